@@ -0,0 +1,281 @@
+/*
+ * bench.cpp
+ *
+ * Measures how fast the virtual machine runs. There is a small loop for each
+ * kind of instruction, plus a few whole programs. Each one is run for a fixed
+ * number of instructions and we report millions of instructions per second
+ * and nanoseconds per instruction, keeping the best of a few runs.
+ *
+ *     leek-bench [-n instructions] [-r repeats] [-f name]
+ *                [-s baseline] [-c baseline] [-t percent]
+ *
+ * -s saves the results to a baseline file, and -c compares against one,
+ * exiting with 1 if anything got slower by more than -t percent (5 by
+ * default). -f only runs benchmarks whose name contains 'name'.
+ *
+ * -- Callum Nicholson
+ */
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+#include "IODevice.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+// A synchronous device that does nothing, so we only measure getting there
+class NullDevice: public IODevice {
+    public:
+        NullDevice(): IODevice(1, true) {}
+};
+
+struct Benchmark {
+    std::string name;
+    std::vector<uint16_t> program;          /* loaded at address 1 */
+    std::vector<std::pair<int, uint16_t>> registers;
+};
+
+std::vector<Benchmark> benchmarks() {
+    std::vector<Benchmark> ret;
+
+    ret.push_back({"alu", {
+        0x3123, //  1: ADD   r1 r2 r3
+        0x4124, //  2: ADDC  r1 r2 r4
+        0x6315, //  3: SUB   r3 r1 r5
+        0x7316, //  4: SUBB  r3 r1 r6
+        0x9127, //  5: MUL   r1 r2 r7
+        0xa728, //  6: DIV   r7 r2 r8
+        0xb129, //  7: ROT   r1 r2 r9
+        0xd12a, //  8: OR    r1 r2 r10
+        0xe12b, //  9: AND   r1 r2 r11
+        0xf12a, // 10: XOR   r1 r2 r10
+        0x5131, // 11: ADDi  r1 $3 r1
+        0x20cf, // 12: REL-  $12   rPC   # line 1
+    }, {{1, 7}, {2, 3}}});
+
+    ret.push_back({"memory", {
+        0x0412, //  1: LOAD  r1    r2
+        0x0323, //  2: STORE r2    r3
+        0x0434, //  3: LOAD  r3    r4
+        0x0341, //  4: STORE r4    r1
+        0x0412, //  5: LOAD  r1    r2
+        0x0323, //  6: STORE r2    r3
+        0x0434, //  7: LOAD  r3    r4
+        0x0341, //  8: STORE r4    r1
+        0x209f, //  9: REL-  $9    rPC   # line 1
+    }, {{1, 0x2000}, {3, 0x2001}}});
+
+    ret.push_back({"flags", {
+        0x085d, //  1: FSET  f5
+        0x075f, //  2: FPRED f5
+        0x5111, //  3: ADDi  r1 $1 r1
+        0x095d, //  4: FCLR  f5
+        0x075f, //  5: FPRED f5
+        0x5111, //  6: ADDi  r1 $1 r1
+        0x0a6d, //  7: FTOG  f6
+        0x208f, //  8: REL-  $8    rPC   # line 1
+    }, {}});
+
+    ret.push_back({"stack", {
+        0x051e, //  1: PUSH  r1
+        0x052e, //  2: PUSH  r2
+        0x06e3, //  3: POP   r3
+        0x06e4, //  4: POP   r4
+        0x051e, //  5: PUSH  r1
+        0x052e, //  6: PUSH  r2
+        0x06e3, //  7: POP   r3
+        0x06e4, //  8: POP   r4
+        0x209f, //  9: REL-  $9    rPC   # line 1
+    }, {{RegisterManager::STACK, 0x4000}}});
+
+    ret.push_back({"device", {
+        0x0319, //  1: STORE r1    r9
+        0x0492, //  2: LOAD  r9    r2
+        0x0319, //  3: STORE r1    r9
+        0x0492, //  4: LOAD  r9    r2
+        0x205f, //  5: REL-  $5    rPC   # line 1
+    }, {{9, 0xc100}}});
+
+    ret.push_back({"fib", {
+        0x3121, //  1: ADD   r1 r2 r1
+        0x3122, //  2: ADD   r1 r2 r2
+        0x203f, //  3: REL-  $3    rPC   # line 1
+    }, {{1, 1}, {2, 1}}});
+
+    // Fill r2 words at r1 backwards, bubble sort them, then start again
+    ret.push_back({"bubblesort", {
+        0x0103, //  1: MOV   r0    r3    # i = 0
+        0x6234, //  2: SUB   r2 r3 r4
+        0x3135, //  3: ADD   r1 r3 r5
+        0x0345, //  4: STORE r4    r5    # a[i] = n - i
+        0x5313, //  5: ADDi  r3 $1 r3
+        0x6320, //  6: SUB   r3 r2 r0
+        0x070f, //  7: FPRED fZERO
+        0x101f, //  8: REL+  $1    rPC   # line 10
+        0x208f, //  9: REL-  $8    rPC   # line 2
+        0x0106, // 10: MOV   r0    r6    # swapped = 0
+        0x0115, // 11: MOV   r1    r5    # p = a
+        0x3127, // 12: ADD   r1 r2 r7
+        0x8717, // 13: SUBi  r7 $1 r7    # end = a + n - 1
+        0x0458, // 14: LOAD  r5    r8
+        0x5519, // 15: ADDi  r5 $1 r9
+        0x049a, // 16: LOAD  r9    r10
+        0x6a80, // 17: SUB   r10 r8 r0
+        0x071f, // 18: FPRED fNEG
+        0x101f, // 19: REL+  $1    rPC   # line 21
+        0x103f, // 20: REL+  $3    rPC   # line 24
+        0x03a5, // 21: STORE r10   r5    # swap
+        0x0389, // 22: STORE r8    r9
+        0x5016, // 23: ADDi  r0 $1 r6    # swapped = 1
+        0x0195, // 24: MOV   r9    r5
+        0x6570, // 25: SUB   r5 r7 r0
+        0x070f, // 26: FPRED fZERO
+        0x101f, // 27: REL+  $1    rPC   # line 29
+        0x20ff, // 28: REL-  $15   rPC   # line 14
+        0x5606, // 29: ADDi  r6 $0 r6
+        0x070f, // 30: FPRED fZERO
+        0x21ff, // 31: REL-  $31   rPC   # line 1
+        0x217f, // 32: REL-  $23   rPC   # line 10
+    }, {{1, 0x1000}, {2, 64}}});
+
+    // Copy r7 words from r1 to r2 one at a time, over and over
+    ret.push_back({"memcpy", {
+        0x0113, //  1: MOV   r1    r3
+        0x0124, //  2: MOV   r2    r4
+        0x0175, //  3: MOV   r7    r5
+        0x0436, //  4: LOAD  r3    r6
+        0x0364, //  5: STORE r6    r4
+        0x5313, //  6: ADDi  r3 $1 r3
+        0x5414, //  7: ADDi  r4 $1 r4
+        0x8515, //  8: SUBi  r5 $1 r5
+        0x070f, //  9: FPRED fZERO
+        0x20af, // 10: REL-  $10   rPC   # line 1
+        0x208f, // 11: REL-  $8    rPC   # line 4
+    }, {{1, 0x2000}, {2, 0x3000}, {7, 256}}});
+
+    return ret;
+}
+
+// Nanoseconds per instruction, the best of 'repeats' runs
+double measure(Benchmark& bench, uint64_t instructions, int repeats) {
+    Processor cpu(0x10000);
+    NullDevice null;
+    cpu.useDevice(null, 0xc100, 0);
+
+    for (int i = 0; i < 16; ++i) cpu.set(i, 0);
+    for (uint16_t word : bench.program) cpu.push(word);
+    for (auto reg : bench.registers) cpu.set(reg.first, reg.second);
+    cpu.set(RegisterManager::PC, 1);
+
+    // Warm up the caches and the branch predictor
+    cpu.runFor(instructions / 10);
+
+    double best = 0;
+    for (int i = 0; i < repeats; ++i) {
+        uint64_t start = cpu.getClock();
+        auto t0 = std::chrono::steady_clock::now();
+        cpu.runFor(instructions);
+        auto t1 = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        double perInstr = ns / (cpu.getClock() - start);
+        if (i == 0 || perInstr < best) best = perInstr;
+    }
+
+    cpu.removeDevice(null);
+    return best;
+}
+
+int main(int argc, char** argv) {
+    uint64_t instructions = 20000000;
+    int repeats = 3;
+    double tolerance = 5;
+    const char* filter   = 0;
+    const char* saveName = 0;
+    const char* compName = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-' || i + 1 >= argc) {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 2;
+        }
+        switch (argv[i][1]) {
+            case 'n': instructions = strtoull(argv[++i], NULL, 10); break;
+            case 'r': repeats      = atoi(argv[++i]);               break;
+            case 't': tolerance    = atof(argv[++i]);               break;
+            case 'f': filter       = argv[++i];                     break;
+            case 's': saveName     = argv[++i];                     break;
+            case 'c': compName     = argv[++i];                     break;
+
+            default:
+                std::cerr << "Unknown option: " << argv[i] << std::endl;
+                return 2;
+        }
+    }
+    if (instructions == 0 || repeats <= 0) {
+        std::cerr << "Need at least one instruction and one repeat" << std::endl;
+        return 2;
+    }
+
+    // The baseline is one benchmark per line, name then ns per instruction
+    std::map<std::string, double> baseline;
+    if (compName) {
+        std::ifstream in(compName);
+        if (!in) {
+            std::cerr << "Could not read baseline " << compName << std::endl;
+            return 2;
+        }
+        std::string name;
+        double ns;
+        while (in >> name >> ns) baseline[name] = ns;
+    }
+
+    std::cout << std::left << std::setw(12) << "benchmark"
+              << std::right << std::setw(10) << "MIPS"
+              << std::setw(12) << "ns/instr";
+    if (compName) std::cout << std::setw(12) << "baseline" << std::setw(10) << "change";
+    std::cout << std::endl;
+
+    std::map<std::string, double> results;
+    bool regressed = false;
+
+    for (Benchmark& bench : benchmarks()) {
+        if (filter && bench.name.find(filter) == std::string::npos) continue;
+
+        double ns = measure(bench, instructions, repeats);
+        results[bench.name] = ns;
+
+        std::cout << std::left << std::setw(12) << bench.name << std::right
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(10) << 1000.0 / ns
+                  << std::setw(12) << ns;
+
+        if (compName && baseline.count(bench.name)) {
+            // Positive is slower
+            double change = (ns / baseline[bench.name] - 1) * 100;
+            std::cout << std::setw(12) << baseline[bench.name]
+                      << std::setw(9) << std::showpos << change << "%"
+                      << std::noshowpos;
+            if (change > tolerance) {
+                std::cout << "  SLOWER";
+                regressed = true;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    if (saveName) {
+        std::ofstream out(saveName);
+        for (auto r : results) out << r.first << " " << r.second << std::endl;
+    }
+
+    return regressed ? 1 : 0;
+}
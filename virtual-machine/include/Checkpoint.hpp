@@ -0,0 +1,39 @@
+/*
+ * Checkpoint.hpp
+ *
+ * Saves the state of a Processor to an append only file so a long running
+ * program can pick up where it left off after the host goes down. Each save
+ * appends a record holding the registers, the interrupt state and only the
+ * pages of memory that have been written since the last save. A record ends
+ * with a checksum, so a record that was only half written when we went down is
+ * simply ignored when restoring.
+ *
+ * Note that the internal state of any IODevices is not saved.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_CHECKPOINT_H_DEFINED
+#define LEEK_VM_CHECKPOINT_H_DEFINED
+
+#include <cstdlib>
+#include <cstdint>
+
+class Processor;
+
+class Checkpoint {
+    public:
+        Checkpoint(const char* filename);
+        ~Checkpoint();
+
+        void save(Processor& cpu);
+        // False if the file is empty. Throws, leaving the file alone, if it
+        // isn't a checkpoint, is for a different memory size or has no
+        // complete record.
+        bool restore(Processor& cpu);
+
+    private:
+        int fd;
+        uint64_t sequence;
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * CodeImage.hpp
+ *
+ * A read only copy of a program that any number of MemoryManagers can map
+ * into their memory (see MemoryManager::mapCode), so a hundred machines
+ * running the same program only hold it once. Hand it around in a
+ * std::shared_ptr, each MemoryManager keeps a reference for as long as it has
+ * the image mapped.
+ *
+ * The words are kept in host memory that is itself read only, so anything
+ * that writes to it without going through the MemoryManager crashes rather
+ * than changing the program under every other machine.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_CODEIMAGE_H_DEFINED
+#define LEEK_VM_CODEIMAGE_H_DEFINED
+
+#include <cstdlib>
+#include <cstdint>
+
+class CodeImage {
+    public:
+        // Copies 'length' words, the rest of the last page is 0
+        CodeImage(const uint16_t* words, size_t length);
+
+        // Maps 'length' words in host byte order from a file, as a Snapshot
+        // holds them. 'offset' must be a multiple of the host page size, and
+        // the file must run to the end of the last page. Only what is used
+        // is read in.
+        CodeImage(int fd, size_t offset, size_t length);
+
+        ~CodeImage();
+
+        size_t pages(); /* of MemoryManager::PAGE_WORDS words */
+        const uint16_t* page(size_t index);
+
+    private:
+        uint16_t* data;
+        size_t    bytes;
+        size_t    pageCount;
+
+        CodeImage(CodeImage const&)      = delete;
+        void operator=(CodeImage const&) = delete;
+};
+
+#endif
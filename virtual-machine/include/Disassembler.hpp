@@ -0,0 +1,84 @@
+/*
+ * Disassembler.hpp
+ *
+ * Turns a memory image back into something close to the assembler's input,
+ * and works out which words are code by following control flow from the
+ * entry points. Control only leaves the straight line through REL+ and REL-
+ * into rPC, FPRED skipping the next instruction, and anything else that
+ * writes rPC (POP rPC to return, MOV rX rPC and so on), which we can't follow
+ * and just mark as indirect. Words we never reach are taken to be data.
+ *
+ * The code is split into basic blocks, and loops are found as back edges to
+ * a block that dominates the block they come from. A jump into the middle of
+ * a loop from outside it (an irreducible loop) is not reported as a loop.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_DISASSEMBLER_H_DEFINED
+#define LEEK_VM_DISASSEMBLER_H_DEFINED
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Disassembler {
+    public:
+        // 'memory' is the whole 64k word image, as leek-vm would load it
+        Disassembler(const std::vector<uint16_t>& memory);
+
+        // One instruction as the assembler would take it, without labels.
+        // REL+ and REL- into rPC are written as JMP+, JMP- and HALT.
+        static std::string text(uint16_t instruction);
+
+        // Where control can go once the instruction at 'address' is done.
+        // Returns false if it writes rPC in a way we can't follow.
+        static bool successors(uint16_t address, uint16_t instruction,
+                std::vector<uint16_t>& out);
+
+        void addEntry(uint16_t address);
+        void analyse(); /* after all the entries have been added */
+
+        static const size_t NO_LOOP = SIZE_MAX;
+
+        struct Block {
+            uint16_t start;
+            uint16_t end;       /* the last instruction */
+            std::vector<uint16_t> successors;   /* starts of blocks */
+            std::vector<uint16_t> predecessors;
+            bool entry;
+            bool indirect;      /* can also go somewhere we can't follow */
+            bool halts;         /* jumps to itself */
+            size_t loop;        /* the innermost loop it is in */
+        };
+
+        struct Loop {
+            uint16_t header;
+            std::vector<uint16_t> blocks;   /* starts, including the header */
+            std::vector<uint16_t> latches;  /* blocks that jump back */
+            size_t parent;      /* the loop this is inside */
+            size_t depth;       /* 1 for a loop not inside any other */
+        };
+
+        bool isCode(uint16_t address);
+        const std::map<uint16_t, Block>& blocks(); /* by start */
+        const std::vector<Loop>& loops();          /* outermost first */
+
+    private:
+        const std::vector<uint16_t>& memory;
+
+        std::vector<uint16_t> entries;
+        std::vector<bool> code;
+        std::vector<bool> leader;
+
+        std::map<uint16_t, Block> blockMap;
+        std::vector<Loop> loopList;
+
+        void findCode();
+        void findBlocks();
+        void findLoops();
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Engine.hpp
+ *
+ * Anything that can run LEEK16 instructions, so different implementations
+ * can be checked against each other (see Verifier.hpp). ProcessorEngine wraps
+ * the Processor we actually run, and Reference (see Reference.hpp) is a
+ * separate, table driven model of what each instruction should do.
+ *
+ * Engines see 64k words of memory with nothing mapped to it, and are only
+ * ever used from one thread at a time. They don't have devices, but INTER
+ * should still interrupt.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_ENGINE_H_DEFINED
+#define LEEK_VM_ENGINE_H_DEFINED
+
+#include "MemoryManager.hpp"
+#include "Processor.hpp"
+
+#include <vector>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Engine {
+    public:
+        virtual ~Engine();
+
+        virtual void exec(uint16_t instruction) = 0;
+        virtual void tick() = 0;
+
+        virtual void     set(size_t index, uint16_t value) = 0;
+        virtual uint16_t inspect(size_t index) = 0;
+
+        virtual void     write(uint16_t address, uint16_t value) = 0;
+        virtual uint16_t read(uint16_t address) = 0;
+
+        // The pages of PAGE_WORDS words written since the last call
+        virtual void dirty(std::vector<size_t>& pages) = 0;
+
+        // Any interrupt still to be taken, packed into a word only the same
+        // engine needs to understand, so it can be put back with the rest
+        virtual uint16_t interrupts() = 0;
+        virtual void     setInterrupts(uint16_t packed) = 0;
+
+        static const size_t PAGE_WORDS = MemoryManager::PAGE_WORDS;
+};
+
+class ProcessorEngine: public Engine {
+    public:
+        ProcessorEngine();
+
+        void exec(uint16_t instruction);
+        void tick();
+
+        void     set(size_t index, uint16_t value);
+        uint16_t inspect(size_t index);
+
+        void     write(uint16_t address, uint16_t value);
+        uint16_t read(uint16_t address);
+
+        void dirty(std::vector<size_t>& pages);
+
+        uint16_t interrupts();
+        void     setInterrupts(uint16_t packed);
+
+    private:
+        MemoryManager mem;
+        Processor cpu;
+};
+
+#endif
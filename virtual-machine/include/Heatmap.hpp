@@ -0,0 +1,75 @@
+/*
+ * Heatmap.hpp
+ *
+ * Counts how often each word of memory is fetched as an instruction, loaded
+ * and stored, to find out which memory a program actually uses. It also
+ * keeps the working set over time, which is how many pages were touched in
+ * each window of WINDOW ticks.
+ *
+ * Only what the program does is counted. Devices and the bulk MemoryManager
+ * operations are not. One Heatmap can be shared by all the cores on the same
+ * memory, a count can be lost if two cores hit the same word at the same time
+ * but nothing worse than that.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_HEATMAP_H_DEFINED
+#define LEEK_VM_HEATMAP_H_DEFINED
+
+#include "MemoryManager.hpp"
+
+#include <ostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Heatmap {
+    public:
+        Heatmap(size_t words, uint64_t window = 10000);
+        ~Heatmap();
+
+        enum Kind {
+            FETCH,
+            LOAD,
+            STORE,
+        };
+
+        // Called from the processor thread with that processor's clock
+        void count(Kind kind, size_t address, uint64_t clock);
+
+        uint32_t get(Kind kind, size_t address);
+
+        // One row per page of PAGE_WORDS words, brighter is busier on a log
+        // scale. Data is loads and stores together.
+        void writeFetchImage(std::ostream& out);
+        void writeDataImage(std::ostream& out);
+
+        void writeWords(std::ostream& out);      /* CSV, only words used */
+        void writePages(std::ostream& out);      /* CSV */
+        void writeWorkingSet(std::ostream& out); /* CSV */
+
+        static const size_t PAGE_WORDS = MemoryManager::PAGE_WORDS;
+
+    private:
+        typedef std::atomic<uint32_t> Counter;
+
+        size_t words;
+        size_t pages;
+        uint64_t window;
+
+        Counter* counts[3];
+
+        // The window each page was last touched in, plus one so that zero
+        // means never. Pages are only added to the working set the first
+        // time they are touched in a window, so the lock is rarely taken.
+        std::atomic<uint64_t>* lastWindow;
+        std::vector<uint32_t> workingSet;
+        std::mutex workingSetM;
+
+        void writeImage(std::ostream& out, const Counter* a, const Counter* b);
+};
+
+#endif
@@ -6,23 +6,53 @@
 #include <cstdlib>
 #include <cstdint>
 
+class MemoryManager;
+
 class IODevice {
     public:
-        IODevice(uint16_t words);
+        IODevice(uint16_t words, bool synchronous = false, bool ownerOnly = false);
+        virtual ~IODevice();
 
         virtual void     write(size_t address, uint16_t value);
         virtual uint16_t  read(size_t address);
 
         uint16_t length();
+        bool isSynchronous();
+
+        // False if the processor running on this thread isn't allowed to
+        // use the device. Only owner only devices say no, and only to the
+        // other cores sharing memory with their processor.
+        bool answersHere();
 
     protected:
         void ready();
 
+        Processor& getProcessor();
+        MemoryManager& getMemory();
+
+        // Have expire called once the processor clock gets 'delay' ticks past
+        // now. Only call these from the processor thread, for example from
+        // the write of a synchronous device.
+        void schedule(uint64_t delay);
+        void cancel();
+        virtual void expire();
+
     private:
         Processor* cpu;
         uint8_t line;
         uint16_t words;
 
+        // Synchronous devices have write called on the processor thread in
+        // between instructions instead of on a new thread. This suits devices
+        // that are quick, or that need to see the machine in a consistent
+        // state.
+        bool synchronous;
+
+        // Owner only devices work on their processor's clock, events or
+        // flags, which only that processor's thread may touch. Other cores
+        // read 0 from them and their writes are dropped.
+        bool ownerOnly;
+
         friend Processor;
 };
 
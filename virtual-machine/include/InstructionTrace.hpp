@@ -0,0 +1,118 @@
+/*
+ * InstructionTrace.hpp
+ *
+ * Records every instruction a processor runs: where it was, the instruction
+ * word, the value it wrote and the flags after it. Most instructions follow
+ * on from the one before, are the same as last time they were run from that
+ * address and only change the value a little, so each record is a byte of
+ * "same as before" bits plus whatever did change, usually 1 ~ 3 bytes all
+ * told.
+ *
+ * Records are packed into blocks. Once a block is full it is handed to a
+ * writer thread which puts it on disk, so the processor only ever waits if
+ * the disk can't keep up with BLOCKS blocks. Every block can be decoded on
+ * its own, and the Reader streams a trace a block at a time however big it
+ * is. See tools/trace.cpp for leek-trace.
+ *
+ * If a write fails the trace stops there and the rest is thrown away. flush
+ * throws the error, or the destructor prints it if nothing flushed since.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_INSTRUCTION_TRACE_H_DEFINED
+#define LEEK_VM_INSTRUCTION_TRACE_H_DEFINED
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+class InstructionTrace {
+    public:
+        InstructionTrace(const char* filename, size_t blockBytes = 1 << 16,
+                size_t blocks = 8);
+        ~InstructionTrace();
+
+        struct Record {
+            uint64_t index;
+            uint16_t pc;
+            uint16_t instruction;
+            uint16_t value;
+            uint16_t flags;
+            bool interrupted; /* an interrupt was taken just before this */
+        };
+
+        // Only call these from one thread, normally the processor's
+        void record(uint16_t pc, uint16_t instruction, uint16_t value,
+                uint16_t flags, bool interrupted);
+        void flush(); /* returns once everything so far is on disk */
+
+        uint64_t stalls(); /* how often record waited for the writer */
+
+        class Reader {
+            public:
+                Reader(const char* filename);
+                ~Reader();
+
+                bool next(Record& rec); /* false at the end of the trace */
+
+            private:
+                FILE* file;
+                std::vector<uint8_t> block;
+                size_t pos;
+                uint32_t left;
+                uint64_t index;
+
+                uint16_t pc;
+                uint16_t value;
+                uint16_t flags;
+                std::vector<uint16_t> instructions;
+                std::vector<uint32_t> seen;
+                uint32_t epoch;
+        };
+
+    private:
+        int fd;
+        size_t blockBytes;
+        size_t blocks;
+
+        // The block being filled and the state it was encoded against. An
+        // instruction is only "the same as last time" if last time was in
+        // the same block, which the epoch keeps track of.
+        std::vector<uint8_t> current;
+        uint32_t count;
+        uint16_t pc;
+        uint16_t value;
+        uint16_t flags;
+        std::vector<uint16_t> instructions;
+        std::vector<uint32_t> seen;
+        uint32_t epoch;
+
+        // Full blocks waiting for the writer, and empty ones to reuse
+        std::deque<std::vector<uint8_t>> full;
+        std::vector<std::vector<uint8_t>> spare;
+        size_t writing;
+        bool done;
+        uint64_t stallCount;
+
+        // Set by the writer when a write fails, after which nothing more is
+        // written. 'stopped' is the processor thread's copy.
+        std::string error;
+        bool stopped;
+        bool reported;
+        std::mutex m;
+        std::condition_variable cv;
+        std::thread writer;
+
+        void startBlock();
+        void submit();
+        void writeLoop();
+};
+
+#endif
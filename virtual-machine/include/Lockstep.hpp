@@ -0,0 +1,73 @@
+/*
+ * Lockstep.hpp
+ *
+ * Runs the same program on two Engines side by side to check a new engine
+ * against a trusted one. Every 'interval' ticks the registers and any memory
+ * either engine has written are compared. When they agree that state is kept
+ * as a checkpoint. When they don't, both are put back to the checkpoint and
+ * we bisect on the number of ticks to find the first one where they part
+ * ways, which is reported in full.
+ *
+ * Both engines must be set up the same way before calling run. A bisect
+ * puts back the registers, memory and each engine's pending interrupts.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_LOCKSTEP_H_DEFINED
+#define LEEK_VM_LOCKSTEP_H_DEFINED
+
+#include "Engine.hpp"
+#include "Verifier.hpp"
+
+#include <vector>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Lockstep {
+    public:
+        Lockstep(Engine& expected, Engine& actual, uint64_t interval);
+
+        enum Result {
+            HALTED,   /* both halted in the same state */
+            LIMIT,    /* ran 'limit' ticks without a difference */
+            DIVERGED,
+        };
+        Result run(uint64_t limit = UINT64_MAX);
+
+        // After DIVERGED, the tick that went wrong counting from 0. The
+        // registers before are from just before that tick.
+        uint64_t divergedAt();
+        const Verifier::Divergence& divergence();
+
+        uint64_t ticks(); /* how many have been run so far */
+
+    private:
+        Engine& expected;
+        Engine& actual;
+        uint64_t interval;
+
+        // The last state both engines agreed on
+        uint64_t checkpointTick;
+        uint16_t checkpointRegs[16];
+        uint16_t checkpointInterrupts[2]; /* expected, actual */
+        std::vector<uint16_t> checkpointMem;
+
+        uint64_t tickCount;
+        uint64_t firstBad;
+        Verifier::Divergence found;
+
+        bool step();    /* true if neither changed a register */
+        bool compare(); /* also takes the dirty pages */
+        void save();
+        void restore();
+        void replay(uint64_t count);
+        void bisect(uint64_t bad);
+        void describe();  /* fill in found from now and pages */
+
+        void takeDirty(); /* pages either engine wrote, into pages */
+
+        std::vector<size_t> pages;
+};
+
+#endif
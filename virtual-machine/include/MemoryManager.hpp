@@ -1,10 +1,18 @@
 /*
  * MemoryManager.hpp
  *
- * For now this just allocates a "big" 64k array to store data. Note that the
- * byte size of this machine is 16 bits though, so it's 128k of physical system
- * memory. This is a class so I can make some of the memory map to peripherals
- * later on.
+ * This stores a "big" 64k array of data. Note that the byte size of this
+ * machine is 16 bits though, so it's 128k of physical system memory. This is
+ * a class so I can make some of the memory map to peripherals later on.
+ *
+ * Memory is split into pages of PAGE_WORDS words, and all access goes through
+ * a page table so that pages can be pointed at memory outside of the 64k.
+ * Pages can also be pointed at a CodeImage that other machines share, which
+ * are read only until written to.
+ *
+ * Every page starts out pointing at one page of zeros shared by everything,
+ * and only gets memory of its own the first time it is written to. So memory
+ * always starts zeroed, and a machine only costs the pages it actually uses.
  *
  * -- Callum Nicholson
  */
@@ -12,30 +20,105 @@
 #define LEEK_VM_MEMORY_H_DEFINED
 
 #include <set>
+#include <vector>
 #include <utility>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 #include <cstdlib>
 #include <cstdint>
 
 class IODevice;
+class CodeImage;
+class Checkpoint;
+class Snapshot;
 
 class MemoryManager {
     public:
         MemoryManager(size_t words);
         ~MemoryManager();
 
+        // operator[] is the write path, it marks the page as dirty. Use read
+        // if you only want to look at the value.
         uint16_t& operator[](size_t index);
+        uint16_t read(size_t index);
         void setRange(size_t index, uint16_t* values, size_t length);
+        void getRange(size_t index, uint16_t* values, size_t length);
+        void moveRange(size_t dest, size_t src, size_t length);
+        void fillRange(size_t index, uint16_t value, size_t length);
+        void mapFile(int fd, size_t offset);
+
+        // Pages with devices on can't be mapped
+        void mapPage(size_t page, uint16_t* frame);
+        void unmapPage(size_t page);
+
+        // Points the pages from 'page' on at 'image' rather than copying it
+        // in. A store to one of them gives this memory its own copy of that
+        // page if 'copyOnWrite', and throws std::runtime_error if not.
+        // Devices can't go on these pages.
+        void mapCode(size_t page, std::shared_ptr<CodeImage> image, bool copyOnWrite);
+
+        // Hands over the pages written since the last call (or since the
+        // last checkpoint, they share the list) and starts again
+        void takeDirty(std::vector<size_t>& pages);
+
+        // Pages that have memory of their own, rather than pointing at the
+        // zero page or at shared code
+        size_t pagesInUse();
 
         void useDevice(IODevice& dev, size_t pos);
         void removeDevice(IODevice& dev);
-        void writeIfDevice(uint16_t* data);
+        // Hands 'value', just stored at 'index', to the device there if
+        // there is one. Memory is shared between cores, so the value comes
+        // from the caller rather than being read back.
+        void writeIfDevice(size_t index, uint16_t value);
+
+        static const size_t PAGE_WORDS = 256;
 
     private:
         size_t    words;
-        uint16_t* data;
+        uint16_t* data; /* only touched as pages get their own copy */
+
+        // Every access goes through here. Normally page i just points to
+        // its own part of data, but pages can be pointed elsewhere (see the
+        // MMU device). Other cores look entries up without a lock, see
+        // privatePage for the order they are changed in.
+        std::vector<std::atomic<uint16_t*>> pageTable;
+
+        // How many devices are on each page
+        std::vector<uint8_t> devicePages;
+
+        // One byte per page, plus a list of the dirty pages so we don't need
+        // to scan the whole thing to find them. Devices with their own
+        // threads write to memory too, so adding to the list takes a lock.
+        std::vector<uint8_t> dirty;
+        std::vector<size_t>  dirtyPages;
+        std::mutex dirtyM;
+
+        void markDirty(size_t page);
+
+        // For pages that still point at the zero page or at shared code from
+        // mapCode, what a store does. codeFrames is what unmapPage goes back
+        // to, until the page gets its own copy.
+        enum Share {
+            PRIVATE,
+            FAULT,
+            COPY,
+        };
+        std::vector<std::atomic<uint8_t>> shared;
+        std::vector<uint16_t*> codeFrames;
+        std::vector<uint8_t>   codeShare;
+        std::vector<std::shared_ptr<CodeImage>> images;
+        std::mutex copyM;
+
+        void makeWritable(size_t page);     /* before a store to a shared page */
+        uint16_t* privatePage(size_t page); /* copies it even if it would fault */
 
         std::set<std::pair<IODevice*, size_t>> devices;
+
+        friend Checkpoint;
+        friend Snapshot;
 };
 
 #endif
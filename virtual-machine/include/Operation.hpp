@@ -26,6 +26,7 @@ class Operation {
 
         static Operation& fromInstruction(uint16_t instruction);
         Mode getMode();
+        const char* getName(); /* as written in the assembler */
 
         // Move operations
         static Operation NOP, MOV, RELp, RELm;
@@ -39,10 +40,13 @@ class Operation {
         static Operation FPRED, FSET, FCLR, FTOG;
         // Interrupt operations
         static Operation INTER, WFI;
+        // Anything else (0x0d00 ~ 0x0fff), which does nothing
+        static Operation UNDEF;
 
     private:
         uint8_t opCode;
         Mode    mode;
+        const char* name;
 
         Operation(Operation const&)      = delete;
         void operator=(Operation const&) = delete;
@@ -50,7 +54,7 @@ class Operation {
         static Operation* shortOps[16];
         static Operation* longOps[16];
 
-        Operation(uint8_t opCode, Mode mode);
+        Operation(uint8_t opCode, Mode mode, const char* name);
 };
 
 bool operator==(Operation& lhs, Operation& rhs);
@@ -11,6 +11,7 @@
 #include "MemoryManager.hpp"
 #include "RegisterManager.hpp"
 
+#include <map>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -19,34 +20,125 @@
 #include <cstdint>
 
 class IODevice;
+class InterruptController;
+class Heatmap;
+class InstructionTrace;
+class Scheduler;
+class Checkpoint;
+class Snapshot;
+class ProcessorEngine;
 
 class Processor {
     public:
         Processor(size_t memWords);
+        Processor(MemoryManager& shared); /* another core on the same memory */
+        ~Processor();
 
         void exec(uint16_t instruction);
         void tick();
         void run();
+
+        // Run at most 'limit' ticks and say why we stopped. WAITING only
+        // happens with setParkOnWait.
+        enum RunResult {
+            HALTED,
+            STOPPED,
+            WAITING,
+            PREEMPTED,
+        };
+        RunResult runFor(uint64_t limit);
+
+        // Have WFI return WAITING from runFor rather than block when there is
+        // no interrupt yet. The WFI is finished off by the next runFor once
+        // one comes in.
+        void setParkOnWait(bool park);
+        void stop();              /* thread safe */
         void interrupt(int line); /* thread safe */
 
         void useDevice(IODevice& dev, size_t pos, uint8_t line);
         void removeDevice(IODevice& dev);
 
+        void useCheckpoint(Checkpoint& cp, uint64_t interval);
+        void useInterruptController(InterruptController& ic);
+        void useHeatmap(Heatmap& map);
+        void useInstructionTrace(InstructionTrace& trace);
+
         void push(uint16_t instruction);
         void set(size_t index, uint16_t value);
         uint16_t inspect(size_t index);
+
+        uint64_t getClock();
+
+        // The processor whose run or runFor this thread is in, or NULL
+        static Processor* running();
     private:
         std::mutex sleepM;
         std::condition_variable sleepCV;
 
         bool lastTickWasInterrupt;
+        bool wakePending;
+        std::atomic<bool> stopRequested;
 
         std::atomic<bool> anyISF;
         std::atomic<bool> softISF;
         std::atomic<bool> hardISF[8];
 
-        MemoryManager mem;
+        // Cores made with the second constructor share memory with another
+        // Processor, otherwise we own it
+        MemoryManager* ownedMem;
+        MemoryManager& mem;
         RegisterManager reg;
+
+        // The clock counts ticks. Devices can ask to have expire called at a
+        // certain time, which happens on the processor thread before the
+        // tick at that time. These are only touched by the processor thread.
+        uint64_t clock;
+        uint64_t nextEvent;
+        std::multimap<uint64_t, IODevice*> events;
+
+        void init();
+
+        void schedule(IODevice& dev, uint64_t when);
+        void cancel(IODevice& dev);
+        void fireEvents();
+
+        // Interrupt state packed into a word for saving to file. Bits 0 ~ 7
+        // are the hardware lines, then the software line, anyISF, whether
+        // the last tick was an interrupt and wakePending.
+        uint16_t packInterrupts();
+        void unpackInterrupts(uint16_t packed);
+
+        Checkpoint* checkpoint;
+        uint64_t checkpointInterval;
+        uint64_t sinceCheckpoint;
+
+        InterruptController* controller;
+        Heatmap* heatmap;
+
+        // The value the last exec wrote, for the instruction trace
+        InstructionTrace* itrace;
+        uint16_t lastResult;
+
+        // Under a Scheduler a WFI that would block parks the processor
+        // instead, and interrupt hands it back to the scheduler
+        bool parkOnWait;
+        std::atomic<Scheduler*> scheduler;
+        std::atomic<uint8_t> schedState;
+        bool parked;
+
+        void finishWait();
+
+        // For Stats, when the oldest interrupt we haven't jumped for yet
+        // came in and when we started waiting, both in ns or 0
+        std::atomic<uint64_t> raisedAt;
+        uint64_t waitStart;
+
+        friend IODevice;
+        friend InterruptController;
+        friend Scheduler;
+        friend Checkpoint;
+        friend Snapshot;
+        friend ProcessorEngine;
 };
 
 #endif
@@ -0,0 +1,101 @@
+/*
+ * Reference.hpp
+ *
+ * A model of what every LEEK16 instruction does, written as a table rather
+ * than the chain of ifs in Processor::exec, so the two are unlikely to share
+ * a mistake. It is as simple as we can make it and not meant to be fast.
+ *
+ * An instruction works out a result from two inputs and then writes, in this
+ * order, the result, AUX, STACK and the flags. Interrupts and WFI don't
+ * change any registers, and encodings that don't name an operation do
+ * nothing at all.
+ *
+ * tick fetches and runs the instruction at PC. Only the software interrupt
+ * is modelled, there are no devices and so no other interrupts.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_REFERENCE_H_DEFINED
+#define LEEK_VM_REFERENCE_H_DEFINED
+
+#include "Engine.hpp"
+
+#include <vector>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Reference: public Engine {
+    public:
+        Reference();
+
+        void exec(uint16_t instruction);
+        void tick();
+
+        void     set(size_t index, uint16_t value);
+        uint16_t inspect(size_t index);
+
+        void     write(uint16_t address, uint16_t value);
+        uint16_t read(uint16_t address);
+
+        void dirty(std::vector<size_t>& pages);
+
+        uint16_t interrupts();   /* 1 if softPending */
+        void     setInterrupts(uint16_t packed);
+
+        // Where the inputs come from
+        enum Mode {
+            IIR, /* 8 bit literal, PC */
+            RIR, /* register, 4 bit literal */
+            RRR, /* register, register */
+            IR,  /* 4 bit literal, register C */
+            RR,  /* register B, register C */
+        };
+
+        // Where the result goes
+        enum Dest {
+            NONE,
+            REG,    /* register C, dropped if that is r0 */
+            MEMORY, /* memory at register C */
+        };
+
+        // What an operation makes of its inputs
+        struct Outcome {
+            uint16_t res;
+            bool write;     /* false to skip writing res after all */
+            bool writeAux;
+            uint16_t aux;
+            bool setCarry;  /* sets carry and overflow */
+            bool carry;
+            bool over;
+            bool setState;  /* sets zero and negative from res */
+            uint16_t flags; /* for operations on the flags themselves */
+        };
+
+        struct Entry {
+            const char* name;
+            Mode mode;
+            Dest dest;
+            bool push;  /* STACK goes up before the inputs are read */
+            bool load;  /* inA is an address to read */
+            bool pop;   /* STACK goes down after */
+            void (*op)(uint16_t inA, uint16_t inB, uint16_t flags,
+                    uint16_t aux, Outcome& out);
+        };
+
+        // Long operations are found by their top 4 bits, the rest by the
+        // next 4 bits, so 16 + opHi or opLo
+        static const Entry& entry(uint16_t instruction);
+
+    private:
+        uint16_t reg[16];
+        std::vector<uint16_t> memory;
+
+        void store(uint16_t address, uint16_t value);
+        std::vector<uint8_t> dirtyFlags;
+        std::vector<size_t>  dirtyPages;
+
+        bool softPending; /* INTER was run, seen by the next tick */
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Scheduler.hpp
+ *
+ * Runs lots of Processors on a few host threads. Each worker takes a
+ * processor off the run queue and runs it for a time slice. A processor that
+ * waits for an interrupt is parked rather than holding on to the thread, and
+ * goes back on the queue when Processor::interrupt is called on it. So a big
+ * fleet of mostly idle machines costs next to nothing.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_SCHEDULER_H_DEFINED
+#define LEEK_VM_SCHEDULER_H_DEFINED
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Processor;
+
+class Scheduler {
+    public:
+        Scheduler(size_t workers, uint64_t slice = 10000);
+        ~Scheduler();
+
+        void add(Processor& cpu);   /* thread safe */
+        void wait();                /* untill everything added has halted */
+        size_t count();             /* how many have not halted yet */
+
+    private:
+        enum State {
+            QUEUED,
+            RUNNING,
+            PARKED,
+            HALTED,
+        };
+
+        uint64_t slice;
+
+        std::mutex mt;
+        std::condition_variable queueCV;
+        std::condition_variable doneCV;
+        std::deque<Processor*> queue;
+        size_t live;
+        bool done;
+
+        std::vector<std::thread> workers;
+
+        void work();
+        void enqueue(Processor& cpu);
+        void wake(Processor& cpu);
+
+        friend Processor;
+};
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Snapshot.hpp
+ *
+ * A snapshot is a full image of the machine at one instant, so a program that
+ * spends a long time setting itself up only has to do it once. The file is a
+ * header page holding the registers and interrupt state, followed by all of
+ * memory starting on a page boundary. That way booting is just a copy on
+ * write mmap of the file, and memory is only read in as it is touched.
+ *
+ * Like checkpoints, the internal state of IODevices is not saved.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_SNAPSHOT_H_DEFINED
+#define LEEK_VM_SNAPSHOT_H_DEFINED
+
+#include <cstdlib>
+#include <cstdint>
+
+class Processor;
+
+class Snapshot {
+    public:
+        static void save(Processor& cpu, const char* filename);
+        static void boot(Processor& cpu, const char* filename);
+};
+
+#endif
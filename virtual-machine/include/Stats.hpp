@@ -0,0 +1,83 @@
+/*
+ * Stats.hpp
+ *
+ * Counts what the machine is doing: instructions by opcode, loads and stores
+ * by region of memory, device reads and writes, interrupts by line, time
+ * spent in WFI and how long interrupts take to be handled. Nothing is counted
+ * unless Stats::enabled is set, which is a single check per instruction.
+ *
+ * Each thread counts into its own block, so the processor threads never
+ * fight over a cache line. The blocks are only added up when the counts are
+ * written out. A thread's block is passed on to the next new thread when it
+ * exits, so there are only ever as many as there were threads at once.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_STATS_H_DEFINED
+#define LEEK_VM_STATS_H_DEFINED
+
+#include <ostream>
+#include <atomic>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Stats {
+    public:
+        static bool enabled; /* set before any processors start */
+
+        static const size_t REGION_WORDS = 0x1000;
+        static const size_t REGIONS      = 0x10000 / REGION_WORDS;
+        static const size_t OPCODES      = 32;
+        static const size_t BUCKETS      = 40;
+        static const size_t DEVICES      = 64;
+
+        // Called from the processor thread
+        static void retire(uint16_t instruction);
+        static void load(size_t address);
+        static void store(size_t address);
+        static void deviceRead(size_t pos);
+        static void deviceWrite(size_t pos);
+        static void wait(uint64_t ns);
+        static void latency(uint64_t ns);
+
+        // Called from any thread
+        static void interrupt(int line);
+        static uint64_t now(); /* nanoseconds */
+
+        static void dump(std::ostream& out); /* as JSON */
+        static void dumpOnSignal(int signal, const char* filename);
+
+    private:
+        // Only the owning thread writes these, so a relaxed load and store
+        // is enough and costs the same as a plain increment
+        typedef std::atomic<uint64_t> Counter;
+
+        struct Counters {
+            Counters();
+
+            Counter ops[OPCODES];
+            Counter loads[REGIONS];
+            Counter stores[REGIONS];
+            Counter waits;
+            Counter waitNs;
+            Counter latency[BUCKETS];
+
+            // Keyed by where the device is mapped. A free slot's counts are
+            // already 0, so the owner publishes the key first and bumps the
+            // counts after, and a dump in between just sees 0 for them.
+            struct Device {
+                std::atomic<size_t> pos; /* NO_DEVICE if the slot is free */
+                Counter reads;
+                Counter writes;
+            } devices[DEVICES];
+        };
+
+        static const size_t NO_DEVICE = SIZE_MAX;
+
+        static Counters& local();
+        static void bump(Counter& c, uint64_t n = 1);
+        static Counters::Device* device(size_t pos);
+};
+
+#endif
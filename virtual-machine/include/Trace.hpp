@@ -0,0 +1,79 @@
+/*
+ * Trace.hpp
+ *
+ * Records a timeline of what the machine did, to be opened in chrome://tracing
+ * or Perfetto. Events are stamped with host time, so a device that takes its
+ * time or an interrupt storm shows up as it happened. Nothing is recorded
+ * unless Trace::enabled is set.
+ *
+ * Each thread appends to its own buffer without taking a lock, the buffers are
+ * only read when the trace is written out. A thread stops recording once its
+ * buffer is full rather than grow without end. When a thread exits its buffer
+ * goes to the next thread to start, so in the trace a "thread" is one of
+ * these buffers, which may have been used by several host threads one after
+ * another.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_TRACE_H_DEFINED
+#define LEEK_VM_TRACE_H_DEFINED
+
+#include <ostream>
+#include <atomic>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Trace {
+    public:
+        static bool enabled; /* set before any processors start */
+
+        static const size_t CHUNK_EVENTS  = 256;
+        static const size_t THREAD_EVENTS = 1 << 20;
+
+        // Names must be string literals, only the pointer is kept
+        static void instant(const char* name, uint64_t arg);
+        static void complete(const char* name, uint64_t start, uint64_t arg);
+
+        // Spans that can start and end on different threads, matched by id
+        static void begin(const char* name, uint64_t id);
+        static void end(const char* name, uint64_t id);
+
+        static uint64_t now(); /* nanoseconds, the same clock as Stats::now */
+
+        static void write(std::ostream& out); /* as Chrome trace-event JSON */
+
+    private:
+        struct Event {
+            const char* name;
+            char     phase;
+            uint64_t ts;
+            uint64_t dur;
+            uint64_t arg;
+        };
+
+        struct Chunk {
+            Chunk();
+
+            Event events[CHUNK_EVENTS];
+            std::atomic<Chunk*> next;
+        };
+
+        // The owner fills in an event before bumping count, so the writer
+        // only ever sees whole events
+        struct Buffer {
+            Buffer(size_t tid);
+
+            size_t tid;
+            Chunk  head;
+            Chunk* tail;  /* owner only */
+            std::atomic<size_t> count;
+            std::atomic<uint64_t> dropped;
+        };
+
+        static Buffer& local();
+        static void record(const char* name, char phase, uint64_t ts,
+                uint64_t dur, uint64_t arg);
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Verifier.hpp
+ *
+ * Checks one Engine against another, by default Processor against the
+ * Reference model. Every encoding in a range is run from a number of starting
+ * states, picked to hit the edge cases (zero, one, the sign bit, all ones)
+ * as well as random ones, and the registers and any memory the instruction
+ * could have written are compared afterwards. The encodings are shared out
+ * between threads, each with its own pair of engines.
+ *
+ * When the engines disagree the starting state is cut down as far as it will
+ * go while they still disagree, so the report only shows what matters.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_VERIFIER_H_DEFINED
+#define LEEK_VM_VERIFIER_H_DEFINED
+
+#include "Engine.hpp"
+
+#include <ostream>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Verifier {
+    public:
+        typedef std::function<Engine*()> Factory;
+
+        // Check 'actual' against 'expected', which defaults to the Reference
+        Verifier(Factory actual, Factory expected = Factory());
+
+        void setThreads(size_t threads);      /* 0 for one per host core */
+        void setSamples(size_t samples);      /* states per encoding */
+        void setMaxDivergences(size_t max);   /* stop after this many */
+        void setSeed(uint64_t seed);
+
+        struct Divergence {
+            uint16_t instruction;
+            uint16_t before[16];
+            uint16_t expected[16];
+            uint16_t actual[16];
+
+            // Memory that differs afterwards, with value expected and actual
+            std::vector<uint16_t> addresses;
+            std::vector<uint16_t> expectedMem;
+            std::vector<uint16_t> actualMem;
+
+            const char* error; /* what the engine threw, if it threw */
+        };
+
+        // Check instructions first ~ first + count - 1. Returns how many
+        // cases were run, the divergences found are left in divergences().
+        uint64_t run(uint32_t first = 0, uint32_t count = 0x10000);
+
+        const std::vector<Divergence>& divergences();
+
+        static void print(std::ostream& out, const Divergence& d);
+
+        // Starting memory is this, so loads see something worth comparing
+        static uint16_t pattern(uint16_t address);
+
+    private:
+        Factory actual;
+        Factory expected;
+
+        size_t threads;
+        size_t samples;
+        size_t maxDivergences;
+        uint64_t seed;
+
+        std::vector<Divergence> found;
+        std::mutex foundM;
+
+        struct Pair {
+            Engine* expected;
+            Engine* actual;
+        };
+
+        void work(uint32_t first, uint32_t count, std::atomic<uint32_t>& next,
+                std::atomic<uint64_t>& cases);
+        void state(uint16_t instruction, size_t sample, uint16_t* regs);
+        bool check(Pair& p, uint16_t instruction, const uint16_t* regs,
+                Divergence* d);
+        void minimise(Pair& p, uint16_t instruction, uint16_t* regs);
+};
+
+#endif
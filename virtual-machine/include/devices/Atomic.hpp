@@ -0,0 +1,37 @@
+#ifndef LEEK_VM_DEVICES_ATOMIC_H_DEFINED
+#define LEEK_VM_DEVICES_ATOMIC_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <atomic>
+
+#include <cstdlib>
+#include <cstdint>
+
+// Lets cores that share memory keep out of each others way. Each access is a
+// single read or write, so no core can see another core half way through an
+// operation. The registers are
+//
+//     0  ~ 15  LOCK     reading sets the lock to 1 and gives what it was
+//                       before, so reading 0 means you have it. Write 0 to
+//                       let it go.
+//     16 ~ 31  COUNTER  reading adds 1 and gives what it was before, which
+//                       is handy for handing out work. Writing sets it.
+//
+// The device never interrupts.
+class Atomic: public IODevice {
+    public:
+        Atomic();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+        static const size_t LOCKS    = 16;
+        static const size_t COUNTERS = 16;
+
+    private:
+        std::atomic<uint16_t> locks[LOCKS];
+        std::atomic<uint16_t> counters[COUNTERS];
+};
+
+#endif
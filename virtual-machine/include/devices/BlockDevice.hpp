@@ -0,0 +1,75 @@
+#ifndef LEEK_VM_DEVICES_BLOCK_DEVICE_H_DEFINED
+#define LEEK_VM_DEVICES_BLOCK_DEVICE_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdlib>
+#include <cstdint>
+
+// A disk backed by a host file, which is mapped into memory so a transfer is
+// just a copy. Sectors are SECTOR_WORDS words, the same size as a page. The
+// registers are
+//
+//     0  SECTOR_LO  sector to transfer
+//     1  SECTOR_HI
+//     2  BUFFER     address in memory to transfer to or from
+//     3  COMMAND    write 1 to read a sector into memory, 2 to write one out
+//                   to the disk, 3 to make sure everything is on the host disk
+//     4  STATUS     (read only) 1 while busy, then 2 if any command failed
+//                   since STATUS was last read, otherwise 0. Reading 2 clears
+//                   it.
+//     5  SIZE_LO    (read only) number of sectors on the disk
+//     6  SIZE_HI
+//
+// The device interrupts when a command is done. In asynchronous mode commands
+// are carried out on a separate thread while the program keeps running, and
+// further commands queue up behind it. Otherwise they are done before the
+// next instruction.
+class BlockDevice: public IODevice {
+    public:
+        BlockDevice(const char* filename, size_t sectors = 0, bool async = true);
+        ~BlockDevice();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+        enum Command {
+            READ  = 1,
+            WRITE = 2,
+            SYNC  = 3,
+        };
+
+        static const size_t SECTOR_WORDS = 256;
+
+    private:
+        struct Request {
+            uint16_t command;
+            uint32_t sector;
+            uint16_t buffer;
+        };
+
+        int fd;
+        uint16_t* disk;
+        size_t sectors;
+
+        uint32_t sector;
+        uint16_t buffer;
+        bool failed;
+
+        bool async;
+        bool done;
+        std::deque<Request> requests;
+        std::mutex mt;
+        std::condition_variable requestCV;
+        std::thread worker;
+
+        bool carryOut(Request req);
+        void workLoop();
+};
+
+#endif
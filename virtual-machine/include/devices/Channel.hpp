@@ -0,0 +1,86 @@
+#ifndef LEEK_VM_DEVICES_CHANNEL_H_DEFINED
+#define LEEK_VM_DEVICES_CHANNEL_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <vector>
+#include <atomic>
+
+#include <cstdlib>
+#include <cstdint>
+
+class Channel;
+
+// One end of a Channel. Each end is used by a different Processor, and
+// whatever is sent from one end is received at the other. The registers are
+//
+//     0  DATA    writing sends a word, reading receives one (0 if there is
+//                nothing to receive)
+//     1  STATUS  bit 0 is set if there is something to receive, bit 1 if
+//                there is space to send, bit 2 if a word has been lost by
+//                sending with no space since STATUS was last read
+//     2  COUNT   how many words there are to receive (at most 0xffff)
+//     3  SPACE   how many words can be sent (at most 0xffff)
+//
+// The device interrupts when data arrives after this end found nothing to
+// receive, and when space frees up after this end found no space to send.
+// So a program that checks COUNT or SPACE and then waits with WFI won't miss
+// its wake up.
+class ChannelEnd: public IODevice {
+    public:
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+    private:
+        ChannelEnd(Channel& channel, int side);
+
+        Channel& channel;
+        int side;
+
+        bool lost;
+
+        void notify(); /* called from the other end's thread */
+
+        friend Channel;
+};
+
+// Connects two virtual machines in the same host process, without locks.
+// Each direction is a ring that only one processor thread writes and only
+// one reads, so all we need is a head and a tail.
+class Channel {
+    public:
+        Channel(size_t capacity = 0x1000); /* rounded up to a power of 2 */
+
+        ChannelEnd& end(int side);         /* side is 0 or 1 */
+
+    private:
+        struct Ring {
+            Ring(size_t capacity);
+
+            std::vector<uint16_t> data;
+            size_t mask;
+
+            // Keep the two threads' counters on separate cache lines
+            char pad0[64];
+            std::atomic<size_t> head;     /* written by the sender */
+            std::atomic<bool>   blocked;  /* sender found no space */
+            size_t tailCache;             /* sender's copy of tail */
+            char pad1[64];
+            std::atomic<size_t> tail;     /* written by the receiver */
+            std::atomic<bool>   waiting;  /* receiver found nothing */
+            size_t headCache;             /* receiver's copy of head */
+            char pad2[64];
+        };
+
+        Ring rings[2];   /* ring i carries data to side i */
+        ChannelEnd ends[2];
+
+        bool send(int side, uint16_t value);
+        bool receive(int side, uint16_t& value);
+        size_t count(int side);
+        size_t space(int side);
+
+        friend ChannelEnd;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef LEEK_VM_DEVICES_CONSOLE_H_DEFINED
+#define LEEK_VM_DEVICES_CONSOLE_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdlib>
+#include <cstdint>
+
+// A serial style output device. Output is collected in a ring buffer and
+// written to the host in batches by a separate thread, so printing a lot
+// doesn't cost a system call per word. The registers are
+//
+//     0  DATA    write a character (low byte) or a number, depending on MODE
+//     1  MODE    0 for characters, 1 for numbers. Numbers are printed in
+//                decimal followed by a new line, like numdisp.
+//     2  SPACE   (read only) how many more characters fit in the buffer
+//     3  FLUSH   write anything to have the buffer written out soon
+//
+// The device interrupts when a write has been taken and there is room for
+// more. If a write fills the buffer the interrupt waits untill some of it has
+// been written out. Writing to a full buffer waits for room.
+class Console: public IODevice {
+    public:
+        enum Mode {
+            CHARACTER,
+            NUMBER,
+        };
+
+        Console(int fd = 1, Mode mode = NUMBER);
+        ~Console();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+        static const size_t CAPACITY = 4096;
+
+    private:
+        int fd;
+        uint16_t mode;
+
+        std::vector<char> buffer;
+        size_t head;
+        size_t count;
+
+        bool waitingForSpace;
+        bool flushRequested;
+        bool done;
+
+        std::mutex mt;
+        std::condition_variable dataCV;
+        std::condition_variable spaceCV;
+        std::thread writer;
+
+        void put(const char* text, size_t length);
+        void writeLoop();
+};
+
+#endif
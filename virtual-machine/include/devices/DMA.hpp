@@ -0,0 +1,48 @@
+#ifndef LEEK_VM_DEVICES_DMA_H_DEFINED
+#define LEEK_VM_DEVICES_DMA_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+// Moves blocks of memory around far faster than a LOAD/STORE loop can. The
+// registers are
+//
+//     0  SRC      source address, or the value to fill with
+//     1  DEST     destination address
+//     2  LENGTH   number of words
+//     3  MODE     0 copy, 1 fill, 2 device to memory, 3 memory to device
+//     4  CONTROL  write anything to start the transfer. Reads 0 if the last
+//                 transfer worked, 1 if it ran off the end of memory.
+//
+// Copies may overlap. Device to memory reads the device at SRC LENGTH times
+// and memory to device writes to the device at DEST LENGTH times. The device
+// interrupts when the transfer is done, which is before the next instruction.
+// There is one set of registers, so only the core the DMA was added to can
+// use it. Other cores sharing its memory read 0 and their writes are dropped.
+class DMA: public IODevice {
+    public:
+        DMA();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+        enum Mode {
+            COPY,
+            FILL,
+            DEVICE_TO_MEMORY,
+            MEMORY_TO_DEVICE,
+        };
+
+    private:
+        uint16_t src;
+        uint16_t dest;
+        uint16_t length;
+        uint16_t mode;
+        uint16_t status;
+
+        void transfer();
+};
+
+#endif
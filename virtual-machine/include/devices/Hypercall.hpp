@@ -0,0 +1,72 @@
+#ifndef LEEK_VM_DEVICES_HYPERCALL_H_DEFINED
+#define LEEK_VM_DEVICES_HYPERCALL_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <vector>
+
+#include <cstdlib>
+#include <cstdint>
+
+// Runs common library routines on the host, which is a lot quicker than
+// doing them one instruction at a time. The registers are
+//
+//     0  ARGS  address of the argument block
+//     1  CALL  write a function number to run it. Reads 0 if the last call
+//              worked, 1 if it ran off the end of memory and 2 if the
+//              function or its arguments were no good.
+//
+// The call is finished before the next instruction, so the device never
+// interrupts. Each function reads its arguments from the block at ARGS, and
+// results that aren't written elsewhere go back into the block. Strings hold
+// one character per word and end with a 0. Big numbers are 'length' words
+// long with the least significant word first.
+//
+//     0  MEMCPY  dest, src, length             copies may overlap
+//     1  MEMSET  dest, value, length
+//     2  STRCMP  a, b, result                  result is 0 if equal, 1 if
+//                                              a comes after b, else 0xffff
+//     3  STRLEN  s, result
+//     4  MUL     a, b, dest, length            dest is 2 * length words
+//     5  DIV     a, b, quot, rem, length       fails if b is 0
+//     6  FORMAT  src, length, base, signed,    writes the number at src as a
+//                dest, result                  string in base 2 ~ 36 to dest,
+//                                              result is the string length
+//
+// Calls share scratch space on the host, so only the core the device was
+// added to can make them. Other cores sharing its memory read 0 and their
+// writes are dropped.
+class Hypercall: public IODevice {
+    public:
+        Hypercall();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+        enum Function {
+            MEMCPY,
+            MEMSET,
+            STRCMP,
+            STRLEN,
+            MUL,
+            DIV,
+            FORMAT,
+        };
+
+    private:
+        uint16_t args;
+        uint16_t status;
+
+        std::vector<uint16_t> a;
+        std::vector<uint16_t> b;
+        std::vector<uint16_t> out;
+        std::vector<uint16_t> rem;
+
+        void call(uint16_t function);
+
+        void mul(uint16_t* block);
+        void div(uint16_t* block);
+        void format(uint16_t* block);
+};
+
+#endif
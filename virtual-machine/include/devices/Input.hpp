@@ -0,0 +1,52 @@
+#ifndef LEEK_VM_DEVICES_INPUT_H_DEFINED
+#define LEEK_VM_DEVICES_INPUT_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <cstdlib>
+#include <cstdint>
+
+// Reads from a host file descriptor (stdin by default) in big chunks on a
+// separate thread, and hands it to the program a byte at a time out of a
+// FIFO. The registers are
+//
+//     0  DATA    reading takes the next byte out of the FIFO, 0 if it's empty
+//     1  STATUS  bit 0 is set if there is data, bit 1 is set once the input
+//                has ended and the FIFO is empty
+//     2  COUNT   how many bytes are in the FIFO (at most 0xffff)
+//
+// The device interrupts when data arrives in an empty FIFO, and when the
+// input ends. The DMA device in device to memory mode can empty the FIFO in
+// one go.
+class Input: public IODevice {
+    public:
+        Input(int fd = 0);
+        ~Input();
+
+        uint16_t read(size_t address);
+
+        static const size_t CAPACITY = 0x10000;
+
+    private:
+        int fd;
+        int wakePipe[2];
+
+        std::vector<uint8_t> buffer;
+        size_t head;
+        size_t count;
+        bool ended;
+        bool done;
+
+        std::mutex mt;
+        std::condition_variable spaceCV;
+        std::thread reader;
+
+        void readLoop();
+};
+
+#endif
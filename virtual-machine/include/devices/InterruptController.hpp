@@ -0,0 +1,60 @@
+#ifndef LEEK_VM_DEVICES_INTERRUPT_CONTROLLER_H_DEFINED
+#define LEEK_VM_DEVICES_INTERRUPT_CONTROLLER_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+// Sends each interrupt line straight to its own handler, so the handler at
+// rIHP doesn't have to work out which line it was. Lines 0 ~ 7 are the
+// hardware lines and line 8 is the software line. The registers are
+//
+//     0  ~ 8   VECTOR    address of the handler for each line, 0 to use rIHP
+//     9  ~ 17  PRIORITY  priority of each line, higher goes first
+//     18       MASK      bit n set stops line n from being taken
+//     19       ACTIVE    (read only) the line that was taken last
+//
+// When an interrupt is taken the processor picks the unmasked line with the
+// highest priority, the lowest line winning a tie. If the line has a vector
+// it jumps there instead of rIHP and clears that line's fISF, if not it
+// behaves as if there were no controller and the handler has to clear fISF
+// itself. The controller keeps track of which lines have come in and not
+// been taken yet, and those are taken as soon as fICF is set, so other lines
+// that were waiting go next. Clearing a line's fISF drops it. A line that has
+// been taken isn't taken again until it comes in again, even if its fISF is
+// left set.
+//
+// A masked line still sets its fISF, and still wakes a WFI, but isn't taken
+// until it is unmasked.
+//
+// The controller has to be handed to Processor::useInterruptController as
+// well as mapped with useDevice. It belongs to that core, other cores sharing
+// its memory read 0 and their writes are dropped.
+class InterruptController: public IODevice {
+    public:
+        InterruptController();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+        static const int LINES = 9;
+
+        void raise(int line);       /* as the line's fISF is set */
+        int select(uint16_t flags); /* line to take, or -1 if none */
+        uint16_t take(int line);    /* the vector for the line */
+
+        bool waiting(uint16_t flags); /* any line select would take */
+
+        static uint16_t flagBit(int line);
+
+    private:
+        uint16_t vector[LINES];
+        uint16_t priority[LINES];
+        uint16_t mask;
+        uint16_t active;
+
+        uint16_t pending; /* bit n for line n, raised but not taken yet */
+};
+
+#endif
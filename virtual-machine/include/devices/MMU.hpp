@@ -0,0 +1,48 @@
+#ifndef LEEK_VM_DEVICES_MMU_H_DEFINED
+#define LEEK_VM_DEVICES_MMU_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <set>
+
+#include <cstdlib>
+#include <cstdint>
+
+// Maps pages of the 64k address space onto frames of a much bigger store, so
+// programs can work with more data than fits in memory. A page and a frame
+// are both MemoryManager::PAGE_WORDS long. The registers are
+//
+//     0  PAGE     page of memory to (un)map
+//     1  FRAME    frame to map it to
+//     2  CONTROL  write 1 to map PAGE to FRAME, 0 to give PAGE its own memory
+//                 back. Reads 0 if the last command worked, 1 if not.
+//     3  FRAMES   (read only) the last frame in the store
+//
+// Commands take effect before the next instruction. The store is only
+// allocated as it is used. Pages with devices on can't be mapped, and pages
+// still mapped when the MMU goes get their own memory back. Only the core
+// the MMU was added to can give it commands, other cores sharing its memory
+// read 0 and their writes are dropped. The mappings themselves are seen by
+// every core.
+class MMU: public IODevice {
+    public:
+        MMU(size_t frames = 0x10000);
+        ~MMU();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+    private:
+        size_t    frames;
+        uint16_t* store;
+
+        uint16_t page;
+        uint16_t frame;
+        uint16_t status;
+
+        // Pages pointing into the store, which have to be unmapped before
+        // it is freed
+        std::set<uint16_t> mapped;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef LEEK_VM_DEVICES_SNAPSHOT_CONTROL_H_DEFINED
+#define LEEK_VM_DEVICES_SNAPSHOT_CONTROL_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <string>
+
+#include <cstdlib>
+#include <cstdint>
+
+// Writing anything to this device saves a snapshot of the machine and then
+// (optionally) stops it. The program carries on from the instruction after
+// the write when the snapshot is booted. Writes from any core but the one it
+// was added to are dropped.
+class SnapshotControl: public IODevice {
+    public:
+        SnapshotControl(const char* filename, bool stopAfter);
+
+        void write(size_t address, uint16_t value);
+
+    private:
+        std::string filename;
+        bool stopAfter;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef LEEK_VM_DEVICES_TIMER_H_DEFINED
+#define LEEK_VM_DEVICES_TIMER_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+// An interval timer that runs off the processor clock, which ticks once per
+// instruction (or interrupt). It has no thread of its own, so it keeps up with
+// the machine however fast that runs. The registers are
+//
+//     0  RELOAD    how many counts before the timer goes off
+//     1  PRESCALE  how many ticks per count, less one
+//     2  CONTROL   bit 0 starts (1) or stops (0) the timer, if bit 1 is set
+//                  the timer starts again each time it goes off
+//     3  COUNT     (read only) counts left before the timer goes off
+//
+// So the timer goes off every RELOAD * (PRESCALE + 1) ticks, and interrupts
+// when it does. Writing CONTROL always starts counting from RELOAD again. If
+// the processor is waiting for an interrupt while the timer is running, the
+// clock skips straight to the time the timer goes off. Only the core the
+// timer was added to can use it. Other cores sharing its memory read 0 and
+// their writes are dropped.
+class Timer: public IODevice {
+    public:
+        Timer();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+    protected:
+        void expire();
+
+    private:
+        uint16_t reload;
+        uint16_t prescale;
+        uint16_t control;
+
+        bool running;
+        uint64_t started;
+
+        uint64_t period();
+};
+
+#endif
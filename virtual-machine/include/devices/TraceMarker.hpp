@@ -0,0 +1,28 @@
+#ifndef LEEK_VM_DEVICES_TRACE_MARKER_H_DEFINED
+#define LEEK_VM_DEVICES_TRACE_MARKER_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+// Lets a program mark out spans of its own in the trace (see Trace.hpp), for
+// example around a function or a frame. The registers are
+//
+//     0  BEGIN  writing starts the span with that id
+//     1  END    writing ends the span with that id
+//
+// Spans are matched up by id, so they can nest, overlap and move between
+// cores. Nothing happens unless tracing is on, and the device never
+// interrupts.
+class TraceMarker: public IODevice {
+    public:
+        TraceMarker();
+
+        void write(size_t address, uint16_t value);
+
+        static const size_t BEGIN = 0;
+        static const size_t END   = 1;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LEEK_VM_DEVICES_VECTOR_UNIT_H_DEFINED
+#define LEEK_VM_DEVICES_VECTOR_UNIT_H_DEFINED
+
+#include "IODevice.hpp"
+
+#include <vector>
+
+#include <cstdlib>
+#include <cstdint>
+
+// Does arithmetic on whole arrays at once, using the host's vector
+// instructions where it can. The registers are
+//
+//     0  OP       which operation, see below
+//     1  SRC_A    address of the first operand array
+//     2  SRC_B    address of the second operand array
+//     3  DEST     address of the result array
+//     4  LENGTH   number of words in each array
+//     5  CONTROL  write anything to start. Reads 0 if the last operation
+//                 worked, 1 if not, and 2 if the result of DOT did not fit
+//                 in RESULT and AUX.
+//     6  RESULT   low word of the result of SUM and DOT
+//     7  AUX      high word of the result of SUM and DOT
+//
+// The element wise operations write DEST[i] = A[i] op B[i] and are ADD, SUB,
+// ADDS and SUBS (unsigned saturating), MUL (low word), MULHI (high word), AND,
+// OR and XOR. SUM adds up A and DOT is the dot product of A and B, both into
+// RESULT and AUX. SUM always fits in 32 bits, DOT of long arrays might not.
+// It is worked out in full and RESULT and AUX get the low 32 bits. The device
+// interrupts when it is done, which is before the next instruction. It
+// keeps its working arrays between operations, so only the core it was
+// added to can use it, and other cores sharing its memory read 0 and have
+// their writes dropped.
+class VectorUnit: public IODevice {
+    public:
+        VectorUnit();
+
+        void     write(size_t address, uint16_t value);
+        uint16_t  read(size_t address);
+
+        enum Op {
+            ADD,
+            SUB,
+            ADDS,
+            SUBS,
+            MUL,
+            MULHI,
+            AND,
+            OR,
+            XOR,
+            SUM,
+            DOT,
+        };
+
+    private:
+        uint16_t regs[8];
+
+        std::vector<uint16_t> a;
+        std::vector<uint16_t> b;
+        std::vector<uint16_t> out;
+
+        bool execute(); /* false if DOT overflowed */
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * leekvm.h
+ *
+ * A C interface to the virtual machine, so it can be run from inside another
+ * program (or another language) rather than as the leek-vm executable. Build
+ * it with 'make lib' and link against libleekvm.so.
+ *
+ * None of these functions throw. Ones that can fail return LEEK_ERROR (or
+ * NULL), and leek_error says what went wrong.
+ *
+ * -- Callum Nicholson
+ */
+#ifndef LEEK_VM_LEEKVM_H_DEFINED
+#define LEEK_VM_LEEKVM_H_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LEEK_API_VERSION 3
+
+// The library is built with everything else hidden
+#define LEEK_API __attribute__((visibility("default")))
+
+typedef struct leek_vm leek_vm;
+typedef struct leek_image leek_image;
+
+// What leek_run and friends return
+enum {
+    LEEK_OK      =  0,
+    LEEK_HALTED  =  1, /* the program halted */
+    LEEK_BUDGET  =  2, /* ran out of instructions */
+    LEEK_WAITING =  3, /* waiting for an interrupt with WFI */
+    LEEK_ERROR   = -1,
+};
+
+// Called on the thread that runs the machine when the program reads from or
+// writes to a device. 'address' is relative to the start of the device.
+typedef uint16_t (*leek_read_fn)(void* user, uint16_t address);
+typedef void    (*leek_write_fn)(void* user, uint16_t address, uint16_t value);
+
+LEEK_API int leek_version(void);
+
+// Memory and registers start out zeroed
+LEEK_API leek_vm*    leek_create(size_t words);
+LEEK_API void        leek_destroy(leek_vm* vm);
+
+// The last error on this machine. With a NULL machine it says why the last
+// leek_create or leek_image_create on this thread returned NULL.
+LEEK_API const char* leek_error(leek_vm* vm);
+
+// Copies 'length' words to memory starting at address 1 and gets the machine
+// ready to run them, the same way leek-vm loads a program
+LEEK_API int leek_load(leek_vm* vm, const uint16_t* image, size_t length);
+
+// A program that many machines can run while only holding it once. Machines
+// that load it keep it alive, so it can be released straight after.
+LEEK_API leek_image* leek_image_create(const uint16_t* image, size_t length);
+LEEK_API void        leek_image_release(leek_image* image);
+
+// What a store to a shared image does
+enum {
+    LEEK_SHARED_COPY  = 0, /* the machine gets its own copy of that page */
+    LEEK_SHARED_FAULT = 1, /* leek_run fails */
+};
+
+// Like leek_load, but the pages the image is on are shared rather than
+// copied. That includes the page holding address 0 and the rest of the last
+// page, so the stack starts after that page. Put anything else written to past
+// the end of it too.
+LEEK_API int leek_load_shared(leek_vm* vm, leek_image* image, int onStore);
+
+// Either callback may be NULL, reads then give 0 and writes do nothing
+LEEK_API int leek_map_device(leek_vm* vm, size_t position, uint16_t words, uint8_t line,
+        leek_read_fn read, leek_write_fn write, void* user);
+
+// Safe to call from any thread. A line of -1 is the software line.
+LEEK_API int leek_interrupt(leek_vm* vm, int line);
+
+// Runs at most 'budget' instructions. If 'executed' is not NULL it is set to
+// how many ran. A program waiting with WFI gives LEEK_WAITING straight away
+// until it is interrupted.
+LEEK_API int leek_run(leek_vm* vm, uint64_t budget, uint64_t* executed);
+
+LEEK_API int leek_get_register(leek_vm* vm, int index, uint16_t* out);
+LEEK_API int leek_set_register(leek_vm* vm, int index, uint16_t value);
+
+LEEK_API int leek_read_memory(leek_vm* vm, size_t address, uint16_t* out, size_t length);
+LEEK_API int leek_write_memory(leek_vm* vm, size_t address, const uint16_t* values, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+#include "Checkpoint.hpp"
+#include "Processor.hpp"
+#include "MemoryManager.hpp"
+#include "RegisterManager.hpp"
+
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring> // memcpy, memcmp
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// A record is laid out as
+//
+//     header     magic, page count, sequence number, memory size
+//     registers  16 words
+//     interrupts 1 word, see Processor::packInterrupts
+//     pages      page count times: page index, PAGE_WORDS words
+//     trailer    end magic, checksum of everything before the trailer
+//
+// All values are in host byte order, these files are not meant to be moved
+// between machines.
+
+const uint32_t RECORD_MAGIC = 0x50434b4c; // "LKCP"
+const uint32_t END_MAGIC    = 0x45434b4c; // "LKCE"
+
+const size_t HEADER_SIZE  = 4 + 4 + 8 + 8;
+const size_t STATE_SIZE   = 16 * 2 + 2;
+const size_t RECORD_PAGE  = 4 + MemoryManager::PAGE_WORDS * 2;
+const size_t TRAILER_SIZE = 4 + 4;
+
+// FNV-1a, we only need to catch torn writes, not malicious ones
+static uint32_t checksum(const uint8_t* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template<typename T>
+static void append(std::vector<uint8_t>& buff, T value) {
+    size_t pos = buff.size();
+    buff.resize(pos + sizeof(T));
+    memcpy(&buff[pos], &value, sizeof(T));
+}
+
+template<typename T>
+static T extract(const uint8_t* data, size_t& pos) {
+    T ret;
+    memcpy(&ret, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return ret;
+}
+
+Checkpoint::Checkpoint(const char* filename) {
+    fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Checkpoint::Checkpoint: Could not open file");
+    }
+    sequence = 0;
+}
+
+Checkpoint::~Checkpoint() {
+    close(fd);
+}
+
+void Checkpoint::save(Processor& cpu) {
+    MemoryManager& mem = cpu.mem;
+    std::lock_guard<std::mutex> lk(mem.dirtyM);
+
+    std::vector<uint8_t> buff;
+    buff.reserve(HEADER_SIZE + STATE_SIZE + TRAILER_SIZE
+            + mem.dirtyPages.size() * RECORD_PAGE);
+
+    append<uint32_t>(buff, RECORD_MAGIC);
+    append<uint32_t>(buff, mem.dirtyPages.size());
+    append<uint64_t>(buff, sequence);
+    append<uint64_t>(buff, mem.words);
+
+    for (size_t i = 0; i < 16; ++i) {
+        append<uint16_t>(buff, cpu.reg[i]);
+    }
+
+    append<uint16_t>(buff, cpu.packInterrupts());
+
+    for (size_t page : mem.dirtyPages) {
+        append<uint32_t>(buff, page);
+
+        size_t start = page * MemoryManager::PAGE_WORDS;
+        for (size_t i = 0; i < MemoryManager::PAGE_WORDS; ++i) {
+            bool valid = start + i < mem.words;
+            append<uint16_t>(buff, valid ? mem.pageTable[page].load()[i] : 0);
+        }
+
+        mem.dirty[page] = 0;
+    }
+    mem.dirtyPages.clear();
+
+    uint32_t sum = checksum(&buff[0], buff.size());
+    append<uint32_t>(buff, END_MAGIC);
+    append<uint32_t>(buff, sum);
+
+    size_t written = 0;
+    while (written < buff.size()) {
+        ssize_t res = write(fd, &buff[written], buff.size() - written);
+        if (res < 0) {
+            throw std::runtime_error("Checkpoint::save: Write failed");
+        }
+        written += res;
+    }
+    fdatasync(fd);
+
+    ++sequence;
+}
+
+bool Checkpoint::restore(Processor& cpu) {
+    MemoryManager& mem = cpu.mem;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        throw std::runtime_error("Checkpoint::restore: Could not read file size");
+    }
+    size_t size = st.st_size;
+    if (size == 0) return false;
+
+    // Whatever this file is, it isn't one of ours, so don't touch it
+    if (size < HEADER_SIZE) {
+        throw std::runtime_error("Checkpoint::restore: Not a checkpoint");
+    }
+
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("Checkpoint::restore: Could not map file");
+    }
+    const uint8_t* data = (const uint8_t*) map;
+
+    // Records are incremental, so play all the consistent ones back in order.
+    // We stop at the first one that is truncated or fails the checksum.
+    size_t offset = 0;
+    bool restored = false;
+    while (offset + HEADER_SIZE <= size) {
+        size_t pos = offset;
+        uint32_t magic = extract<uint32_t>(data, pos);
+        uint32_t pages = extract<uint32_t>(data, pos);
+        uint64_t seq   = extract<uint64_t>(data, pos);
+        uint64_t words = extract<uint64_t>(data, pos);
+
+        // The first header decides whether we may write to this file at all
+        if (offset == 0 && magic != RECORD_MAGIC) {
+            munmap(map, size);
+            throw std::runtime_error("Checkpoint::restore: Not a checkpoint");
+        }
+        if (offset == 0 && words != mem.words) {
+            munmap(map, size);
+            throw std::runtime_error("Checkpoint::restore: Wrong memory size");
+        }
+
+        size_t length = HEADER_SIZE + STATE_SIZE + pages * RECORD_PAGE + TRAILER_SIZE;
+        if (magic != RECORD_MAGIC || words != mem.words || offset + length > size) {
+            break;
+        }
+
+        size_t trailer = offset + length - TRAILER_SIZE;
+        size_t endPos  = trailer;
+        uint32_t endMagic = extract<uint32_t>(data, endPos);
+        uint32_t sum      = extract<uint32_t>(data, endPos);
+        if (endMagic != END_MAGIC || sum != checksum(data + offset, length - TRAILER_SIZE)) {
+            break;
+        }
+
+        for (size_t i = 0; i < 16; ++i) {
+            cpu.reg[i] = extract<uint16_t>(data, pos);
+        }
+
+        cpu.unpackInterrupts(extract<uint16_t>(data, pos));
+
+        for (uint32_t i = 0; i < pages; ++i) {
+            size_t page  = extract<uint32_t>(data, pos);
+            size_t start = page * MemoryManager::PAGE_WORDS;
+            size_t count = MemoryManager::PAGE_WORDS;
+            if (start >= mem.words) {
+                pos += count * 2;
+                continue;
+            }
+            if (start + count > mem.words) count = mem.words - start;
+
+            // Shared code only needs its own copy if the checkpoint changed it
+            if (!mem.shared[page] || memcmp(mem.pageTable[page].load(), data + pos, count * 2)) {
+                memcpy(mem.privatePage(page), data + pos, count * 2);
+            }
+            pos += MemoryManager::PAGE_WORDS * 2;
+        }
+
+        sequence = seq + 1;
+        offset  += length;
+        restored = true;
+    }
+
+    munmap(map, size);
+
+    // Nothing we can trust to pick up from, and nothing we should throw away
+    if (!restored) {
+        throw std::runtime_error("Checkpoint::restore: No complete record, "
+                "remove the file to start again");
+    }
+
+    // Throw away the torn record after the last good one so new records are
+    // appended straight after it
+    if (offset < size && ftruncate(fd, offset) < 0) {
+        throw std::runtime_error("Checkpoint::restore: Could not truncate file");
+    }
+
+    // Memory now matches the file exactly
+    std::lock_guard<std::mutex> lk(mem.dirtyM);
+    for (size_t page : mem.dirtyPages) {
+        mem.dirty[page] = 0;
+    }
+    mem.dirtyPages.clear();
+
+    return true;
+}
@@ -0,0 +1,68 @@
+#include "CodeImage.hpp"
+#include "MemoryManager.hpp"
+
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring> // memcpy
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const size_t PAGE_BYTES = MemoryManager::PAGE_WORDS * sizeof(uint16_t);
+
+CodeImage::CodeImage(const uint16_t* words, size_t length) {
+    pageCount = (length + MemoryManager::PAGE_WORDS - 1) / MemoryManager::PAGE_WORDS;
+    bytes     = pageCount * PAGE_BYTES;
+    if (bytes == 0) {
+        throw std::invalid_argument("CodeImage::CodeImage: Empty image");
+    }
+
+    // Anonymous memory starts out zeroed, which takes care of the last page
+    void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("CodeImage::CodeImage: Could not allocate memory");
+    }
+    memcpy(map, words, sizeof(uint16_t) * length);
+    mprotect(map, bytes, PROT_READ);
+
+    data = (uint16_t*) map;
+}
+
+CodeImage::CodeImage(int fd, size_t offset, size_t length) {
+    pageCount = (length + MemoryManager::PAGE_WORDS - 1) / MemoryManager::PAGE_WORDS;
+    bytes     = pageCount * PAGE_BYTES;
+    if (bytes == 0) {
+        throw std::invalid_argument("CodeImage::CodeImage: Empty image");
+    }
+
+    // Touching memory past the end of the file is SIGBUS, so the whole of
+    // the last page has to be there
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < offset + bytes) {
+        throw std::runtime_error("CodeImage::CodeImage: File is too short");
+    }
+
+    void* map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, offset);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("CodeImage::CodeImage: Could not map file");
+    }
+
+    data = (uint16_t*) map;
+}
+
+CodeImage::~CodeImage() {
+    munmap(data, bytes);
+}
+
+size_t CodeImage::pages() {
+    return pageCount;
+}
+
+const uint16_t* CodeImage::page(size_t index) {
+    if (index >= pageCount) {
+        throw std::out_of_range("CodeImage::page");
+    }
+    return data + index * MemoryManager::PAGE_WORDS;
+}
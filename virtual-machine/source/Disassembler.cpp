@@ -0,0 +1,410 @@
+#include "Disassembler.hpp"
+#include "Operation.hpp"
+
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include <cstdlib>
+#include <cstdint>
+
+const uint8_t PC = 15;
+
+static const char* REGISTERS[16] = {
+    "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+    "r8", "r9", "r10", "r11", "rIHP", "rFLAGS", "rSTACK", "rPC",
+};
+
+static const char* FLAGS[16] = {
+    "fZERO", "fNEG", "fCARRY", "fOVER", "fICF", "5", "6", "fISFs",
+    "fISF0", "fISF1", "fISF2", "fISF3", "fISF4", "fISF5", "fISF6", "fISF7",
+};
+
+// Lined up the way the examples are written
+static std::string columns(const std::vector<std::string>& parts) {
+    std::string out;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        out += parts[i];
+        if (i + 1 < parts.size()) {
+            out += std::string(parts[i].size() < 8 ? 8 - parts[i].size() : 1, ' ');
+        }
+    }
+    return out;
+}
+
+static std::string number(unsigned value) {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+}
+
+// Everything that puts its result in register C
+static bool writesRegister(Operation& op) {
+    Operation::Mode mode = op.getMode();
+    return mode == Operation::IIR || mode == Operation::RIR || mode == Operation::RRR
+        || op == Operation::NOP || op == Operation::MOV || op == Operation::NOT
+        || op == Operation::LOAD || op == Operation::POP;
+}
+
+Disassembler::Disassembler(const std::vector<uint16_t>& memory):
+        memory(memory), code(0x10000, false), leader(0x10000, false) {
+    // Do nothing
+}
+
+std::string Disassembler::text(uint16_t instruction) {
+    Operation& op = Operation::fromInstruction(instruction);
+    uint8_t  a   = (instruction >> 8) & 0xf;
+    uint8_t  b   = (instruction >> 4) & 0xf;
+    uint8_t  c   = instruction & 0xf;
+    uint8_t  imm = (instruction >> 4) & 0xff;
+
+    std::vector<std::string> parts;
+    parts.push_back(op.getName());
+
+    switch (op.getMode()) {
+        case Operation::IIR:
+            if (c == PC) {
+                if (op == Operation::RELm && imm == 1) return "HALT";
+                parts[0] = op == Operation::RELp ? "JMP+" : "JMP-";
+                parts.push_back(number(imm));
+            }
+            else {
+                parts.push_back(number(imm));
+                parts.push_back(REGISTERS[c]);
+            }
+            break;
+
+        case Operation::RIR:
+            parts.push_back(REGISTERS[a]);
+            parts.push_back(number(b));
+            parts.push_back(REGISTERS[c]);
+            break;
+
+        case Operation::RRR:
+            parts.push_back(REGISTERS[a]);
+            parts.push_back(REGISTERS[b]);
+            parts.push_back(REGISTERS[c]);
+            break;
+
+        case Operation::IR:
+            parts.push_back(FLAGS[b]);
+            break;
+
+        case Operation::RR:
+            if (op == Operation::UNDEF) {
+                std::ostringstream out;
+                out << "0x" << std::hex << std::setw(4) << std::setfill('0') << instruction;
+                parts[0] = "LIT";
+                parts.push_back(out.str());
+            }
+            else if (op == Operation::PUSH) {
+                parts.push_back(REGISTERS[b]);
+            }
+            else if (op == Operation::POP) {
+                parts.push_back(REGISTERS[c]);
+            }
+            else if (op == Operation::MOV || op == Operation::NOT
+                    || op == Operation::STORE || op == Operation::LOAD) {
+                parts.push_back(REGISTERS[b]);
+                parts.push_back(REGISTERS[c]);
+            }
+            break;
+    }
+
+    return columns(parts);
+}
+
+bool Disassembler::successors(uint16_t address, uint16_t instruction,
+        std::vector<uint16_t>& out) {
+    Operation& op = Operation::fromInstruction(instruction);
+    uint16_t next = address + 1;
+    uint8_t  c    = instruction & 0xf;
+    uint8_t  imm  = (instruction >> 4) & 0xff;
+
+    if (op == Operation::FPRED && c == PC) {
+        // Either run the next instruction or skip it
+        out.push_back(next);
+        out.push_back(next + 1);
+        return true;
+    }
+    if (c != PC || !writesRegister(op)) {
+        out.push_back(next);
+        return true;
+    }
+
+    if (op == Operation::RELp) {
+        out.push_back(next + imm);
+        return true;
+    }
+    if (op == Operation::RELm) {
+        out.push_back(next - imm);
+        return true;
+    }
+    if (op == Operation::NOP) {
+        out.push_back(0);
+        return true;
+    }
+    return false;
+}
+
+void Disassembler::addEntry(uint16_t address) {
+    entries.push_back(address);
+}
+
+void Disassembler::analyse() {
+    findCode();
+    findBlocks();
+    findLoops();
+}
+
+bool Disassembler::isCode(uint16_t address) {
+    return code[address];
+}
+
+const std::map<uint16_t, Disassembler::Block>& Disassembler::blocks() {
+    return blockMap;
+}
+
+const std::vector<Disassembler::Loop>& Disassembler::loops() {
+    return loopList;
+}
+
+void Disassembler::findCode() {
+    std::vector<uint16_t> work(entries);
+    for (uint16_t e : entries) leader[e] = true;
+
+    std::vector<uint16_t> next;
+    while (!work.empty()) {
+        uint16_t address = work.back();
+        work.pop_back();
+        if (code[address]) continue;
+        code[address] = true;
+
+        next.clear();
+        bool known = successors(address, memory[address], next);
+
+        // Anything other than carrying on to the next word starts new blocks
+        bool straight = known && next.size() == 1 && next[0] == (uint16_t) (address + 1);
+        for (uint16_t n : next) {
+            if (!straight) leader[n] = true;
+            work.push_back(n);
+        }
+    }
+}
+
+void Disassembler::findBlocks() {
+    std::vector<uint16_t> next;
+
+    Block* block = NULL;
+    for (uint32_t address = 0; address < 0x10000; ++address) {
+        if (!code[address]) {
+            block = NULL;
+            continue;
+        }
+
+        if (!block || leader[address]) {
+            Block& b = blockMap[address];
+            b.start    = address;
+            b.entry    = std::find(entries.begin(), entries.end(), address) != entries.end();
+            b.indirect = false;
+            b.halts    = false;
+            b.loop     = NO_LOOP;
+            block = &b;
+        }
+        block->end = address;
+
+        next.clear();
+        bool known = successors(address, memory[address], next);
+        bool straight = known && next.size() == 1 && next[0] == address + 1;
+        if (straight && address + 1 < 0x10000 && !leader[address + 1]) continue;
+
+        // This is the end of the block
+        block->successors = next;
+        block->indirect   = !known;
+        block->halts      = known && next.size() == 1 && next[0] == address;
+        block = NULL;
+    }
+
+    for (auto& kv : blockMap) {
+        for (uint16_t s : kv.second.successors) {
+            blockMap[s].predecessors.push_back(kv.first);
+        }
+    }
+}
+
+void Disassembler::findLoops() {
+    // Number the blocks, with a made up root before all the entries
+    std::vector<uint16_t> starts;
+    std::map<uint16_t, size_t> index;
+    for (auto& kv : blockMap) {
+        index[kv.first] = starts.size();
+        starts.push_back(kv.first);
+    }
+    size_t n    = starts.size();
+    size_t root = n;
+
+    std::vector<std::vector<size_t>> succ(n + 1), pred(n + 1);
+    for (size_t i = 0; i < n; ++i) {
+        for (uint16_t s : blockMap[starts[i]].successors) {
+            succ[i].push_back(index[s]);
+            pred[index[s]].push_back(i);
+        }
+    }
+    for (uint16_t e : entries) {
+        succ[root].push_back(index[e]);
+        pred[index[e]].push_back(root);
+    }
+
+    // Reverse postorder from the root
+    std::vector<size_t> order;
+    std::vector<size_t> rpo(n + 1, SIZE_MAX);
+    {
+        std::vector<bool> seen(n + 1, false);
+        std::vector<std::pair<size_t, size_t>> stack;
+        stack.push_back(std::make_pair(root, 0));
+        seen[root] = true;
+        while (!stack.empty()) {
+            size_t node = stack.back().first;
+            size_t& i   = stack.back().second;
+            if (i < succ[node].size()) {
+                size_t s = succ[node][i++];
+                if (!seen[s]) {
+                    seen[s] = true;
+                    stack.push_back(std::make_pair(s, 0));
+                }
+            }
+            else {
+                order.push_back(node);
+                stack.pop_back();
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        for (size_t i = 0; i < order.size(); ++i) rpo[order[i]] = i;
+    }
+
+    // Immediate dominators, as in Cooper, Harvey and Kennedy's "A Simple,
+    // Fast Dominance Algorithm"
+    std::vector<size_t> idom(n + 1, SIZE_MAX);
+    idom[root] = root;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); ++i) {
+            size_t node = order[i];
+            size_t best = SIZE_MAX;
+            for (size_t p : pred[node]) {
+                if (idom[p] == SIZE_MAX) continue;
+                if (best == SIZE_MAX) {
+                    best = p;
+                    continue;
+                }
+                size_t x = p, y = best;
+                while (x != y) {
+                    while (rpo[x] > rpo[y]) x = idom[x];
+                    while (rpo[y] > rpo[x]) y = idom[y];
+                }
+                best = x;
+            }
+            if (idom[node] != best) {
+                idom[node] = best;
+                changed = true;
+            }
+        }
+    }
+
+    auto dominates = [&](size_t a, size_t b) {
+        while (true) {
+            if (a == b) return true;
+            if (b == root) return false;
+            b = idom[b];
+        }
+    };
+
+    // A back edge goes to a block that dominates where it comes from. All
+    // the back edges to one header make one loop. HALT isn't a loop.
+    std::map<size_t, std::vector<size_t>> latches;
+    for (size_t i = 0; i < n; ++i) {
+        if (idom[i] == SIZE_MAX || blockMap[starts[i]].halts) continue;
+        for (size_t s : succ[i]) {
+            if (dominates(s, i)) latches[s].push_back(i);
+        }
+    }
+
+    std::vector<std::vector<bool>> bodies;
+    for (auto& kv : latches) {
+        // Everything that can reach a latch without going through the header
+        std::vector<bool> body(n, false);
+        body[kv.first] = true;
+        std::vector<size_t> work(kv.second);
+        while (!work.empty()) {
+            size_t node = work.back();
+            work.pop_back();
+            if (body[node]) continue;
+            body[node] = true;
+            for (size_t p : pred[node]) {
+                if (p != root && !body[p]) work.push_back(p);
+            }
+        }
+
+        Loop loop;
+        loop.header = starts[kv.first];
+        for (size_t i = 0; i < n; ++i) {
+            if (body[i]) loop.blocks.push_back(starts[i]);
+        }
+        for (size_t l : kv.second) loop.latches.push_back(starts[l]);
+        loop.parent = NO_LOOP;
+        loop.depth  = 1;
+
+        loopList.push_back(loop);
+        bodies.push_back(body);
+    }
+
+    // Loops with different headers are either nested or apart, so the
+    // parent is the smallest other loop holding our header
+    for (size_t i = 0; i < loopList.size(); ++i) {
+        size_t h = index[loopList[i].header];
+        for (size_t j = 0; j < loopList.size(); ++j) {
+            if (j == i || !bodies[j][h]) continue;
+            size_t p = loopList[i].parent;
+            if (p == NO_LOOP || loopList[j].blocks.size() < loopList[p].blocks.size()) {
+                loopList[i].parent = j;
+            }
+        }
+    }
+
+    // Outermost first, keeping the parents pointing at the right place
+    std::vector<size_t> depth(loopList.size());
+    for (size_t i = 0; i < loopList.size(); ++i) {
+        depth[i] = 1;
+        for (size_t p = loopList[i].parent; p != NO_LOOP; p = loopList[p].parent) ++depth[i];
+    }
+    std::vector<size_t> sorted(loopList.size());
+    for (size_t i = 0; i < sorted.size(); ++i) sorted[i] = i;
+    std::stable_sort(sorted.begin(), sorted.end(),
+            [&](size_t a, size_t b) { return depth[a] < depth[b]; });
+
+    std::vector<size_t> where(loopList.size());
+    for (size_t i = 0; i < sorted.size(); ++i) where[sorted[i]] = i;
+
+    std::vector<Loop> result;
+    for (size_t i : sorted) {
+        Loop loop = loopList[i];
+        loop.depth = depth[i];
+        if (loop.parent != NO_LOOP) loop.parent = where[loop.parent];
+        result.push_back(loop);
+    }
+    loopList.swap(result);
+
+    // The innermost loop is the deepest one holding the block
+    for (size_t i = 0; i < loopList.size(); ++i) {
+        for (uint16_t start : loopList[i].blocks) {
+            Block& b = blockMap[start];
+            if (b.loop == NO_LOOP || loopList[b.loop].depth < loopList[i].depth) {
+                b.loop = i;
+            }
+        }
+    }
+}
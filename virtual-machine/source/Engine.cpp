@@ -0,0 +1,53 @@
+#include "Engine.hpp"
+#include "MemoryManager.hpp"
+#include "Processor.hpp"
+
+#include <vector>
+
+#include <cstdlib>
+#include <cstdint>
+
+Engine::~Engine() {
+    // Do nothing
+}
+
+ProcessorEngine::ProcessorEngine(): mem(0x10000), cpu(mem) {
+    // WFI can't block when there is nothing to wake it
+    cpu.setParkOnWait(true);
+}
+
+void ProcessorEngine::exec(uint16_t instruction) {
+    cpu.exec(instruction);
+}
+
+void ProcessorEngine::tick() {
+    cpu.tick();
+}
+
+void ProcessorEngine::set(size_t index, uint16_t value) {
+    cpu.set(index, value);
+}
+
+uint16_t ProcessorEngine::inspect(size_t index) {
+    return cpu.inspect(index);
+}
+
+void ProcessorEngine::write(uint16_t address, uint16_t value) {
+    mem[address] = value;
+}
+
+uint16_t ProcessorEngine::read(uint16_t address) {
+    return mem.read(address);
+}
+
+void ProcessorEngine::dirty(std::vector<size_t>& pages) {
+    mem.takeDirty(pages);
+}
+
+uint16_t ProcessorEngine::interrupts() {
+    return cpu.packInterrupts();
+}
+
+void ProcessorEngine::setInterrupts(uint16_t packed) {
+    cpu.unpackInterrupts(packed);
+}
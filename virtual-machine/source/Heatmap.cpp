@@ -0,0 +1,115 @@
+#include "Heatmap.hpp"
+#include "MemoryManager.hpp"
+
+#include <ostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+
+Heatmap::Heatmap(size_t words, uint64_t window) {
+    if (window == 0) {
+        throw std::invalid_argument("Heatmap::Heatmap: Window must be positive");
+    }
+    this->words  = words;
+    this->pages  = (words + PAGE_WORDS - 1) / PAGE_WORDS;
+    this->window = window;
+
+    for (int k = 0; k < 3; ++k) {
+        counts[k] = new Counter[words];
+        for (size_t i = 0; i < words; ++i) counts[k][i] = 0;
+    }
+
+    lastWindow = new std::atomic<uint64_t>[pages];
+    for (size_t i = 0; i < pages; ++i) lastWindow[i] = 0;
+}
+
+Heatmap::~Heatmap() {
+    for (int k = 0; k < 3; ++k) delete[] counts[k];
+    delete[] lastWindow;
+}
+
+void Heatmap::count(Kind kind, size_t address, uint64_t clock) {
+    if (address >= words) return;
+
+    // Only the one processor normally touches a word, so a load and a store
+    // is cheaper than an atomic add and nearly always right
+    Counter& c = counts[kind][address];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    size_t page = address / PAGE_WORDS;
+    uint64_t w  = clock / window;
+    if (lastWindow[page].load(std::memory_order_relaxed) == w + 1) return;
+    if (lastWindow[page].exchange(w + 1) == w + 1) return;
+
+    std::lock_guard<std::mutex> lk(workingSetM);
+    if (workingSet.size() <= w) workingSet.resize(w + 1, 0);
+    workingSet[w] += 1;
+}
+
+uint32_t Heatmap::get(Kind kind, size_t address) {
+    if (address >= words) {
+        throw std::out_of_range("Heatmap::get");
+    }
+    return counts[kind][address];
+}
+
+void Heatmap::writeFetchImage(std::ostream& out) {
+    writeImage(out, counts[FETCH], NULL);
+}
+
+void Heatmap::writeDataImage(std::ostream& out) {
+    writeImage(out, counts[LOAD], counts[STORE]);
+}
+
+void Heatmap::writeImage(std::ostream& out, const Counter* a, const Counter* b) {
+    std::vector<uint64_t> totals(pages * PAGE_WORDS, 0);
+    uint64_t max = 0;
+    for (size_t i = 0; i < words; ++i) {
+        totals[i] = a[i] + (b ? (uint64_t) b[i] : 0);
+        if (totals[i] > max) max = totals[i];
+    }
+
+    // Binary PGM. Counts are all over the place so scale by log, otherwise
+    // everything but the hottest loop would be black.
+    out << "P5\n" << PAGE_WORDS << " " << pages << "\n255\n";
+    double scale = max ? 255.0 / log(1.0 + max) : 0;
+    for (size_t i = 0; i < totals.size(); ++i) {
+        out.put((char) (uint8_t) lround(log(1.0 + totals[i]) * scale));
+    }
+}
+
+void Heatmap::writeWords(std::ostream& out) {
+    out << "address,page,fetches,loads,stores\n";
+    for (size_t i = 0; i < words; ++i) {
+        uint32_t f = counts[FETCH][i], l = counts[LOAD][i], s = counts[STORE][i];
+        if (!f && !l && !s) continue;
+        out << i << "," << i / PAGE_WORDS << "," << f << "," << l << "," << s << "\n";
+    }
+}
+
+void Heatmap::writePages(std::ostream& out) {
+    out << "page,fetches,loads,stores,words_used\n";
+    for (size_t p = 0; p < pages; ++p) {
+        uint64_t f = 0, l = 0, s = 0, used = 0;
+        for (size_t i = p * PAGE_WORDS; i < (p + 1) * PAGE_WORDS && i < words; ++i) {
+            f += counts[FETCH][i];
+            l += counts[LOAD][i];
+            s += counts[STORE][i];
+            if (counts[FETCH][i] || counts[LOAD][i] || counts[STORE][i]) ++used;
+        }
+        out << p << "," << f << "," << l << "," << s << "," << used << "\n";
+    }
+}
+
+void Heatmap::writeWorkingSet(std::ostream& out) {
+    std::lock_guard<std::mutex> lk(workingSetM);
+    out << "start,pages\n";
+    for (size_t w = 0; w < workingSet.size(); ++w) {
+        out << w * window << "," << workingSet[w] << "\n";
+    }
+}
@@ -1,13 +1,22 @@
 #include "IODevice.hpp"
 #include "Processor.hpp"
+#include "Trace.hpp"
 
 #include <stdexcept>
 
 #include <cstdlib>
 #include <cstdint>
 
-IODevice::IODevice(uint16_t words) {
+IODevice::IODevice(uint16_t words, bool synchronous, bool ownerOnly) {
+    this->cpu   = NULL;
+    this->line  = 0;
     this->words = words;
+    this->synchronous = synchronous;
+    this->ownerOnly   = ownerOnly;
+}
+
+IODevice::~IODevice() {
+    // Do nothing
 }
 
 void IODevice::write(size_t address, uint16_t value) {
@@ -29,6 +38,39 @@ uint16_t IODevice::length() {
     return words;
 }
 
+bool IODevice::isSynchronous() {
+    return synchronous;
+}
+
+bool IODevice::answersHere() {
+    // Outside of run there is only the one thread driving things
+    Processor* here = Processor::running();
+    return !ownerOnly || !here || here == cpu;
+}
+
 void IODevice::ready() {
-    cpu->interrupt(line);
+    if (Trace::enabled) Trace::instant("ready", line);
+
+    // Devices with their own threads might be ready before they are used
+    if (cpu) cpu->interrupt(line);
+}
+
+Processor& IODevice::getProcessor() {
+    return *cpu;
+}
+
+MemoryManager& IODevice::getMemory() {
+    return cpu->mem;
+}
+
+void IODevice::schedule(uint64_t delay) {
+    cpu->schedule(*this, cpu->clock + delay);
+}
+
+void IODevice::cancel() {
+    cpu->cancel(*this);
+}
+
+void IODevice::expire() {
+    // Default behaviour is to do nothing
 }
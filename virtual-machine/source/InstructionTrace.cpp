@@ -0,0 +1,382 @@
+#include "InstructionTrace.hpp"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <string>
+#include <stdexcept>
+#include <iostream>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring> // memcpy
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// The file is a header, magic then version, followed by blocks of
+//
+//     length   bytes of records in the block
+//     count    records in the block
+//     records  count records
+//
+// A record starts with a byte of these bits, followed by the fields that
+// aren't covered by them in this order
+//
+//     SEQUENTIAL   pc is one on from the last record, else a zigzag varint of
+//                  the difference
+//     SAME_INSTR   the instruction is the same as the last one at this pc in
+//                  this block, else 2 bytes
+//     SAME_VALUE   else a zigzag varint of the difference from the last value
+//     SAME_FLAGS   else 2 bytes
+//     INTERRUPTED  an interrupt was taken before this instruction
+//
+// Each block starts from pc 0xffff, value and flags 0 and no instructions
+// seen. All values are in host byte order, like checkpoints.
+
+const uint32_t TRACE_MAGIC   = 0x54494b4c; // "LKIT"
+const uint32_t TRACE_VERSION = 1;
+
+const size_t BLOCK_HEADER = 8;
+const size_t MAX_RECORD   = 1 + 3 + 2 + 3 + 2;
+
+const uint8_t SEQUENTIAL  = 1 << 0;
+const uint8_t SAME_INSTR  = 1 << 1;
+const uint8_t SAME_VALUE  = 1 << 2;
+const uint8_t SAME_FLAGS  = 1 << 3;
+const uint8_t INTERRUPTED = 1 << 4;
+
+static void putVarint(std::vector<uint8_t>& out, uint16_t delta) {
+    // Small changes either way give small numbers
+    int16_t  signedDelta = (int16_t) delta;
+    uint32_t zigzag = ((uint32_t) signedDelta << 1) ^ (uint32_t) (signedDelta >> 15);
+    zigzag &= 0xffff;
+
+    while (zigzag >= 0x80) {
+        out.push_back((zigzag & 0x7f) | 0x80);
+        zigzag >>= 7;
+    }
+    out.push_back(zigzag);
+}
+
+static bool getVarint(const std::vector<uint8_t>& in, size_t& pos, uint16_t& delta) {
+    uint32_t zigzag = 0;
+    for (int shift = 0; shift < 21; shift += 7) {
+        if (pos >= in.size()) return false;
+        uint8_t b = in[pos++];
+        zigzag |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            delta = (uint16_t) ((zigzag >> 1) ^ -(zigzag & 1));
+            return true;
+        }
+    }
+    return false;
+}
+
+static void put16(std::vector<uint8_t>& out, uint16_t value) {
+    size_t pos = out.size();
+    out.resize(pos + 2);
+    memcpy(&out[pos], &value, 2);
+}
+
+static bool get16(const std::vector<uint8_t>& in, size_t& pos, uint16_t& value) {
+    if (pos + 2 > in.size()) return false;
+    memcpy(&value, &in[pos], 2);
+    pos += 2;
+    return true;
+}
+
+static void writeAll(int fd, const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t res = write(fd, data + written, length - written);
+        if (res < 0) {
+            throw std::runtime_error("InstructionTrace: Write failed");
+        }
+        written += res;
+    }
+}
+
+InstructionTrace::InstructionTrace(const char* filename, size_t blockBytes,
+        size_t blocks) {
+    if (blockBytes == 0 || blocks == 0) {
+        throw std::invalid_argument("InstructionTrace::InstructionTrace");
+    }
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("InstructionTrace::InstructionTrace: Could not open file");
+    }
+
+    this->blockBytes = blockBytes;
+    this->blocks     = blocks;
+
+    instructions.resize(0x10000);
+    seen.resize(0x10000, 0);
+    epoch = 0;
+
+    writing    = 0;
+    done       = false;
+    stallCount = 0;
+    stopped    = false;
+    reported   = false;
+
+    startBlock();
+    writer = std::thread(&InstructionTrace::writeLoop, this);
+}
+
+InstructionTrace::~InstructionTrace() {
+    bool wasReported = reported;
+    try {
+        flush();
+    }
+    catch (std::runtime_error& e) {
+        // Destructors can't throw, but the trace is missing its end
+        if (!wasReported) std::cerr << e.what() << std::endl;
+    }
+    {
+        std::lock_guard<std::mutex> lk(m);
+        done = true;
+    }
+    cv.notify_all();
+    writer.join();
+    close(fd);
+}
+
+void InstructionTrace::startBlock() {
+    current.clear();
+    current.reserve(blockBytes + MAX_RECORD + BLOCK_HEADER);
+    current.resize(BLOCK_HEADER);
+    count = 0;
+
+    pc    = 0xffff;
+    value = 0;
+    flags = 0;
+    ++epoch;
+}
+
+void InstructionTrace::record(uint16_t pc, uint16_t instruction, uint16_t value,
+        uint16_t flags, bool interrupted) {
+    if (stopped) return;
+
+    size_t head = current.size();
+    current.push_back(0);
+    uint8_t bits = 0;
+
+    if (pc == (uint16_t) (this->pc + 1)) {
+        bits |= SEQUENTIAL;
+    }
+    else {
+        putVarint(current, pc - this->pc);
+    }
+
+    if (seen[pc] == epoch && instructions[pc] == instruction) {
+        bits |= SAME_INSTR;
+    }
+    else {
+        put16(current, instruction);
+        instructions[pc] = instruction;
+        seen[pc] = epoch;
+    }
+
+    if (value == this->value) {
+        bits |= SAME_VALUE;
+    }
+    else {
+        putVarint(current, value - this->value);
+    }
+
+    if (flags == this->flags) {
+        bits |= SAME_FLAGS;
+    }
+    else {
+        put16(current, flags);
+    }
+
+    if (interrupted) bits |= INTERRUPTED;
+
+    current[head] = bits;
+    this->pc    = pc;
+    this->value = value;
+    this->flags = flags;
+    ++count;
+
+    if (current.size() - BLOCK_HEADER >= blockBytes) submit();
+}
+
+void InstructionTrace::submit() {
+    if (count == 0) return;
+
+    uint32_t header[2] = {(uint32_t) (current.size() - BLOCK_HEADER), count};
+    memcpy(&current[0], header, BLOCK_HEADER);
+
+    std::unique_lock<std::mutex> lk(m);
+    if (full.size() >= blocks && error.empty()) {
+        ++stallCount;
+        while (full.size() >= blocks) cv.wait(lk);
+    }
+
+    // Nothing after a failed write would make sense, so stop recording
+    if (!error.empty()) {
+        stopped = true;
+        lk.unlock();
+        startBlock();
+        return;
+    }
+    full.push_back(std::move(current));
+
+    if (!spare.empty()) {
+        current = std::move(spare.back());
+        spare.pop_back();
+    }
+    else {
+        current = std::vector<uint8_t>();
+    }
+    lk.unlock();
+    cv.notify_all();
+
+    startBlock();
+}
+
+void InstructionTrace::flush() {
+    submit();
+
+    std::unique_lock<std::mutex> lk(m);
+    while (!full.empty() || writing) cv.wait(lk);
+
+    if (!error.empty()) {
+        reported = true;
+        throw std::runtime_error(error);
+    }
+}
+
+uint64_t InstructionTrace::stalls() {
+    std::lock_guard<std::mutex> lk(m);
+    return stallCount;
+}
+
+void InstructionTrace::writeLoop() {
+    // An exception leaving this thread would end the program, so failures
+    // are kept for flush to throw. The header is written here for the same
+    // reason.
+    std::string what;
+    try {
+        uint32_t header[2] = {TRACE_MAGIC, TRACE_VERSION};
+        writeAll(fd, (const uint8_t*) header, sizeof(header));
+    }
+    catch (std::runtime_error& e) {
+        what = e.what();
+    }
+
+    std::unique_lock<std::mutex> lk(m);
+    error = what;
+
+    while (true) {
+        while (full.empty() && !done) cv.wait(lk);
+        if (full.empty()) return;
+
+        std::vector<uint8_t> block = std::move(full.front());
+        full.pop_front();
+        ++writing;
+        bool failed = !error.empty();
+        lk.unlock();
+
+        // Once a write has failed the rest are dropped, so record and flush
+        // don't wait on a disk that isn't taking them
+        what.clear();
+        if (!failed) {
+            try {
+                writeAll(fd, &block[0], block.size());
+            }
+            catch (std::runtime_error& e) {
+                what = e.what();
+            }
+        }
+
+        lk.lock();
+        --writing;
+        if (!what.empty()) error = what;
+        spare.push_back(std::move(block));
+        cv.notify_all();
+    }
+}
+
+InstructionTrace::Reader::Reader(const char* filename) {
+    file = fopen(filename, "rb");
+    if (!file) {
+        throw std::runtime_error("InstructionTrace::Reader: Could not open file");
+    }
+
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+            header[0] != TRACE_MAGIC || header[1] != TRACE_VERSION) {
+        fclose(file);
+        throw std::runtime_error("InstructionTrace::Reader: Not a trace");
+    }
+
+    pos   = 0;
+    left  = 0;
+    index = 0;
+
+    instructions.resize(0x10000);
+    seen.resize(0x10000, 0);
+    epoch = 0;
+}
+
+InstructionTrace::Reader::~Reader() {
+    fclose(file);
+}
+
+bool InstructionTrace::Reader::next(Record& rec) {
+    // Move on to the next block, skipping any empty ones
+    while (left == 0) {
+        uint32_t header[2];
+        if (fread(header, sizeof(header), 1, file) != 1) return false;
+
+        block.resize(header[0]);
+        if (header[0] && fread(&block[0], header[0], 1, file) != 1) return false;
+
+        pos   = 0;
+        left  = header[1];
+        pc    = 0xffff;
+        value = 0;
+        flags = 0;
+        ++epoch;
+    }
+
+    if (pos >= block.size()) return false;
+    uint8_t bits = block[pos++];
+
+    uint16_t delta = 1;
+    if (!(bits & SEQUENTIAL) && !getVarint(block, pos, delta)) return false;
+    pc += delta;
+
+    if (bits & SAME_INSTR) {
+        if (seen[pc] != epoch) return false;
+    }
+    else {
+        if (!get16(block, pos, instructions[pc])) return false;
+        seen[pc] = epoch;
+    }
+
+    if (!(bits & SAME_VALUE)) {
+        if (!getVarint(block, pos, delta)) return false;
+        value += delta;
+    }
+
+    if (!(bits & SAME_FLAGS) && !get16(block, pos, flags)) return false;
+
+    rec.index       = index++;
+    rec.pc          = pc;
+    rec.instruction = instructions[pc];
+    rec.value       = value;
+    rec.flags       = flags;
+    rec.interrupted = bits & INTERRUPTED;
+
+    --left;
+    return true;
+}
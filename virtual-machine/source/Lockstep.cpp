@@ -0,0 +1,214 @@
+#include "Lockstep.hpp"
+#include "Engine.hpp"
+#include "Verifier.hpp"
+
+#include <vector>
+#include <algorithm>
+
+#include <cstdlib>
+#include <cstdint>
+
+const size_t PC = 15;
+
+Lockstep::Lockstep(Engine& expected, Engine& actual, uint64_t interval):
+        expected(expected), actual(actual) {
+    this->interval = interval ? interval : 1;
+
+    tickCount = 0;
+    firstBad  = 0;
+    checkpointTick = 0;
+    checkpointMem.resize(0x10000);
+    checkpointInterrupts[0] = 0;
+    checkpointInterrupts[1] = 0;
+
+    found.instruction = 0;
+    found.error = NULL;
+}
+
+uint64_t Lockstep::divergedAt() {
+    return firstBad;
+}
+
+const Verifier::Divergence& Lockstep::divergence() {
+    return found;
+}
+
+uint64_t Lockstep::ticks() {
+    return tickCount;
+}
+
+Lockstep::Result Lockstep::run(uint64_t limit) {
+    // Start from a full copy, both engines should already agree on it
+    for (uint32_t i = 0; i < 0x10000; ++i) {
+        checkpointMem[i] = expected.read(i);
+    }
+    for (size_t i = 0; i < 16; ++i) {
+        checkpointRegs[i] = expected.inspect(i);
+    }
+    checkpointInterrupts[0] = expected.interrupts();
+    checkpointInterrupts[1] = actual.interrupts();
+    checkpointTick = tickCount;
+
+    // Every page counts as written, so this compares all of memory
+    if (!compare()) {
+        firstBad = tickCount;
+        for (size_t i = 0; i < 16; ++i) found.before[i] = expected.inspect(i);
+        found.instruction = expected.read(expected.inspect(PC));
+        describe();
+        return DIVERGED;
+    }
+
+    while (tickCount < limit) {
+        bool halted = false;
+        uint64_t n = 0;
+        while (n < interval && tickCount < limit && !halted) {
+            halted = step();
+            ++n;
+        }
+
+        if (!compare()) {
+            bisect(tickCount - checkpointTick);
+            return DIVERGED;
+        }
+        save();
+
+        if (halted) return HALTED;
+    }
+    return LIMIT;
+}
+
+bool Lockstep::step() {
+    // PC alone isn't enough, an interrupt can land on the PC it came from,
+    // but it always pushes so STACK moves
+    uint16_t before[2][16];
+    for (size_t i = 0; i < 16; ++i) {
+        before[0][i] = expected.inspect(i);
+        before[1][i] = actual.inspect(i);
+    }
+
+    expected.tick();
+    actual.tick();
+    ++tickCount;
+
+    for (size_t i = 0; i < 16; ++i) {
+        if (before[0][i] != expected.inspect(i)) return false;
+        if (before[1][i] != actual.inspect(i))   return false;
+    }
+    return true;
+}
+
+void Lockstep::takeDirty() {
+    // Either engine might have written a page the other didn't
+    std::vector<size_t> other;
+    expected.dirty(pages);
+    actual.dirty(other);
+    pages.insert(pages.end(), other.begin(), other.end());
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+}
+
+bool Lockstep::compare() {
+    takeDirty();
+
+    for (size_t i = 0; i < 16; ++i) {
+        if (expected.inspect(i) != actual.inspect(i)) return false;
+    }
+
+    for (size_t page : pages) {
+        size_t start = page * Engine::PAGE_WORDS;
+        for (size_t i = start; i < start + Engine::PAGE_WORDS; ++i) {
+            if (expected.read(i) != actual.read(i)) return false;
+        }
+    }
+    return true;
+}
+
+void Lockstep::save() {
+    // Only the pages from the last compare can have changed
+    for (size_t page : pages) {
+        size_t start = page * Engine::PAGE_WORDS;
+        for (size_t i = start; i < start + Engine::PAGE_WORDS; ++i) {
+            checkpointMem[i] = expected.read(i);
+        }
+    }
+    for (size_t i = 0; i < 16; ++i) {
+        checkpointRegs[i] = expected.inspect(i);
+    }
+    // Each engine packs these its own way, so keep both
+    checkpointInterrupts[0] = expected.interrupts();
+    checkpointInterrupts[1] = actual.interrupts();
+    checkpointTick = tickCount;
+}
+
+void Lockstep::restore() {
+    Engine* engines[2] = {&expected, &actual};
+    for (size_t n = 0; n < 2; ++n) {
+        Engine* e = engines[n];
+        for (uint32_t i = 0; i < 0x10000; ++i) {
+            if (e->read(i) != checkpointMem[i]) e->write(i, checkpointMem[i]);
+        }
+        for (size_t i = 0; i < 16; ++i) {
+            e->set(i, checkpointRegs[i]);
+        }
+        e->setInterrupts(checkpointInterrupts[n]);
+        e->dirty(pages);
+    }
+    tickCount = checkpointTick;
+}
+
+void Lockstep::replay(uint64_t count) {
+    restore();
+    for (uint64_t i = 0; i < count; ++i) step();
+}
+
+void Lockstep::bisect(uint64_t bad) {
+    // Agree after 'good' ticks from the checkpoint, disagree after 'bad'
+    uint64_t good = 0;
+    while (bad - good > 1) {
+        uint64_t mid = good + (bad - good) / 2;
+        replay(mid);
+        if (compare()) {
+            good = mid;
+        }
+        else {
+            bad = mid;
+        }
+    }
+
+    // Run up to just before, then the bad tick itself
+    replay(good);
+    takeDirty();
+
+    found.instruction = expected.read(expected.inspect(PC));
+    for (size_t i = 0; i < 16; ++i) found.before[i] = expected.inspect(i);
+
+    if (bad > good) step();
+    firstBad = checkpointTick + good;
+
+    takeDirty();
+    describe();
+}
+
+void Lockstep::describe() {
+    for (size_t i = 0; i < 16; ++i) {
+        found.expected[i] = expected.inspect(i);
+        found.actual[i]   = actual.inspect(i);
+    }
+
+    found.addresses.clear();
+    found.expectedMem.clear();
+    found.actualMem.clear();
+    found.error = NULL;
+
+    for (size_t page : pages) {
+        size_t start = page * Engine::PAGE_WORDS;
+        for (size_t i = start; i < start + Engine::PAGE_WORDS; ++i) {
+            uint16_t a = expected.read(i);
+            uint16_t b = actual.read(i);
+            if (a == b) continue;
+            found.addresses.push_back(i);
+            found.expectedMem.push_back(a);
+            found.actualMem.push_back(b);
+        }
+    }
+}
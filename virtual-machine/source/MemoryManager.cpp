@@ -1,8 +1,16 @@
 #include "MemoryManager.hpp"
 #include "IODevice.hpp"
+#include "CodeImage.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
 
 #include <set>
+#include <vector>
 #include <utility>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm> // fill, count
 #include <thread>
 #include <stdexcept>
 
@@ -10,13 +18,51 @@
 #include <cstdint>
 #include <cstring> // memcpy
 
+#include <sys/mman.h>
+
+// Every page of every memory starts out here. Nothing ever writes to it, a
+// store gets the page its own copy first.
+static const uint16_t ZERO_PAGE[MemoryManager::PAGE_WORDS] = {0};
+
+static uint16_t* allocate(size_t words) {
+    // The host doesn't give us any actual memory until a page is touched
+    void* map = mmap(NULL, sizeof(uint16_t) * words, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("MemoryManager::MemoryManager: Could not allocate memory");
+    }
+    return (uint16_t*) map;
+}
+
 MemoryManager::MemoryManager(size_t words) {
-    this->data  = (uint16_t*) malloc(sizeof(uint16_t) * words);
+    this->data  = allocate(words);
     this->words = words;
+
+    size_t pages = (words + PAGE_WORDS - 1) / PAGE_WORDS;
+    uint16_t* zero = const_cast<uint16_t*>(ZERO_PAGE);
+    // Atomics can't be copied in, so make the tables and then fill them
+    std::vector<std::atomic<uint16_t*>> table(pages);
+    std::vector<std::atomic<uint8_t>> share(pages);
+    pageTable.swap(table);
+    shared.swap(share);
+    for (size_t i = 0; i < pages; ++i) {
+        pageTable[i].store(zero);
+        shared[i].store(COPY);
+    }
+    devicePages.resize(pages, 0);
+
+    codeFrames.resize(pages, zero);
+    codeShare.resize(pages, COPY);
+
+    // Everything starts dirty, so the first checkpoint is a full image
+    dirty.resize(pages, 0);
+    for (size_t i = 0; i < pages; ++i) {
+        markDirty(i);
+    }
 }
 
 MemoryManager::~MemoryManager() {
-    free(data);
+    munmap(data, sizeof(uint16_t) * words);
 }
 
 uint16_t& MemoryManager::operator[](size_t index) {
@@ -24,32 +70,295 @@ uint16_t& MemoryManager::operator[](size_t index) {
         throw std::out_of_range("MemoryManager::operator[]");
     }
 
-    uint16_t& ret = data[index];
+    size_t page = index / PAGE_WORDS;
+    if (shared[page].load(std::memory_order_acquire)) makeWritable(page);
+    markDirty(page);
+    return pageTable[page].load(std::memory_order_acquire)[index % PAGE_WORDS];
+}
+
+uint16_t MemoryManager::read(size_t index) {
+    if (index >= words) {
+        throw std::out_of_range("MemoryManager::read");
+    }
+
+    size_t page = index / PAGE_WORDS;
+    uint16_t& ret = pageTable[page].load(std::memory_order_acquire)[index % PAGE_WORDS];
+
+    // Most pages don't have any devices on them, so skip the search
+    if (!devicePages[page]) return ret;
 
     for (auto p : devices) {
         IODevice& dev = *p.first;
         size_t    pos =  p.second;
 
-        if (pos <= index && index <= pos + dev.length()) {
-            ret = dev.read(index - pos);
-            break;
+        if (pos <= index && index < pos + dev.length()) {
+            if (!dev.answersHere()) {
+                if (Trace::enabled) Trace::instant("device refused", pos);
+                return 0;
+            }
+            if (Stats::enabled) Stats::deviceRead(pos);
+
+            // Another core might be reading the same device, so hand back
+            // what we read rather than what is in memory now
+            uint16_t value = dev.read(index - pos);
+            ret = value;
+            return value;
         }
     }
 
-    return this->data[index];
+    return ret;
 }
 
 void MemoryManager::setRange(size_t index, uint16_t* values, size_t length) {
-    if (index + length >= words) {
+    if (index + length > words) {
         throw std::out_of_range("MemoryManager::setRange");
     }
 
-    memcpy(data + index, values, sizeof(uint16_t) * length);
+    // Copy a page at a time, as consecutive pages need not be next to each
+    // other on the host
+    while (length > 0) {
+        size_t page   = index / PAGE_WORDS;
+        size_t offset = index % PAGE_WORDS;
+        size_t count  = PAGE_WORDS - offset;
+        if (count > length) count = length;
+
+        if (shared[page].load(std::memory_order_acquire)) makeWritable(page);
+        uint16_t* frame = pageTable[page].load(std::memory_order_acquire);
+        memcpy(frame + offset, values, sizeof(uint16_t) * count);
+        markDirty(page);
+
+        index  += count;
+        values += count;
+        length -= count;
+    }
+}
+
+// These bulk operations work directly on memory, they don't trigger any
+// devices
+void MemoryManager::getRange(size_t index, uint16_t* values, size_t length) {
+    if (index + length > words) {
+        throw std::out_of_range("MemoryManager::getRange");
+    }
+
+    while (length > 0) {
+        size_t page   = index / PAGE_WORDS;
+        size_t offset = index % PAGE_WORDS;
+        size_t count  = PAGE_WORDS - offset;
+        if (count > length) count = length;
+
+        uint16_t* frame = pageTable[page].load(std::memory_order_acquire);
+        memcpy(values, frame + offset, sizeof(uint16_t) * count);
+
+        index  += count;
+        values += count;
+        length -= count;
+    }
+}
+
+// Behaves like memmove, the ranges are allowed to overlap
+void MemoryManager::moveRange(size_t dest, size_t src, size_t length) {
+    if (src + length > words || dest + length > words) {
+        throw std::out_of_range("MemoryManager::moveRange");
+    }
+
+    // If dest is inside the source range we need to work from the back so we
+    // don't overwrite anything before it has been copied
+    bool backwards = src < dest && dest < src + length;
+
+    while (length > 0) {
+        size_t srcEnd  = src  + (backwards ? length : 0);
+        size_t destEnd = dest + (backwards ? length : 0);
+
+        // Largest chunk that doesn't cross a page boundary on either side
+        size_t srcRoom, destRoom;
+        if (backwards) {
+            srcRoom  = (srcEnd  - 1) % PAGE_WORDS + 1;
+            destRoom = (destEnd - 1) % PAGE_WORDS + 1;
+        }
+        else {
+            srcRoom  = PAGE_WORDS - src  % PAGE_WORDS;
+            destRoom = PAGE_WORDS - dest % PAGE_WORDS;
+        }
+        size_t count = length;
+        if (count > srcRoom)  count = srcRoom;
+        if (count > destRoom) count = destRoom;
+
+        size_t from = backwards ? srcEnd  - count : src;
+        size_t to   = backwards ? destEnd - count : dest;
+
+        if (shared[to / PAGE_WORDS].load(std::memory_order_acquire)) {
+            makeWritable(to / PAGE_WORDS);
+        }
+        uint16_t* toFrame   = pageTable[to   / PAGE_WORDS].load(std::memory_order_acquire);
+        uint16_t* fromFrame = pageTable[from / PAGE_WORDS].load(std::memory_order_acquire);
+        memmove(toFrame + to % PAGE_WORDS, fromFrame + from % PAGE_WORDS,
+                sizeof(uint16_t) * count);
+        markDirty(to / PAGE_WORDS);
+
+        if (!backwards) {
+            src  += count;
+            dest += count;
+        }
+        length -= count;
+    }
+}
+
+void MemoryManager::fillRange(size_t index, uint16_t value, size_t length) {
+    if (index + length > words) {
+        throw std::out_of_range("MemoryManager::fillRange");
+    }
+
+    while (length > 0) {
+        size_t page   = index / PAGE_WORDS;
+        size_t offset = index % PAGE_WORDS;
+        size_t count  = PAGE_WORDS - offset;
+        if (count > length) count = length;
+
+        if (shared[page].load(std::memory_order_acquire)) makeWritable(page);
+        uint16_t* start = pageTable[page].load(std::memory_order_acquire) + offset;
+        std::fill(start, start + count, value);
+        markDirty(page);
+
+        index  += count;
+        length -= count;
+    }
+}
+
+// Replace the contents of memory with a private copy on write mapping of a
+// file. Nothing is actually read untill it is touched, and the file itself is
+// never written to.
+void MemoryManager::mapFile(int fd, size_t offset) {
+    void* map = mmap(NULL, sizeof(uint16_t) * words, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, offset);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("MemoryManager::mapFile: Could not map file");
+    }
+
+    munmap(data, sizeof(uint16_t) * words);
+    data = (uint16_t*) map;
+
+    // This also undoes any pages that were mapped elsewhere
+    for (size_t i = 0; i < pageTable.size(); ++i) {
+        pageTable[i] = data + i * PAGE_WORDS;
+        shared[i]     = PRIVATE;
+        codeFrames[i] = NULL;
+        codeShare[i]  = PRIVATE;
+        markDirty(i);
+    }
+    images.clear();
+}
+
+// Point a page of guest memory at some other host memory. It is up to the
+// caller to make sure there are PAGE_WORDS words there, and that they stay
+// there untill the page is unmapped.
+void MemoryManager::mapPage(size_t page, uint16_t* frame) {
+    if (page >= pageTable.size()) {
+        throw std::out_of_range("MemoryManager::mapPage");
+    }
+    if (devicePages[page]) {
+        throw std::out_of_range("MemoryManager::mapPage: Device collision");
+    }
+    pageTable[page] = frame;
+    shared[page] = PRIVATE;
+    markDirty(page);
+}
+
+void MemoryManager::unmapPage(size_t page) {
+    if (page >= pageTable.size()) {
+        throw std::out_of_range("MemoryManager::unmapPage");
+    }
+
+    // Shared code goes back to being shared
+    // Mark it shared before pointing it back, so no store lands on the code
+    if (codeFrames[page]) {
+        shared[page] = codeShare[page];
+        pageTable[page] = codeFrames[page];
+    }
+    else {
+        pageTable[page] = data + page * PAGE_WORDS;
+    }
+    markDirty(page);
+}
+
+void MemoryManager::mapCode(size_t page, std::shared_ptr<CodeImage> image, bool copyOnWrite) {
+    size_t count = image->pages();
+    if (page + count > pageTable.size()) {
+        throw std::out_of_range("MemoryManager::mapCode");
+    }
+    for (size_t i = page; i < page + count; ++i) {
+        if (devicePages[i]) {
+            throw std::out_of_range("MemoryManager::mapCode: Device collision");
+        }
+    }
+
+    // Keep it alive for as long as we might point at it
+    images.push_back(image);
+
+    for (size_t i = 0; i < count; ++i) {
+        // Stores are caught before they get here, see makeWritable
+        uint16_t* frame = const_cast<uint16_t*>(image->page(i));
+        codeFrames[page + i] = frame;
+        codeShare[page + i]  = copyOnWrite ? COPY : FAULT;
+        shared[page + i]     = codeShare[page + i];
+        pageTable[page + i]  = frame;
+        markDirty(page + i);
+    }
+}
+
+void MemoryManager::makeWritable(size_t page) {
+    if (shared[page].load(std::memory_order_acquire) == FAULT) {
+        throw std::runtime_error("MemoryManager: Store to read only code");
+    }
+    privatePage(page);
+}
+
+uint16_t* MemoryManager::privatePage(size_t page) {
+    // Two cores can store to the same page at once, only one of them copies
+    std::lock_guard<std::mutex> lk(copyM);
+    if (shared[page].load(std::memory_order_relaxed)) {
+        size_t count = PAGE_WORDS;
+        if ((page + 1) * PAGE_WORDS > words) count = words - page * PAGE_WORDS;
+
+        uint16_t* frame = data + page * PAGE_WORDS;
+        memcpy(frame, pageTable[page].load(std::memory_order_relaxed),
+                sizeof(uint16_t) * count);
+
+        // From now on this page is ours. Stores check shared without the
+        // lock and then follow the table, so the table has to point at the
+        // copy before the page is marked PRIVATE.
+        pageTable[page].store(frame, std::memory_order_release);
+        codeFrames[page] = NULL;
+        codeShare[page]  = PRIVATE;
+        shared[page].store(PRIVATE, std::memory_order_release);
+    }
+    return pageTable[page].load(std::memory_order_relaxed);
+}
+
+void MemoryManager::takeDirty(std::vector<size_t>& pages) {
+    std::lock_guard<std::mutex> lk(dirtyM);
+    pages.swap(dirtyPages);
+    dirtyPages.clear();
+    for (size_t page : pages) dirty[page] = 0;
+}
+
+size_t MemoryManager::pagesInUse() {
+    return std::count(codeFrames.begin(), codeFrames.end(), (uint16_t*) NULL);
+}
+
+void MemoryManager::markDirty(size_t page) {
+    // Only the first write to a page takes the lock
+    if (!dirty[page]) {
+        std::lock_guard<std::mutex> lk(dirtyM);
+        if (!dirty[page]) {
+            dirty[page] = 1;
+            dirtyPages.push_back(page);
+        }
+    }
 }
 
 void MemoryManager::useDevice(IODevice& dev, size_t pos) {
     // Check the device range doesn't overlap the memory boundaries
-    if (pos + dev.length() >= words) {
+    if (pos + dev.length() > words) {
         throw std::out_of_range("MemoryManager::useDevice: Memory boundary collision");
     }
 
@@ -64,42 +373,76 @@ void MemoryManager::useDevice(IODevice& dev, size_t pos) {
         b1 = posCheck;
         b2 = posCheck + devCheck.length();
 
-        if ((a1>=b1 || a2>=b1) && (a1<=b2 || a2<=b2)) {
+        if (a1 < b2 && b1 < a2) {
             throw std::out_of_range("MemoryManager::useDevice: Device collision");
         }
     }
 
+    // Reads from devices are written back to memory, which shared code can't
+    // take
+    for (size_t i = pos / PAGE_WORDS; i * PAGE_WORDS < pos + dev.length(); ++i) {
+        if (codeFrames[i] && codeFrames[i] != ZERO_PAGE) {
+            throw std::out_of_range("MemoryManager::useDevice: Shared code collision");
+        }
+    }
+    for (size_t i = pos / PAGE_WORDS; i * PAGE_WORDS < pos + dev.length(); ++i) {
+        if (shared[i]) privatePage(i);
+    }
+
     devices.insert(std::pair<IODevice*, size_t>(&dev, pos));
+
+    for (size_t i = pos / PAGE_WORDS; i * PAGE_WORDS < pos + dev.length(); ++i) {
+        devicePages[i] += 1;
+    }
 }
 
 void MemoryManager::removeDevice(IODevice& dev) {
     for (auto it = devices.begin(); it != devices.end(); ++it) {
         IODevice& cand = *it->first;
+        size_t    pos  =  it->second;
 
         if (&cand == &dev) {
+            for (size_t i = pos / PAGE_WORDS; i * PAGE_WORDS < pos + dev.length(); ++i) {
+                devicePages[i] -= 1;
+            }
             devices.erase(it);
             break;
         }
     }
 }
 
-void callWrite(IODevice* dev, size_t pos, uint16_t val) {
+void callWrite(IODevice* dev, size_t base, size_t pos, uint16_t val) {
+    uint64_t start = Trace::enabled ? Trace::now() : 0;
     dev->write(pos, val);
+    if (start) Trace::complete("device write", start, base);
 }
 
-void MemoryManager::writeIfDevice(uint16_t* val) {
-    // Make sure it's in the memory chunk
-    if (val < data || val > data + words) return;
+void MemoryManager::writeIfDevice(size_t index, uint16_t value) {
+    if (index >= words) return;
+
+    size_t page = index / PAGE_WORDS;
+    if (!devicePages[page]) return;
 
     // Find if it is in the memory mapped to a device
-    size_t index = val - data;
     for (auto p : devices) {
         IODevice& dev = *p.first;
         size_t    pos =  p.second;
 
-        if (index >= pos && index <= pos + dev.length()) {
-            std::thread(callWrite, &dev, index - pos, *val).detach();
-            *val = 0;
+        if (index >= pos && index < pos + dev.length()) {
+            pageTable[page].load(std::memory_order_acquire)[index % PAGE_WORDS] = 0;
+            if (!dev.answersHere()) {
+                if (Trace::enabled) Trace::instant("device refused", pos);
+                break;
+            }
+            if (Stats::enabled) Stats::deviceWrite(pos);
+
+            if (dev.isSynchronous()) {
+                callWrite(&dev, pos, index - pos, value);
+            }
+            else {
+                if (Trace::enabled) Trace::instant("device dispatch", pos);
+                std::thread(callWrite, &dev, pos, index - pos, value).detach();
+            }
             break;
         }
     }
@@ -2,9 +2,13 @@
 #include <assert.h>
 #include <cstdint>
 
-Operation::Operation(uint8_t opCode, Operation::Mode mode) {
+Operation::Operation(uint8_t opCode, Operation::Mode mode, const char* name) {
     this->opCode = opCode;
     this->mode   = mode;
+    this->name   = name;
+
+    // UNDEF isn't in either table
+    if (opCode >= 16) return;
 
     if (mode == IR || mode == RR) {
         Operation::shortOps[opCode] = this;
@@ -26,18 +30,18 @@ Operation& Operation::fromInstruction(uint16_t instruction) {
     assert(opLo < 16);
     assert(opHi < 16);
 
-    if (opHi == 0) {
-        return *Operation::shortOps[opLo];
-    }
-    else {
-        return *Operation::longOps[opHi];
-    }
+    Operation* op = opHi == 0 ? Operation::shortOps[opLo] : Operation::longOps[opHi];
+    return op ? *op : Operation::UNDEF;
 }
 
 Operation::Mode Operation::getMode() {
     return this->mode;
 }
 
+const char* Operation::getName() {
+    return this->name;
+}
+
 bool operator==(Operation& lhs, Operation& rhs) {
     // These are immutable and unique, just compare addresses
     return &lhs == &rhs;
@@ -48,39 +52,40 @@ bool operator!=(Operation& lhs, Operation& rhs) {
 }
 
 // Move and set operations
-Operation Operation::NOP(  0x0, RR);
-Operation Operation::MOV(  0x1, RR);
-Operation Operation::RELp( 0x1, IIR);
-Operation Operation::RELm( 0x2, IIR);
+Operation Operation::NOP(  0x0, RR,  "NOP");
+Operation Operation::MOV(  0x1, RR,  "MOV");
+Operation Operation::RELp( 0x1, IIR, "REL+");
+Operation Operation::RELm( 0x2, IIR, "REL-");
 // Arithmetic operations
-Operation Operation::ADD(  0x3, RRR);
-Operation Operation::ADDC( 0x4, RRR);
-Operation Operation::ADDi( 0x5, RIR);
-Operation Operation::SUB(  0x6, RRR);
-Operation Operation::SUBB( 0x7, RRR);
-Operation Operation::SUBi( 0x8, RIR);
-Operation Operation::MUL(  0x9, RRR);
-Operation Operation::DIV(  0xa, RRR);
-Operation Operation::ROT(  0xb, RRR);
-Operation Operation::ROTi( 0xc, RIR);
+Operation Operation::ADD(  0x3, RRR, "ADD");
+Operation Operation::ADDC( 0x4, RRR, "ADDC");
+Operation Operation::ADDi( 0x5, RIR, "ADDi");
+Operation Operation::SUB(  0x6, RRR, "SUB");
+Operation Operation::SUBB( 0x7, RRR, "SUBB");
+Operation Operation::SUBi( 0x8, RIR, "SUBi");
+Operation Operation::MUL(  0x9, RRR, "MUL");
+Operation Operation::DIV(  0xa, RRR, "DIV");
+Operation Operation::ROT(  0xb, RRR, "ROT");
+Operation Operation::ROTi( 0xc, RIR, "ROTi");
 // Logic operations
-Operation Operation::OR(   0xd, RRR);
-Operation Operation::AND(  0xe, RRR);
-Operation Operation::XOR(  0xf, RRR);
-Operation Operation::NOT(  0x2, RR);
+Operation Operation::OR(   0xd, RRR, "OR");
+Operation Operation::AND(  0xe, RRR, "AND");
+Operation Operation::XOR(  0xf, RRR, "XOR");
+Operation Operation::NOT(  0x2, RR,  "NOT");
 // Memory operations
-Operation Operation::STORE(0x3, RR);
-Operation Operation::LOAD( 0x4, RR);
-Operation Operation::PUSH( 0x5, RR);
-Operation Operation::POP(  0x6, RR);
+Operation Operation::STORE(0x3, RR,  "STORE");
+Operation Operation::LOAD( 0x4, RR,  "LOAD");
+Operation Operation::PUSH( 0x5, RR,  "PUSH");
+Operation Operation::POP(  0x6, RR,  "POP");
 // Jump and flag operations
-Operation Operation::FPRED(0x7, IR);
-Operation Operation::FSET( 0x8, IR);
-Operation Operation::FCLR( 0x9, IR);
-Operation Operation::FTOG( 0xa, IR);
+Operation Operation::FPRED(0x7, IR,  "FPRED");
+Operation Operation::FSET( 0x8, IR,  "FSET");
+Operation Operation::FCLR( 0x9, IR,  "FCLR");
+Operation Operation::FTOG( 0xa, IR,  "FTOG");
 // Other operations
-Operation Operation::INTER(0xb, RR);
-Operation Operation::WFI(  0xc, RR);
+Operation Operation::INTER(0xb, RR,  "INTER");
+Operation Operation::WFI(  0xc, RR,  "WFI");
+Operation Operation::UNDEF(0x10, RR,  "UNDEF");
 
 Operation* Operation::shortOps[16];
 Operation* Operation::longOps[16];
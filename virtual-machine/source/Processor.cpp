@@ -1,7 +1,16 @@
 #include "Processor.hpp"
 #include "Operation.hpp"
 #include "IODevice.hpp"
-
+#include "Checkpoint.hpp"
+#include "Scheduler.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include "Heatmap.hpp"
+#include "InstructionTrace.hpp"
+#include "devices/InterruptController.hpp"
+
+#include <map>
+#include <utility>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -10,13 +19,65 @@
 #include <cstdlib>
 #include <cstdint>
 
+// Set for as long as a thread is running a processor, so devices can tell
+// their own core from the others
+static thread_local Processor* runningHere = NULL;
+
+struct RunningHere {
+    Processor* prev;
+
+    RunningHere(Processor* cpu) {
+        prev = runningHere;
+        runningHere = cpu;
+    }
+
+    ~RunningHere() {
+        runningHere = prev;
+    }
+};
+
+
+Processor::Processor(size_t memWords):
+        ownedMem(new MemoryManager(memWords)), mem(*ownedMem) {
+    init();
+}
+
+Processor::Processor(MemoryManager& shared): ownedMem(NULL), mem(shared) {
+    init();
+}
+
+Processor::~Processor() {
+    delete ownedMem;
+}
 
-Processor::Processor(size_t memWords): mem(memWords) {
+void Processor::init() {
     anyISF = false;
     softISF = false;
     for (int i = 0; i < 8; ++i) hardISF[i] = false;
 
     lastTickWasInterrupt = false;
+    wakePending = false;
+    stopRequested = false;
+
+    clock = 0;
+    nextEvent = UINT64_MAX;
+
+    checkpoint = NULL;
+    checkpointInterval = 0;
+    sinceCheckpoint = 0;
+
+    controller = NULL;
+    heatmap = NULL;
+    itrace = NULL;
+    lastResult = 0;
+
+    parkOnWait = false;
+    scheduler = NULL;
+    schedState = 0;
+    parked = false;
+
+    raisedAt = 0;
+    waitStart = 0;
 }
 
 void Processor::exec(uint16_t instruction) {
@@ -27,6 +88,7 @@ void Processor::exec(uint16_t instruction) {
     const uint8_t ICF_FLAG   = 4;
 
     Operation& op = Operation::fromInstruction(instruction);
+    if (Stats::enabled) Stats::retire(instruction);
 
     // We need to increase the stack pointer before resolving inputs if the
     // operation is PUSH
@@ -68,23 +130,29 @@ void Processor::exec(uint16_t instruction) {
 
     // For some operations inB is an address in memory
     if (op == Operation::LOAD || op == Operation::POP) {
-        inA = mem[inA];
+        if (Stats::enabled) Stats::load(inA);
+        if (heatmap) heatmap->count(Heatmap::LOAD, inA, clock);
+        inA = mem.read(inA);
     }
 
-    // Compute the result
-    // Some operations write to memory, most write to a register
-    uint16_t* _res;
-    if (op == Operation::STORE || op == Operation::PUSH) {
-        _res = &mem[reg[litC]];
-    }
-    else if (litC == 0) {
-        uint16_t dummy = 0;
-        _res = &dummy;
-    }
-    else {
-        _res = &reg[litC];
-    }
-    uint16_t& res = *_res;
+    // Some operations write to memory, most write to a register. Everything
+    // is worked out first and written at the end, in the order
+    //
+    //     the result, AUX, STACK (for POP), then the flags
+    //
+    // so it is clear what happens when the result goes to one of those.
+    bool toMemory = op == Operation::STORE || op == Operation::PUSH;
+    uint16_t resAddr = toMemory ? reg[litC] : 0;
+
+    uint16_t res = 0;
+    bool writeRes = true;
+
+    bool writeAux = false;
+    uint16_t aux = 0;
+
+    bool setCarry = false;
+    bool carry = false;
+    bool over  = false;
 
     bool setStateFlags = false;
 
@@ -108,58 +176,57 @@ void Processor::exec(uint16_t instruction) {
     // Arithmetic
     //
     else if (op == Operation::ADD || op == Operation::ADDC || op == Operation::ADDi) {
-        res = inA + inB;
-
-        if (op == Operation::ADDC && reg.getBit(RegisterManager::FLAGS, CARRY_FLAG)) {
-            ++res;
-        }
+        uint32_t sum = (uint32_t) inA + inB;
+        if (op == Operation::ADDC && reg.getBit(RegisterManager::FLAGS, CARRY_FLAG)) ++sum;
+        res = sum;
 
         setStateFlags = true;
+        setCarry = true;
         // Set the carry flag if we need to carry
-        bool carry = res < inA;
-        reg.setBit(RegisterManager::FLAGS, CARRY_FLAG, carry);
+        carry = sum > 0xffff;
 
         // Set the overflow flag if we overflow
-        bool over = inA <  0x8000 && inB <  0x8000 && res >= 0x8000 ||
-                    inA >= 0x8000 && inB >= 0x8000 && res <  0x8000;
-
-        reg.setBit(RegisterManager::FLAGS, OVER_FLAG, over);
+        over = inA <  0x8000 && inB <  0x8000 && res >= 0x8000 ||
+               inA >= 0x8000 && inB >= 0x8000 && res <  0x8000;
     }
     else if (op == Operation::SUB || op == Operation::SUBB || op == Operation::SUBi) {
-        res = inA - inB;
-
-        if (op == Operation::SUBB && reg.getBit(RegisterManager::FLAGS, CARRY_FLAG)) {
-            --res;
-        }
+        uint32_t take = inB;
+        if (op == Operation::SUBB && reg.getBit(RegisterManager::FLAGS, CARRY_FLAG)) ++take;
+        res = inA - take;
 
         setStateFlags = true;
+        setCarry = true;
 
         // If this is going to be a negative result, flag carry (borrow)
-        bool carry = inB > inA;
-        reg.setBit(RegisterManager::FLAGS, CARRY_FLAG, carry);
+        carry = take > inA;
 
         // Set the overflow flag if we overflow
-        bool over = inA <  0x8000 && inB >= 0x8000 && res >= 0x8000 ||
-                    inA >= 0x8000 && inB <  0x8000 && res <  0x8000;
-        reg.setBit(RegisterManager::FLAGS, OVER_FLAG, over);
+        over = inA <  0x8000 && inB >= 0x8000 && res >= 0x8000 ||
+               inA >= 0x8000 && inB <  0x8000 && res <  0x8000;
     }
     else if (op == Operation::MUL) {
-        uint32_t prod = inA * inB;
-        uint16_t prodHi = res > 16;
-        uint16_t prodLo = res & ((1 << 16) - 1);
+        uint32_t prod = (uint32_t) inA * inB;
 
-        res = prodLo;
-        reg[RegisterManager::AUX] = prodHi;
+        res = prod & 0xffff;
+        writeAux = true;
+        aux = prod >> 16;
 
         setStateFlags = true;
     }
     else if (op == Operation::DIV) {
-        uint32_t divisor = reg[RegisterManager::AUX] << 16 | inA;
-        uint16_t quotient = divisor / inB;
-        uint16_t modulus  = divisor % inB;
-
-        res = quotient;
-        reg[RegisterManager::AUX] = modulus;
+        uint32_t divisor = (uint32_t) reg[RegisterManager::AUX] << 16 | inA;
+
+        // Dividing by zero gives all ones and leaves the low word as the
+        // remainder, rather than bringing down the host
+        writeAux = true;
+        if (inB == 0) {
+            res = 0xffff;
+            aux = inA;
+        }
+        else {
+            res = divisor / inB;
+            aux = divisor % inB;
+        }
 
         setStateFlags = true;
     }
@@ -209,24 +276,25 @@ void Processor::exec(uint16_t instruction) {
     }
     else if (op == Operation::POP) {
         res = inA;
-        reg[RegisterManager::STACK] -= 1;
     }
 
     //
     // Jump and Flags
     //
     else if (op == Operation::FPRED) {
-        if (!reg.getBit(RegisterManager::FLAGS, inA)) {
-            res = inB + 1;
-        }
+        writeRes = !reg.getBit(RegisterManager::FLAGS, inA);
+        res = inB + 1;
     }
     else if (op == Operation::FSET) {
+        writeRes = false;
         reg.setBit(RegisterManager::FLAGS, inA, true);
     }
     else if (op == Operation::FCLR) {
+        writeRes = false;
         reg.setBit(RegisterManager::FLAGS, inA, false);
     }
     else if (op == Operation::FTOG) {
+        writeRes = false;
         reg.togBit(RegisterManager::FLAGS, inA);
     }
 
@@ -234,11 +302,61 @@ void Processor::exec(uint16_t instruction) {
     // Other
     //
     else if (op == Operation::INTER) {
+        writeRes = false;
         interrupt(-1);
     }
-    else if (op == Operation::WFI && !lastTickWasInterrupt) {
-        std::unique_lock<std::mutex> lk(sleepM);
-        while (!anyISF) sleepCV.wait(lk);
+    else if (op == Operation::WFI) {
+        writeRes = false;
+
+        // Don't wait if an interrupt already came in with fICF clear, it has
+        // already been taken out of anyISF
+        if (!lastTickWasInterrupt && !wakePending) {
+            // Time doesn't mean anything while we are asleep, so if a device
+            // is waiting on the clock skip straight to it
+            while (!anyISF && !events.empty()) {
+                clock = nextEvent;
+                fireEvents();
+            }
+
+            if (parkOnWait && !anyISF) {
+                // Give the thread back, the scheduler runs us again once an
+                // interrupt comes in
+                parked = true;
+                if (Stats::enabled || Trace::enabled) waitStart = Stats::now();
+            }
+            else {
+                if (Stats::enabled || Trace::enabled) waitStart = Stats::now();
+
+                std::unique_lock<std::mutex> lk(sleepM);
+                while (!anyISF) sleepCV.wait(lk);
+
+                finishWait();
+            }
+        }
+        if (!lastTickWasInterrupt) wakePending = false;
+    }
+    else {
+        // Undefined, does nothing
+        writeRes = false;
+    }
+
+    if (writeRes) {
+        if (toMemory) {
+            mem[resAddr] = res;
+            if (Stats::enabled) Stats::store(resAddr);
+            if (heatmap) heatmap->count(Heatmap::STORE, resAddr, clock);
+        }
+        else if (litC != 0) {
+            reg[litC] = res;
+        }
+    }
+
+    if (writeAux) reg[RegisterManager::AUX] = aux;
+    if (op == Operation::POP) reg[RegisterManager::STACK] -= 1;
+
+    if (setCarry) {
+        reg.setBit(RegisterManager::FLAGS, CARRY_FLAG, carry);
+        reg.setBit(RegisterManager::FLAGS, OVER_FLAG, over);
     }
 
     // Set zero and negative flags
@@ -247,8 +365,10 @@ void Processor::exec(uint16_t instruction) {
         reg.setBit(RegisterManager::FLAGS, NEG_FLAG,  res & (1 << 15));
     }
 
+    lastResult = res;
+
     // Trigger an IODevice write if we happened to be writting to a device
-    mem.writeIfDevice(&res);
+    if (toMemory && writeRes) mem.writeIfDevice(resAddr, res);
 }
 
 void Processor::tick() {
@@ -256,18 +376,22 @@ void Processor::tick() {
     const size_t FLAGS_ISF0 = 8;
     const size_t FLAGS_ICF  = 4;
 
+    if (++clock >= nextEvent) fireEvents();
+
     // We clear the flags *conditionally*. If we were to do it unconditionally
     // we run the risk of recieving a flag inbetween the check and the reset
     // resulting in a missed flag.
     if (softISF) {
         reg.setBit(RegisterManager::FLAGS, FLAGS_ISFs, true);
         softISF = false;
+        if (controller) controller->raise(8);
     }
 
     for (int i = 0; i < 8; ++i) {
         if (hardISF[i]) {
             reg.setBit(RegisterManager::FLAGS, FLAGS_ISF0 + i, true);
             hardISF[i] = false;
+            if (controller) controller->raise(i);
         }
     }
 
@@ -278,19 +402,64 @@ void Processor::tick() {
         anyISF = false;
     }
 
-    if (needsInterrupt && reg.getBit(RegisterManager::FLAGS, FLAGS_ICF)) {
+    bool takeInterrupt = needsInterrupt && reg.getBit(RegisterManager::FLAGS, FLAGS_ICF);
+
+    // The controller also takes lines that came in but weren't taken, for
+    // example because a higher priority line went first
+    if (controller && !takeInterrupt && reg.getBit(RegisterManager::FLAGS, FLAGS_ICF)) {
+        takeInterrupt = controller->waiting(reg[RegisterManager::FLAGS]);
+    }
+    uint16_t handler = reg[RegisterManager::IHP];
+
+    // With a controller we go straight to the handler for the line, unless
+    // all the lines that are waiting are masked
+    if (takeInterrupt && controller) {
+        int line = controller->select(reg[RegisterManager::FLAGS]);
+        if (line < 0) {
+            takeInterrupt = false;
+        }
+        else {
+            uint16_t vector = controller->take(line);
+            if (vector) {
+                handler = vector;
+                reg[RegisterManager::FLAGS] &= ~InterruptController::flagBit(line);
+            }
+        }
+    }
+
+    if (Stats::enabled && needsInterrupt) {
+        // Only count from when the interrupt came in to when we jump. If
+        // fICF is clear it isn't going to be taken any time soon, that's up
+        // to the program and not a latency.
+        uint64_t raised = raisedAt.exchange(0);
+        if (raised && takeInterrupt) Stats::latency(Stats::now() - raised);
+    }
+
+    if (takeInterrupt) {
         reg.setBit(RegisterManager::FLAGS, FLAGS_ICF, false);
         anyISF = false;
 
         push(reg[RegisterManager::PC]);
-        reg[RegisterManager::PC] = reg[RegisterManager::IHP];
+        reg[RegisterManager::PC] = handler;
+
+        if (Trace::enabled) Trace::instant("interrupt", handler);
 
         lastTickWasInterrupt = true;
     }
     else {
+        // Remember that we got one for the next WFI
+        if (needsInterrupt) wakePending = true;
+
         uint16_t pc = reg[RegisterManager::PC];
         reg[RegisterManager::PC] += 1;
-        exec(mem[pc]);
+        if (heatmap) heatmap->count(Heatmap::FETCH, pc, clock);
+        uint16_t instruction = mem.read(pc);
+        exec(instruction);
+
+        if (itrace) {
+            itrace->record(pc, instruction, lastResult,
+                    reg[RegisterManager::FLAGS], lastTickWasInterrupt);
+        }
 
         lastTickWasInterrupt = false;
     }
@@ -298,18 +467,76 @@ void Processor::tick() {
 
 // Call tick in a loop untill we halt
 void Processor::run() {
-    uint16_t prevPC;
-    do {
-        prevPC = reg[RegisterManager::PC];
+    runFor(UINT64_MAX);
+}
+
+Processor::RunResult Processor::runFor(uint64_t limit) {
+    RunningHere here(this);
+
+    // Still waiting from last time
+    if (parked) {
+        if (!anyISF) return WAITING;
+        finishWait();
+    }
+
+    for (uint64_t i = 0; i < limit; ++i) {
+        uint16_t prevPC = reg[RegisterManager::PC];
         tick();
+
+        if (checkpoint && ++sinceCheckpoint >= checkpointInterval) {
+            checkpoint->save(*this);
+            sinceCheckpoint = 0;
+        }
+
+        if (parked) {
+            return WAITING;
+        }
+        if (prevPC == reg[RegisterManager::PC] && !lastTickWasInterrupt) {
+            stopRequested = false;
+            return HALTED;
+        }
+        if (stopRequested) {
+            stopRequested = false;
+            return STOPPED;
+        }
+    }
+    return PREEMPTED;
+}
+
+void Processor::setParkOnWait(bool park) {
+    parkOnWait = park;
+}
+
+void Processor::finishWait() {
+    const uint8_t ICF_FLAG = 4;
+
+    // With fICF clear the interrupt that woke us has done its job, don't let
+    // it wake the next WFI too
+    if (!reg.getBit(RegisterManager::FLAGS, ICF_FLAG)) anyISF = false;
+    parked = false;
+
+    if (waitStart) {
+        if (Stats::enabled) Stats::wait(Stats::now() - waitStart);
+        if (Trace::enabled) Trace::complete("wfi", waitStart, 0);
+        waitStart = 0;
     }
-    while (prevPC != reg[RegisterManager::PC] || lastTickWasInterrupt);
+}
+
+// Stop running at the end of the current instruction
+void Processor::stop() {
+    stopRequested = true;
 }
 
 void Processor::interrupt(int line) {
     if (line > 7) {
         throw std::out_of_range("Processor::interrupt");
     }
+    if (Stats::enabled) {
+        Stats::interrupt(line);
+        uint64_t none = 0;
+        raisedAt.compare_exchange_strong(none, Stats::now());
+    }
+
     anyISF = true;
     sleepCV.notify_all();
 
@@ -319,6 +546,9 @@ void Processor::interrupt(int line) {
     else {
         hardISF[line] = true;
     }
+
+    Scheduler* sched = scheduler;
+    if (sched) sched->wake(*this);
 }
 
 void Processor::useDevice(IODevice& dev, size_t pos, uint8_t line) {
@@ -332,6 +562,76 @@ void Processor::useDevice(IODevice& dev, size_t pos, uint8_t line) {
 
 void Processor::removeDevice(IODevice& dev) {
     mem.removeDevice(dev);
+    cancel(dev);
+}
+
+void Processor::useInterruptController(InterruptController& ic) {
+    controller = &ic;
+}
+
+void Processor::useHeatmap(Heatmap& map) {
+    heatmap = &map;
+}
+
+void Processor::useInstructionTrace(InstructionTrace& trace) {
+    itrace = &trace;
+}
+
+uint16_t Processor::packInterrupts() {
+    uint16_t packed = 0;
+    for (int i = 0; i < 8; ++i) {
+        if (hardISF[i]) packed |= 1 << i;
+    }
+    if (softISF)              packed |= 1 << 8;
+    if (anyISF)               packed |= 1 << 9;
+    if (lastTickWasInterrupt) packed |= 1 << 10;
+    if (wakePending)          packed |= 1 << 11;
+
+    return packed;
+}
+
+void Processor::unpackInterrupts(uint16_t packed) {
+    for (int i = 0; i < 8; ++i) {
+        hardISF[i] = packed & (1 << i);
+    }
+    softISF              = packed & (1 << 8);
+    anyISF               = packed & (1 << 9);
+    lastTickWasInterrupt = packed & (1 << 10);
+    wakePending          = packed & (1 << 11);
+}
+
+void Processor::schedule(IODevice& dev, uint64_t when) {
+    events.insert(std::make_pair(when, &dev));
+    nextEvent = events.begin()->first;
+}
+
+void Processor::cancel(IODevice& dev) {
+    for (auto it = events.begin(); it != events.end();) {
+        if (it->second == &dev) {
+            it = events.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    nextEvent = events.empty() ? UINT64_MAX : events.begin()->first;
+}
+
+void Processor::fireEvents() {
+    // expire can schedule more events, so take each one out before calling it
+    while (!events.empty() && events.begin()->first <= clock) {
+        IODevice* dev = events.begin()->second;
+        events.erase(events.begin());
+        nextEvent = events.empty() ? UINT64_MAX : events.begin()->first;
+
+        dev->expire();
+    }
+}
+
+void Processor::useCheckpoint(Checkpoint& cp, uint64_t interval) {
+    checkpoint = &cp;
+    checkpointInterval = interval;
+    sinceCheckpoint = 0;
 }
 
 void Processor::push(uint16_t instruction) {
@@ -347,3 +647,11 @@ void Processor::set(size_t index, uint16_t value) {
 uint16_t Processor::inspect(size_t index) {
     return reg[index];
 }
+
+uint64_t Processor::getClock() {
+    return clock;
+}
+
+Processor* Processor::running() {
+    return runningHere;
+}
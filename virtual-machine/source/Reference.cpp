@@ -0,0 +1,314 @@
+#include "Reference.hpp"
+#include "Engine.hpp"
+
+#include <vector>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+const size_t AUX   = 11;
+const size_t IHP   = 12;
+const size_t FLAGS = 13;
+const size_t STACK = 14;
+const size_t PC    = 15;
+
+const uint16_t ZERO_BIT  = 1 << 0;
+const uint16_t NEG_BIT   = 1 << 1;
+const uint16_t CARRY_BIT = 1 << 2;
+const uint16_t OVER_BIT  = 1 << 3;
+const uint16_t ICF_BIT   = 1 << 4;
+const uint16_t ISFS_BIT  = 1 << 7;
+
+typedef Reference::Outcome Outcome;
+
+static bool sign(uint16_t value) {
+    return value & 0x8000;
+}
+
+static void opNone(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.write = false;
+}
+
+static void opZero(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = 0;
+}
+
+static void opMove(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = a;
+}
+
+static void opRelp(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = b + a;
+}
+
+static void opRelm(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = b - a;
+}
+
+static void add(uint16_t a, uint16_t b, bool carryIn, Outcome& o) {
+    uint32_t full = (uint32_t) a + b + carryIn;
+    o.res = full;
+    o.setCarry = true;
+    o.carry = full >> 16;
+    o.over  = sign(a) == sign(b) && sign(o.res) != sign(a);
+    o.setState = true;
+}
+
+static void sub(uint16_t a, uint16_t b, bool borrowIn, Outcome& o) {
+    int32_t full = (int32_t) a - b - borrowIn;
+    o.res = full;
+    o.setCarry = true;
+    o.carry = full < 0;
+    o.over  = sign(a) != sign(b) && sign(o.res) != sign(a);
+    o.setState = true;
+}
+
+static void opAdd(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    add(a, b, false, o);
+}
+
+static void opAddc(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    add(a, b, f & CARRY_BIT, o);
+}
+
+static void opSub(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    sub(a, b, false, o);
+}
+
+static void opSubb(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    sub(a, b, f & CARRY_BIT, o);
+}
+
+static void opMul(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    uint32_t prod = (uint32_t) a * b;
+    o.res = prod;
+    o.writeAux = true;
+    o.aux = prod >> 16;
+    o.setState = true;
+}
+
+static void opDiv(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    uint32_t num = (uint32_t) x << 16 | a;
+    o.writeAux = true;
+    o.res = b ? num / b : 0xffff;
+    o.aux = b ? num % b : a;
+    o.setState = true;
+}
+
+static void opRot(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    uint32_t twice = (uint32_t) a << 16 | a;
+    o.res = twice >> (16 - b % 16);
+    o.setState = true;
+}
+
+static void opOr(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = a | b;
+    o.setState = true;
+}
+
+static void opAnd(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = a & b;
+    o.setState = true;
+}
+
+static void opXor(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = a ^ b;
+    o.setState = true;
+}
+
+static void opNot(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.res = ~a;
+    o.setState = true;
+}
+
+static void opFpred(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    // Skip the next instruction unless the flag is set
+    o.res = b + 1;
+    o.write = !(f >> a & 1);
+}
+
+static void opFset(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.write = false;
+    o.flags = f | 1 << a;
+}
+
+static void opFclr(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.write = false;
+    o.flags = f & ~(1 << a);
+}
+
+static void opFtog(uint16_t a, uint16_t b, uint16_t f, uint16_t x, Outcome& o) {
+    o.write = false;
+    o.flags = f ^ 1 << a;
+}
+
+typedef Reference::Entry Entry;
+#define R Reference
+
+//                 name     mode    dest       push   load   pop    op
+static const Entry TABLE[32] = {
+    // Short operations, 0x00 ~ 0x0f
+    {"NOP",   R::RR,  R::REG,    false, false, false, opZero},
+    {"MOV",   R::RR,  R::REG,    false, false, false, opMove},
+    {"NOT",   R::RR,  R::REG,    false, false, false, opNot},
+    {"STORE", R::RR,  R::MEMORY, false, false, false, opMove},
+    {"LOAD",  R::RR,  R::REG,    false, true,  false, opMove},
+    {"PUSH",  R::RR,  R::MEMORY, true,  false, false, opMove},
+    {"POP",   R::RR,  R::REG,    false, true,  true,  opMove},
+    {"FPRED", R::IR,  R::REG,    false, false, false, opFpred},
+    {"FSET",  R::IR,  R::NONE,   false, false, false, opFset},
+    {"FCLR",  R::IR,  R::NONE,   false, false, false, opFclr},
+    {"FTOG",  R::IR,  R::NONE,   false, false, false, opFtog},
+    {"INTER", R::RR,  R::NONE,   false, false, false, opNone},
+    {"WFI",   R::RR,  R::NONE,   false, false, false, opNone},
+    {NULL,    R::RR,  R::NONE,   false, false, false, opNone},
+    {NULL,    R::RR,  R::NONE,   false, false, false, opNone},
+    {NULL,    R::RR,  R::NONE,   false, false, false, opNone},
+
+    // Long operations, 0x1000 ~ 0xffff. 0 is the short operations.
+    {NULL,    R::RR,  R::NONE,   false, false, false, opNone},
+    {"REL+",  R::IIR, R::REG,    false, false, false, opRelp},
+    {"REL-",  R::IIR, R::REG,    false, false, false, opRelm},
+    {"ADD",   R::RRR, R::REG,    false, false, false, opAdd},
+    {"ADDC",  R::RRR, R::REG,    false, false, false, opAddc},
+    {"ADDi",  R::RIR, R::REG,    false, false, false, opAdd},
+    {"SUB",   R::RRR, R::REG,    false, false, false, opSub},
+    {"SUBB",  R::RRR, R::REG,    false, false, false, opSubb},
+    {"SUBi",  R::RIR, R::REG,    false, false, false, opSub},
+    {"MUL",   R::RRR, R::REG,    false, false, false, opMul},
+    {"DIV",   R::RRR, R::REG,    false, false, false, opDiv},
+    {"ROT",   R::RRR, R::REG,    false, false, false, opRot},
+    {"ROTi",  R::RIR, R::REG,    false, false, false, opRot},
+    {"OR",    R::RRR, R::REG,    false, false, false, opOr},
+    {"AND",   R::RRR, R::REG,    false, false, false, opAnd},
+    {"XOR",   R::RRR, R::REG,    false, false, false, opXor},
+};
+
+#undef R
+
+Reference::Reference(): memory(0x10000, 0) {
+    for (size_t i = 0; i < 16; ++i) reg[i] = 0;
+    dirtyFlags.resize(0x10000 / PAGE_WORDS, 0);
+    softPending = false;
+}
+
+const Reference::Entry& Reference::entry(uint16_t instruction) {
+    uint8_t opHi = instruction >> 12;
+    uint8_t opLo = (instruction >> 8) & 0xf;
+    return TABLE[opHi ? 16 + opHi : opLo];
+}
+
+void Reference::exec(uint16_t instruction) {
+    const Entry& e = entry(instruction);
+
+    uint8_t A = (instruction >> 8) & 0xf;
+    uint8_t B = (instruction >> 4) & 0xf;
+    uint8_t C = (instruction >> 0) & 0xf;
+
+    reg[0] = 0;
+    if (e.push) reg[STACK] += 1;
+
+    uint16_t inA = 0, inB = 0;
+    switch (e.mode) {
+        case IIR: inA = A << 4 | B; inB = reg[PC];   break;
+        case RIR: inA = reg[A];     inB = B;         break;
+        case RRR: inA = reg[A];     inB = reg[B];    break;
+        case IR:  inA = B;          inB = reg[C];    break;
+        case RR:  inA = reg[B];     inB = reg[C];    break;
+    }
+    if (e.load) inA = memory[inA];
+
+    Outcome o = {0, true, false, 0, false, false, false, false, reg[FLAGS]};
+    e.op(inA, inB, reg[FLAGS], reg[AUX], o);
+
+    if (o.write) {
+        if (e.dest == MEMORY) store(reg[C], o.res);
+        if (e.dest == REG && C != 0) reg[C] = o.res;
+    }
+    if (e.dest == NONE) reg[FLAGS] = o.flags;
+
+    if (o.writeAux) reg[AUX] = o.aux;
+    if (e.pop) reg[STACK] -= 1;
+
+    uint16_t& flags = reg[FLAGS];
+    if (o.setCarry) {
+        flags = (flags & ~(CARRY_BIT | OVER_BIT))
+              | (o.carry ? CARRY_BIT : 0) | (o.over ? OVER_BIT : 0);
+    }
+    if (o.setState) {
+        flags = (flags & ~(ZERO_BIT | NEG_BIT))
+              | (o.res == 0 ? ZERO_BIT : 0) | (sign(o.res) ? NEG_BIT : 0);
+    }
+
+    if (&e == &TABLE[0x0b]) softPending = true;
+
+    reg[0] = 0;
+}
+
+void Reference::tick() {
+    // An interrupt from last tick sets its flag, and is taken instead of
+    // the next instruction if fICF is set
+    if (softPending) {
+        softPending = false;
+        reg[FLAGS] |= ISFS_BIT;
+
+        if (reg[FLAGS] & ICF_BIT) {
+            reg[FLAGS] &= ~ICF_BIT;
+            reg[STACK] += 1;
+            store(reg[STACK], reg[PC]);
+            reg[PC] = reg[IHP];
+            return;
+        }
+    }
+
+    uint16_t pc = reg[PC];
+    reg[PC] += 1;
+    exec(memory[pc]);
+}
+
+uint16_t Reference::interrupts() {
+    return softPending ? 1 : 0;
+}
+
+void Reference::setInterrupts(uint16_t packed) {
+    softPending = packed & 1;
+}
+
+void Reference::store(uint16_t address, uint16_t value) {
+    memory[address] = value;
+
+    size_t page = address / PAGE_WORDS;
+    if (!dirtyFlags[page]) {
+        dirtyFlags[page] = 1;
+        dirtyPages.push_back(page);
+    }
+}
+
+void Reference::dirty(std::vector<size_t>& pages) {
+    pages.swap(dirtyPages);
+    dirtyPages.clear();
+    for (size_t page : pages) dirtyFlags[page] = 0;
+}
+
+void Reference::set(size_t index, uint16_t value) {
+    if (index >= 16) {
+        throw std::out_of_range("Reference::set");
+    }
+    reg[index] = value;
+}
+
+uint16_t Reference::inspect(size_t index) {
+    if (index >= 16) {
+        throw std::out_of_range("Reference::inspect");
+    }
+    return index ? reg[index] : 0;
+}
+
+void Reference::write(uint16_t address, uint16_t value) {
+    store(address, value);
+}
+
+uint16_t Reference::read(uint16_t address) {
+    return memory[address];
+}
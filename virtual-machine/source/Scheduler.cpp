@@ -0,0 +1,116 @@
+#include "Scheduler.hpp"
+#include "Processor.hpp"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+Scheduler::Scheduler(size_t workers, uint64_t slice) {
+    if (workers == 0 || slice == 0) {
+        throw std::out_of_range("Scheduler::Scheduler");
+    }
+
+    this->slice = slice;
+    live = 0;
+    done = false;
+
+    for (size_t i = 0; i < workers; ++i) {
+        this->workers.push_back(std::thread(&Scheduler::work, this));
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lk(mt);
+        done = true;
+    }
+    queueCV.notify_all();
+
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+void Scheduler::add(Processor& cpu) {
+    {
+        std::lock_guard<std::mutex> lk(mt);
+        ++live;
+    }
+    cpu.parkOnWait = true;
+    cpu.scheduler = this;
+    cpu.schedState = QUEUED;
+    enqueue(cpu);
+}
+
+void Scheduler::wait() {
+    std::unique_lock<std::mutex> lk(mt);
+    while (live > 0) doneCV.wait(lk);
+}
+
+size_t Scheduler::count() {
+    std::lock_guard<std::mutex> lk(mt);
+    return live;
+}
+
+void Scheduler::enqueue(Processor& cpu) {
+    {
+        std::lock_guard<std::mutex> lk(mt);
+        queue.push_back(&cpu);
+    }
+    queueCV.notify_one();
+}
+
+// Called by Processor::interrupt, from any thread
+void Scheduler::wake(Processor& cpu) {
+    uint8_t expected = PARKED;
+    if (cpu.schedState.compare_exchange_strong(expected, QUEUED)) {
+        enqueue(cpu);
+    }
+}
+
+void Scheduler::work() {
+    while (true) {
+        Processor* cpu;
+        {
+            std::unique_lock<std::mutex> lk(mt);
+            while (queue.empty() && !done) queueCV.wait(lk);
+            if (done) return;
+
+            cpu = queue.front();
+            queue.pop_front();
+        }
+
+        cpu->schedState = RUNNING;
+
+        switch (cpu->runFor(slice)) {
+            case Processor::PREEMPTED:
+                cpu->schedState = QUEUED;
+                enqueue(*cpu);
+                break;
+
+            case Processor::WAITING:
+                // Park, then look again. Either interrupt sees us parked, or
+                // we see what it set before it looked.
+                cpu->schedState = PARKED;
+                if (cpu->anyISF) wake(*cpu);
+                break;
+
+            default:
+                cpu->schedState = HALTED;
+                cpu->scheduler = NULL;
+                cpu->parkOnWait = false;
+                {
+                    std::lock_guard<std::mutex> lk(mt);
+                    --live;
+                }
+                doneCV.notify_all();
+                break;
+        }
+    }
+}
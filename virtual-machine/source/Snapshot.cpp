@@ -0,0 +1,149 @@
+#include "Snapshot.hpp"
+#include "Processor.hpp"
+#include "MemoryManager.hpp"
+#include "RegisterManager.hpp"
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring> // memcpy
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// The header is laid out as
+//
+//     magic      "LKSN"
+//     words      size of memory
+//     registers  16 words
+//     interrupts 1 word, see Processor::packInterrupts
+//
+// padded out to HEADER_SIZE, which needs to be a multiple of the host page
+// size so the memory that follows can be mapped directly.
+
+const uint32_t SNAPSHOT_MAGIC = 0x4e534b4c; // "LKSN"
+const size_t   HEADER_SIZE    = 0x10000;
+
+static void writeAll(int fd, const void* data, size_t length) {
+    const uint8_t* bytes = (const uint8_t*) data;
+    size_t written = 0;
+    while (written < length) {
+        ssize_t res = write(fd, bytes + written, length - written);
+        if (res < 0) {
+            throw std::runtime_error("Snapshot::save: Write failed");
+        }
+        written += res;
+    }
+}
+
+void Snapshot::save(Processor& cpu, const char* filename) {
+    MemoryManager& mem = cpu.mem;
+
+    std::vector<uint8_t> header(HEADER_SIZE, 0);
+
+    uint32_t magic = SNAPSHOT_MAGIC;
+    uint64_t words = mem.words;
+    uint16_t registers[16];
+    for (size_t i = 0; i < 16; ++i) {
+        registers[i] = cpu.reg[i];
+    }
+    uint16_t interrupts = cpu.packInterrupts();
+
+    uint8_t* pos = &header[0];
+    memcpy(pos, &magic,      sizeof(magic));      pos += sizeof(magic);
+    memcpy(pos, &words,      sizeof(words));      pos += sizeof(words);
+    memcpy(pos, registers,   sizeof(registers));  pos += sizeof(registers);
+    memcpy(pos, &interrupts, sizeof(interrupts));
+
+    // Write to a temporary file and move it into place, so a crash half way
+    // through never leaves a broken snapshot behind
+    std::string tempName = std::string(filename) + ".tmp";
+    int fd = open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Snapshot::save: Could not open file");
+    }
+
+    // Anything short of a complete file on disk leaves the old snapshot be
+    try {
+        writeAll(fd, &header[0], HEADER_SIZE);
+        // Pages may not be next to each other, so write them one by one
+        for (size_t page = 0; page < mem.pageTable.size(); ++page) {
+            size_t count = MemoryManager::PAGE_WORDS;
+            if ((page + 1) * count > mem.words) count = mem.words - page * count;
+            writeAll(fd, mem.pageTable[page].load(), sizeof(uint16_t) * count);
+        }
+        if (fsync(fd) != 0) {
+            throw std::runtime_error("Snapshot::save: Could not flush file");
+        }
+    }
+    catch (std::runtime_error& e) {
+        close(fd);
+        unlink(tempName.c_str());
+        throw;
+    }
+
+    if (close(fd) != 0) {
+        unlink(tempName.c_str());
+        throw std::runtime_error("Snapshot::save: Could not flush file");
+    }
+    if (rename(tempName.c_str(), filename) != 0) {
+        unlink(tempName.c_str());
+        throw std::runtime_error("Snapshot::save: Could not rename file");
+    }
+}
+
+void Snapshot::boot(Processor& cpu, const char* filename) {
+    MemoryManager& mem = cpu.mem;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Snapshot::boot: Could not open file");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Snapshot::boot: Could not read file size");
+    }
+
+    uint32_t magic = 0;
+    uint64_t words = 0;
+    uint16_t registers[16];
+    uint16_t interrupts;
+
+    uint8_t header[sizeof(magic) + sizeof(words) + sizeof(registers) + sizeof(interrupts)];
+    if (pread(fd, header, sizeof(header), 0) == sizeof(header)) {
+        uint8_t* pos = header;
+        memcpy(&magic,      pos, sizeof(magic));      pos += sizeof(magic);
+        memcpy(&words,      pos, sizeof(words));      pos += sizeof(words);
+        memcpy(registers,   pos, sizeof(registers));  pos += sizeof(registers);
+        memcpy(&interrupts, pos, sizeof(interrupts));
+    }
+
+    bool valid = magic == SNAPSHOT_MAGIC && words == mem.words
+        && (size_t) st.st_size >= HEADER_SIZE + sizeof(uint16_t) * words;
+
+    if (!valid) {
+        close(fd);
+        throw std::runtime_error("Snapshot::boot: Not a snapshot for this machine");
+    }
+
+    try {
+        mem.mapFile(fd, HEADER_SIZE);
+    }
+    catch (std::exception& e) {
+        close(fd);
+        throw;
+    }
+    // The mapping holds its own reference to the file
+    close(fd);
+
+    for (size_t i = 0; i < 16; ++i) {
+        cpu.reg[i] = registers[i];
+    }
+    cpu.unpackInterrupts(interrupts);
+}
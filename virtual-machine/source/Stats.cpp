@@ -0,0 +1,267 @@
+#include "Stats.hpp"
+
+#include <ostream>
+#include <fstream>
+#include <atomic>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <csignal>
+
+#include <unistd.h>
+
+bool Stats::enabled = false;
+
+// Every thread's block, so they can be added up. Blocks outlive their
+// threads, what a thread counted still counts once it is gone. Counts only
+// ever get added up, so once a thread is gone the next new thread carries on
+// counting into its block rather than each short lived device thread getting
+// one of its own.
+static std::mutex blocksM;
+static std::vector<void*> blocks;
+static std::vector<void*> idle;
+
+struct BlockOwner {
+    void* block;
+
+    BlockOwner() {
+        block = NULL;
+    }
+
+    ~BlockOwner() {
+        if (!block) return;
+        std::lock_guard<std::mutex> lk(blocksM);
+        idle.push_back(block);
+    }
+};
+
+// Interrupts come from any thread so these are shared, they are rare enough
+static std::atomic<uint64_t> interrupts[9];
+
+// Names for the opcode slots, long operations go in 16 ~ 31
+static const char* OP_NAMES[Stats::OPCODES] = {
+    "NOP", "MOV", "NOT", "STORE", "LOAD", "PUSH", "POP", "FPRED",
+    "FSET", "FCLR", "FTOG", "INTER", "WFI", "0x0d", "0x0e", "0x0f",
+    "0x00", "REL+", "REL-", "ADD", "ADDC", "ADDi", "SUB", "SUBB",
+    "SUBi", "MUL", "DIV", "ROT", "ROTi", "OR", "AND", "XOR",
+};
+
+Stats::Counters::Counters() {
+    for (size_t i = 0; i < OPCODES; ++i) ops[i] = 0;
+    for (size_t i = 0; i < REGIONS; ++i) {
+        loads[i]  = 0;
+        stores[i] = 0;
+    }
+    waits  = 0;
+    waitNs = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) latency[i] = 0;
+    for (size_t i = 0; i < DEVICES; ++i) {
+        devices[i].pos    = NO_DEVICE;
+        devices[i].reads  = 0;
+        devices[i].writes = 0;
+    }
+}
+
+Stats::Counters& Stats::local() {
+    thread_local BlockOwner mine;
+    if (!mine.block) {
+        std::lock_guard<std::mutex> lk(blocksM);
+        if (!idle.empty()) {
+            mine.block = idle.back();
+            idle.pop_back();
+        }
+        else {
+            mine.block = new Counters();
+            blocks.push_back(mine.block);
+        }
+    }
+    return *(Counters*) mine.block;
+}
+
+void Stats::bump(Counter& c, uint64_t n) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void Stats::retire(uint16_t instruction) {
+    uint8_t opHi = instruction >> 12;
+    uint8_t opLo = (instruction >> 8) & 0xf;
+    bump(local().ops[opHi ? 16 + opHi : opLo]);
+}
+
+void Stats::load(size_t address) {
+    bump(local().loads[(address / REGION_WORDS) % REGIONS]);
+}
+
+void Stats::store(size_t address) {
+    bump(local().stores[(address / REGION_WORDS) % REGIONS]);
+}
+
+Stats::Counters::Device* Stats::device(size_t pos) {
+    // Only a handful of devices are ever mapped, so open addressing on the
+    // position is plenty. Anything past DEVICES just isn't counted.
+    Counters& c = local();
+    for (size_t i = 0; i < DEVICES; ++i) {
+        Counters::Device& d = c.devices[(pos + i) % DEVICES];
+        size_t key = d.pos.load(std::memory_order_relaxed);
+        if (key == pos) return &d;
+        if (key == NO_DEVICE) {
+            d.pos.store(pos, std::memory_order_release);
+            return &d;
+        }
+    }
+    return NULL;
+}
+
+void Stats::deviceRead(size_t pos) {
+    Counters::Device* d = device(pos);
+    if (d) bump(d->reads);
+}
+
+void Stats::deviceWrite(size_t pos) {
+    Counters::Device* d = device(pos);
+    if (d) bump(d->writes);
+}
+
+void Stats::wait(uint64_t ns) {
+    Counters& c = local();
+    bump(c.waits);
+    bump(c.waitNs, ns);
+}
+
+void Stats::latency(uint64_t ns) {
+    // Bucket i holds latencies under 2^i ns
+    size_t bucket = 0;
+    while (bucket + 1 < BUCKETS && (ns >> bucket) != 0) ++bucket;
+    bump(local().latency[bucket]);
+}
+
+void Stats::interrupt(int line) {
+    interrupts[line < 0 ? 8 : line].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Stats::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void writeArray(std::ostream& out, const uint64_t* values, size_t length) {
+    out << "[";
+    for (size_t i = 0; i < length; ++i) {
+        out << (i ? ", " : "") << values[i];
+    }
+    out << "]";
+}
+
+void Stats::dump(std::ostream& out) {
+    uint64_t ops[OPCODES] = {0};
+    uint64_t loads[REGIONS] = {0};
+    uint64_t stores[REGIONS] = {0};
+    uint64_t waits = 0, waitNs = 0;
+    uint64_t latency[BUCKETS] = {0};
+    std::map<size_t, std::pair<uint64_t, uint64_t>> devices;
+
+    {
+        std::lock_guard<std::mutex> lk(blocksM);
+        for (void* p : blocks) {
+            Counters& c = *(Counters*) p;
+            for (size_t i = 0; i < OPCODES; ++i) ops[i] += c.ops[i];
+            for (size_t i = 0; i < REGIONS; ++i) {
+                loads[i]  += c.loads[i];
+                stores[i] += c.stores[i];
+            }
+            waits  += c.waits;
+            waitNs += c.waitNs;
+            for (size_t i = 0; i < BUCKETS; ++i) latency[i] += c.latency[i];
+
+            for (size_t i = 0; i < DEVICES; ++i) {
+                size_t pos = c.devices[i].pos.load(std::memory_order_acquire);
+                if (pos == NO_DEVICE) continue;
+                devices[pos].first  += c.devices[i].reads;
+                devices[pos].second += c.devices[i].writes;
+            }
+        }
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < OPCODES; ++i) total += ops[i];
+
+    out << "{\n";
+    out << "  \"instructions\": " << total << ",\n";
+
+    out << "  \"opcodes\": {";
+    bool first = true;
+    for (size_t i = 0; i < OPCODES; ++i) {
+        if (!ops[i]) continue;
+        out << (first ? "" : ",") << "\n    \"" << OP_NAMES[i] << "\": " << ops[i];
+        first = false;
+    }
+    out << (first ? "" : "\n  ") << "},\n";
+
+    out << "  \"region_words\": " << REGION_WORDS << ",\n";
+    out << "  \"loads\": ";
+    writeArray(out, loads, REGIONS);
+    out << ",\n  \"stores\": ";
+    writeArray(out, stores, REGIONS);
+    out << ",\n";
+
+    out << "  \"devices\": {";
+    first = true;
+    for (auto& d : devices) {
+        out << (first ? "" : ",") << "\n    \"" << std::hex << d.first << std::dec
+            << "\": {\"reads\": " << d.second.first
+            << ", \"writes\": " << d.second.second << "}";
+        first = false;
+    }
+    out << (first ? "" : "\n  ") << "},\n";
+
+    uint64_t lines[9];
+    for (int i = 0; i < 9; ++i) lines[i] = interrupts[i];
+    out << "  \"interrupts\": ";
+    writeArray(out, lines, 9);
+    out << ",\n";
+
+    out << "  \"wfi\": {\"count\": " << waits << ", \"ns\": " << waitNs << "},\n";
+
+    // Bucket i counts latencies under 2^i ns
+    out << "  \"interrupt_latency_ns\": ";
+    writeArray(out, latency, BUCKETS);
+    out << "\n}" << std::endl;
+}
+
+// Signal handlers can't do much, so the handler pokes a pipe and a thread
+// does the writing
+static int signalPipe[2];
+
+static void onSignal(int signal) {
+    char c = 0;
+    ssize_t res = write(signalPipe[1], &c, 1);
+    (void) res;
+}
+
+static void dumpLoop(std::string filename) {
+    char c;
+    while (read(signalPipe[0], &c, 1) == 1) {
+        std::ofstream out(filename.c_str());
+        Stats::dump(out);
+    }
+}
+
+void Stats::dumpOnSignal(int signal, const char* filename) {
+    if (pipe(signalPipe) != 0) {
+        throw std::runtime_error("Stats::dumpOnSignal: Could not create pipe");
+    }
+    std::thread(dumpLoop, std::string(filename)).detach();
+
+    struct sigaction sa;
+    sa.sa_handler = onSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(signal, &sa, NULL);
+}
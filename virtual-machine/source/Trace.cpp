@@ -0,0 +1,169 @@
+#include "Trace.hpp"
+
+#include <ostream>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+bool Trace::enabled = false;
+
+// Every thread's buffer, so they can be written out. Buffers outlive their
+// threads, and devices often write from short lived threads, so a buffer is
+// handed on to the next new thread once its thread is done with it. That
+// keeps the number of buffers down to the most threads running at once.
+static std::mutex buffersM;
+static std::vector<void*> buffers;
+static std::vector<void*> idle;
+
+struct BufferOwner {
+    void* buff;
+
+    BufferOwner() {
+        buff = NULL;
+    }
+
+    ~BufferOwner() {
+        if (!buff) return;
+        std::lock_guard<std::mutex> lk(buffersM);
+        idle.push_back(buff);
+    }
+};
+
+Trace::Chunk::Chunk() {
+    next = NULL;
+}
+
+Trace::Buffer::Buffer(size_t tid) {
+    this->tid = tid;
+    tail = &head;
+    count = 0;
+    dropped = 0;
+}
+
+Trace::Buffer& Trace::local() {
+    thread_local BufferOwner mine;
+    if (!mine.buff) {
+        std::lock_guard<std::mutex> lk(buffersM);
+        if (!idle.empty()) {
+            mine.buff = idle.back();
+            idle.pop_back();
+        }
+        else {
+            mine.buff = new Buffer(buffers.size());
+            buffers.push_back(mine.buff);
+        }
+    }
+    return *(Buffer*) mine.buff;
+}
+
+void Trace::record(const char* name, char phase, uint64_t ts, uint64_t dur,
+        uint64_t arg) {
+    Buffer& buff = local();
+    size_t count = buff.count.load(std::memory_order_relaxed);
+
+    if (count >= THREAD_EVENTS) {
+        buff.dropped.store(buff.dropped.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+        return;
+    }
+
+    // Start a new chunk when the last one is full. It is linked in before
+    // count covers any of it, so the writer can always follow the list.
+    if (count && count % CHUNK_EVENTS == 0) {
+        Chunk* chunk = new Chunk();
+        buff.tail->next.store(chunk, std::memory_order_relaxed);
+        buff.tail = chunk;
+    }
+
+    Event& e = buff.tail->events[count % CHUNK_EVENTS];
+    e.name  = name;
+    e.phase = phase;
+    e.ts    = ts;
+    e.dur   = dur;
+    e.arg   = arg;
+
+    buff.count.store(count + 1, std::memory_order_release);
+}
+
+void Trace::instant(const char* name, uint64_t arg) {
+    record(name, 'i', now(), 0, arg);
+}
+
+void Trace::complete(const char* name, uint64_t start, uint64_t arg) {
+    record(name, 'X', start, now() - start, arg);
+}
+
+void Trace::begin(const char* name, uint64_t id) {
+    record(name, 'b', now(), 0, id);
+}
+
+void Trace::end(const char* name, uint64_t id) {
+    record(name, 'e', now(), 0, id);
+}
+
+uint64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Trace-event times are in microseconds
+static void writeTime(std::ostream& out, uint64_t ns) {
+    char buff[32];
+    snprintf(buff, sizeof(buff), "%llu.%03llu",
+            (unsigned long long) (ns / 1000), (unsigned long long) (ns % 1000));
+    out << buff;
+}
+
+void Trace::write(std::ostream& out) {
+    std::lock_guard<std::mutex> lk(buffersM);
+
+    out << "{\"traceEvents\": [";
+    bool first = true;
+
+    for (void* p : buffers) {
+        Buffer& buff = *(Buffer*) p;
+        size_t count = buff.count.load(std::memory_order_acquire);
+        if (!count) continue;
+
+        out << (first ? "" : ",")
+            << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": "
+            << buff.tid << ", \"args\": {\"name\": \"thread " << buff.tid;
+        if (buff.dropped) out << " (dropped " << buff.dropped << ")";
+        out << "\"}}";
+        first = false;
+
+        const Chunk* chunk = &buff.head;
+        for (size_t i = 0; i < count; ++i) {
+            if (i && i % CHUNK_EVENTS == 0) {
+                chunk = chunk->next.load(std::memory_order_relaxed);
+            }
+            const Event& e = chunk->events[i % CHUNK_EVENTS];
+
+            out << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"vm\", \"ph\": \""
+                << e.phase << "\", \"pid\": 0, \"tid\": " << buff.tid << ", \"ts\": ";
+            writeTime(out, e.ts);
+
+            if (e.phase == 'X') {
+                out << ", \"dur\": ";
+                writeTime(out, e.dur);
+            }
+            if (e.phase == 'i') {
+                out << ", \"s\": \"t\"";
+            }
+            if (e.phase == 'b' || e.phase == 'e') {
+                out << ", \"id\": " << e.arg;
+            }
+            else {
+                out << ", \"args\": {\"value\": " << e.arg << "}";
+            }
+            out << "}";
+        }
+    }
+
+    out << "\n]}" << std::endl;
+}
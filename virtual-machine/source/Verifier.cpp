@@ -0,0 +1,297 @@
+#include "Verifier.hpp"
+#include "Engine.hpp"
+#include "Reference.hpp"
+
+#include <ostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+const size_t FLAGS = 13;
+const uint32_t CHUNK = 256;
+
+// Values that tend to find mistakes
+static const uint16_t INTERESTING[] = {
+    0x0000, 0x0001, 0x0002, 0x000f, 0x0010, 0x7fff, 0x8000, 0x8001, 0xfffe, 0xffff,
+};
+
+// splitmix64, cheap and good enough to pick test states
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static Engine* makeReference() {
+    return new Reference();
+}
+
+Verifier::Verifier(Factory actual, Factory expected) {
+    this->actual   = actual;
+    this->expected = expected ? expected : Factory(makeReference);
+
+    threads = 0;
+    samples = 16;
+    maxDivergences = 16;
+    seed = 0;
+}
+
+void Verifier::setThreads(size_t threads) {
+    this->threads = threads;
+}
+
+void Verifier::setSamples(size_t samples) {
+    this->samples = samples;
+}
+
+void Verifier::setMaxDivergences(size_t max) {
+    maxDivergences = max;
+}
+
+void Verifier::setSeed(uint64_t seed) {
+    this->seed = seed;
+}
+
+const std::vector<Verifier::Divergence>& Verifier::divergences() {
+    return found;
+}
+
+uint16_t Verifier::pattern(uint16_t address) {
+    return mix(address) >> 48;
+}
+
+uint64_t Verifier::run(uint32_t first, uint32_t count) {
+    if (first + count > 0x10000) {
+        throw std::out_of_range("Verifier::run");
+    }
+    found.clear();
+
+    size_t n = threads;
+    if (n == 0) n = std::thread::hardware_concurrency();
+    if (n == 0) n = 1;
+
+    std::atomic<uint32_t> next(0);
+    std::atomic<uint64_t> cases(0);
+
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < n; ++i) {
+        pool.push_back(std::thread(&Verifier::work, this, first, count,
+                    std::ref(next), std::ref(cases)));
+    }
+    for (std::thread& t : pool) t.join();
+
+    // Threads finish in any order, report in instruction order
+    std::sort(found.begin(), found.end(),
+            [](const Divergence& a, const Divergence& b) {
+                return a.instruction < b.instruction;
+            });
+    return cases;
+}
+
+void Verifier::work(uint32_t first, uint32_t count, std::atomic<uint32_t>& next,
+        std::atomic<uint64_t>& cases) {
+    Pair p;
+    p.expected = expected();
+    p.actual   = actual();
+
+    for (uint32_t i = 0; i < 0x10000; ++i) {
+        p.expected->write(i, pattern(i));
+        p.actual->write(i, pattern(i));
+    }
+
+    uint64_t done = 0;
+    while (true) {
+        uint32_t start = next.fetch_add(CHUNK);
+        if (start >= count) break;
+        {
+            std::lock_guard<std::mutex> lk(foundM);
+            if (found.size() >= maxDivergences) break;
+        }
+
+        for (uint32_t i = start; i < start + CHUNK && i < count; ++i) {
+            uint16_t instruction = first + i;
+            for (size_t s = 0; s < samples; ++s) {
+                uint16_t regs[16];
+                state(instruction, s, regs);
+                ++done;
+                if (check(p, instruction, regs, NULL)) continue;
+
+                // Only report the simplest state for each encoding
+                minimise(p, instruction, regs);
+                Divergence d;
+                check(p, instruction, regs, &d);
+
+                std::lock_guard<std::mutex> lk(foundM);
+                if (found.size() < maxDivergences) found.push_back(d);
+                break;
+            }
+        }
+    }
+    cases += done;
+
+    delete p.expected;
+    delete p.actual;
+}
+
+void Verifier::state(uint16_t instruction, size_t sample, uint16_t* regs) {
+    uint64_t r = mix(seed ^ mix((uint64_t) instruction << 32 | sample));
+
+    for (size_t i = 0; i < 16; ++i) {
+        // The first two samples are all zeros and all ones, after that a
+        // mix of interesting and random values
+        if (sample < 2) {
+            regs[i] = sample ? 0xffff : 0;
+            continue;
+        }
+        r = mix(r);
+        if (r & 1) {
+            regs[i] = INTERESTING[(r >> 8) % (sizeof(INTERESTING) / sizeof(uint16_t))];
+        }
+        else {
+            regs[i] = r >> 32;
+        }
+    }
+    regs[0] = 0;
+}
+
+bool Verifier::check(Pair& p, uint16_t instruction, const uint16_t* regs,
+        Divergence* d) {
+    Engine* engines[2] = {p.expected, p.actual};
+    uint16_t after[2][16];
+    const char* error[2] = {NULL, NULL};
+
+    for (int e = 0; e < 2; ++e) {
+        for (size_t i = 0; i < 16; ++i) engines[e]->set(i, regs[i]);
+        try {
+            engines[e]->exec(instruction);
+        }
+        catch (std::exception& ex) {
+            error[e] = "exception";
+        }
+        for (size_t i = 0; i < 16; ++i) after[e][i] = engines[e]->inspect(i);
+    }
+
+    bool same = !error[0] && !error[1];
+    for (size_t i = 0; i < 16; ++i) {
+        if (after[0][i] != after[1][i]) same = false;
+    }
+
+    // An instruction can only write to memory at an address held in a
+    // register, or one past it for PUSH. Put it all back for the next case.
+    std::vector<uint16_t> addresses;
+    std::vector<uint16_t> values[2];
+    for (size_t i = 0; i < 32; ++i) {
+        uint16_t address = regs[i / 2] + i % 2;
+        uint16_t a = engines[0]->read(address);
+        uint16_t b = engines[1]->read(address);
+        if (a != b) {
+            same = false;
+            addresses.push_back(address);
+            values[0].push_back(a);
+            values[1].push_back(b);
+        }
+    }
+    for (size_t i = 0; i < 32; ++i) {
+        uint16_t address = regs[i / 2] + i % 2;
+        engines[0]->write(address, pattern(address));
+        engines[1]->write(address, pattern(address));
+    }
+
+    if (d) {
+        d->instruction = instruction;
+        for (size_t i = 0; i < 16; ++i) {
+            d->before[i]   = regs[i];
+            d->expected[i] = after[0][i];
+            d->actual[i]   = after[1][i];
+        }
+        d->addresses   = addresses;
+        d->expectedMem = values[0];
+        d->actualMem   = values[1];
+        d->error = error[1] ? error[1] : error[0];
+    }
+    return same;
+}
+
+void Verifier::minimise(Pair& p, uint16_t instruction, uint16_t* regs) {
+    // Try each register as 0 then 1, and each flag cleared, keeping any
+    // change that still shows the problem. Go round until nothing changes.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < 16; ++i) {
+            for (uint16_t value = 0; value < 2; ++value) {
+                if (regs[i] == value) break;
+
+                uint16_t old = regs[i];
+                regs[i] = value;
+                if (check(p, instruction, regs, NULL)) {
+                    regs[i] = old;
+                }
+                else {
+                    changed = true;
+                    break;
+                }
+            }
+        }
+        for (size_t bit = 0; bit < 16; ++bit) {
+            if (!(regs[FLAGS] & 1 << bit)) continue;
+
+            regs[FLAGS] &= ~(1 << bit);
+            if (check(p, instruction, regs, NULL)) {
+                regs[FLAGS] |= 1 << bit;
+            }
+            else {
+                changed = true;
+            }
+        }
+    }
+}
+
+static void printRegisters(std::ostream& out, const char* name, const uint16_t* regs) {
+    out << "    " << std::setfill(' ') << std::setw(9) << std::left << name
+        << std::right << std::setfill('0');
+    for (size_t i = 0; i < 16; ++i) {
+        out << " " << std::setw(4) << regs[i];
+    }
+    out << std::endl;
+}
+
+void Verifier::print(std::ostream& out, const Divergence& d) {
+    const Reference::Entry& e = Reference::entry(d.instruction);
+
+    std::ios::fmtflags fmt = out.flags();
+    char fill = out.fill('0');
+    out << std::hex;
+
+    out << std::setw(4) << d.instruction << " "
+        << (e.name ? e.name : "(undefined)");
+    if (d.error) out << ", threw " << d.error;
+    out << std::endl;
+
+    out.fill(' ');
+    out << "    " << std::setw(9) << "" << std::dec;
+    for (size_t i = 0; i < 16; ++i) out << " r" << std::setw(3) << std::left << i << std::right;
+    out << std::hex << std::endl;
+
+    printRegisters(out, "before", d.before);
+    printRegisters(out, "expected", d.expected);
+    printRegisters(out, "actual", d.actual);
+
+    for (size_t i = 0; i < d.addresses.size(); ++i) {
+        out << "    mem[" << std::setw(4) << d.addresses[i] << "] expected "
+            << std::setw(4) << d.expectedMem[i] << " actual "
+            << std::setw(4) << d.actualMem[i] << std::endl;
+    }
+
+    out.flags(fmt);
+    out.fill(fill);
+}
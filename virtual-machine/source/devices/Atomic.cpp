@@ -0,0 +1,34 @@
+#include "devices/Atomic.hpp"
+#include "IODevice.hpp"
+
+#include <atomic>
+
+#include <cstdlib>
+#include <cstdint>
+
+Atomic::Atomic(): IODevice(LOCKS + COUNTERS, true) {
+    for (size_t i = 0; i < LOCKS; ++i)    locks[i] = 0;
+    for (size_t i = 0; i < COUNTERS; ++i) counters[i] = 0;
+}
+
+void Atomic::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    if (address < LOCKS) {
+        locks[address].store(value, std::memory_order_release);
+    }
+    else {
+        counters[address - LOCKS] = value;
+    }
+}
+
+uint16_t Atomic::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    if (address < LOCKS) {
+        return locks[address].exchange(1, std::memory_order_acquire);
+    }
+    return counters[address - LOCKS].fetch_add(1);
+}
@@ -0,0 +1,207 @@
+#include "devices/BlockDevice.hpp"
+#include "IODevice.hpp"
+#include "MemoryManager.hpp"
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const size_t SECTOR_BYTES = sizeof(uint16_t) * BlockDevice::SECTOR_WORDS;
+
+// If sectors is 0 the disk is as big as the file, which must exist. Otherwise
+// the file is made if need be, and removed again if we can't use it.
+BlockDevice::BlockDevice(const char* filename, size_t sectors, bool async):
+        IODevice(7, true) {
+    if (sectors > 0xffffffff) {
+        throw std::out_of_range("BlockDevice::BlockDevice: Bad disk size");
+    }
+
+    bool created = false;
+    fd = open(filename, O_RDWR);
+    if (fd < 0 && errno == ENOENT && sectors > 0) {
+        fd = open(filename, O_RDWR | O_CREAT | O_EXCL, 0644);
+        created = true;
+    }
+    if (fd < 0) {
+        throw std::runtime_error("BlockDevice::BlockDevice: Could not open file");
+    }
+
+    auto fail = [&](const char* message) {
+        close(fd);
+        if (created) unlink(filename);
+        throw std::runtime_error(message);
+    };
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fail("BlockDevice::BlockDevice: Could not read file size");
+    }
+    if (sectors == 0) {
+        sectors = st.st_size / SECTOR_BYTES;
+        if (sectors == 0 || sectors > 0xffffffff) {
+            close(fd);
+            throw std::out_of_range("BlockDevice::BlockDevice: Bad disk size");
+        }
+    }
+    if ((size_t) st.st_size < sectors * SECTOR_BYTES
+            && ftruncate(fd, sectors * SECTOR_BYTES) < 0) {
+        fail("BlockDevice::BlockDevice: Could not resize file");
+    }
+    this->sectors = sectors;
+
+    void* map = mmap(NULL, sectors * SECTOR_BYTES, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        fail("BlockDevice::BlockDevice: Could not map file");
+    }
+    disk = (uint16_t*) map;
+
+    sector = 0;
+    buffer = 0;
+    failed = false;
+
+    this->async = async;
+    done = false;
+    if (async) {
+        worker = std::thread(&BlockDevice::workLoop, this);
+    }
+}
+
+BlockDevice::~BlockDevice() {
+    if (async) {
+        {
+            std::lock_guard<std::mutex> lk(mt);
+            done = true;
+        }
+        requestCV.notify_all();
+        worker.join();
+    }
+
+    munmap(disk, sectors * SECTOR_BYTES);
+    close(fd);
+}
+
+void BlockDevice::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    std::unique_lock<std::mutex> lk(mt);
+    switch (address) {
+        case 0:
+            sector = (sector & 0xffff0000) | value;
+            break;
+
+        case 1:
+            sector = (sector & 0x0000ffff) | (uint32_t) value << 16;
+            break;
+
+        case 2:
+            buffer = value;
+            break;
+
+        case 3:
+            {
+                Request req;
+                req.command = value;
+                req.sector  = sector;
+                req.buffer  = buffer;
+
+                if (async) {
+                    requests.push_back(req);
+                    lk.unlock();
+                    requestCV.notify_all();
+                }
+                else {
+                    lk.unlock();
+                    bool ok = carryOut(req);
+                    lk.lock();
+                    if (!ok) failed = true;
+                    lk.unlock();
+                    ready();
+                }
+            }
+            break;
+    }
+}
+
+uint16_t BlockDevice::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    std::lock_guard<std::mutex> lk(mt);
+    switch (address) {
+        case 0:  return sector & 0xffff;
+        case 1:  return sector >> 16;
+        case 2:  return buffer;
+        case 4:
+            {
+                // Busy until the queue is empty, and a failure is kept until
+                // the program has seen it
+                if (!requests.empty()) return 1;
+                uint16_t status = failed ? 2 : 0;
+                failed = false;
+                return status;
+            }
+        case 5:  return sectors & 0xffff;
+        case 6:  return sectors >> 16;
+        default: return 0;
+    }
+}
+
+bool BlockDevice::carryOut(Request req) {
+    if (req.command == SYNC) {
+        return msync(disk, sectors * SECTOR_BYTES, MS_SYNC) == 0;
+    }
+
+    if (req.sector >= sectors) return false;
+    uint16_t* data = disk + (size_t) req.sector * SECTOR_WORDS;
+
+    try {
+        switch (req.command) {
+            case READ:
+                getMemory().setRange(req.buffer, data, SECTOR_WORDS);
+                return true;
+
+            case WRITE:
+                getMemory().getRange(req.buffer, data, SECTOR_WORDS);
+                return true;
+        }
+    }
+    catch (std::out_of_range e) {
+        // The buffer runs off the end of memory
+    }
+    return false;
+}
+
+void BlockDevice::workLoop() {
+    std::unique_lock<std::mutex> lk(mt);
+    while (true) {
+        requestCV.wait(lk, [this]{ return done || !requests.empty(); });
+        if (requests.empty()) return;
+
+        Request req = requests.front();
+        lk.unlock();
+
+        // This is where the host actually goes to disk, page faults and all,
+        // while the program keeps running
+        bool ok = carryOut(req);
+
+        lk.lock();
+        requests.pop_front();
+        if (!ok) failed = true;
+        lk.unlock();
+        ready();
+        lk.lock();
+    }
+}
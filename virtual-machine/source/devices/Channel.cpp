@@ -0,0 +1,164 @@
+#include "devices/Channel.hpp"
+#include "IODevice.hpp"
+
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+static size_t roundUp(size_t n) {
+    size_t ret = 1;
+    while (ret < n) ret <<= 1;
+    return ret;
+}
+
+Channel::Ring::Ring(size_t capacity): data(roundUp(capacity)) {
+    mask = data.size() - 1;
+
+    head = 0;
+    tail = 0;
+    tailCache = 0;
+    headCache = 0;
+
+    // Both ends start out as if they had found nothing to do, so the first
+    // word through interrupts
+    blocked = false;
+    waiting = true;
+}
+
+Channel::Channel(size_t capacity):
+        rings{{capacity}, {capacity}},
+        ends{{*this, 0}, {*this, 1}} {
+}
+
+ChannelEnd& Channel::end(int side) {
+    if (side < 0 || side > 1) {
+        throw std::out_of_range("Channel::end");
+    }
+    return ends[side];
+}
+
+// Side 'side' sends on the ring going to the other side
+bool Channel::send(int side, uint16_t value) {
+    Ring& ring = rings[1 - side];
+    size_t head = ring.head.load(std::memory_order_relaxed);
+
+    // Only go to the shared tail when our copy says we are full
+    if (head - ring.tailCache > ring.mask) {
+        ring.tailCache = ring.tail.load(std::memory_order_acquire);
+        if (head - ring.tailCache > ring.mask) {
+            // Say we are blocked, then look again in case space was made in
+            // between
+            ring.blocked = true;
+            ring.tailCache = ring.tail.load(std::memory_order_seq_cst);
+            if (head - ring.tailCache > ring.mask) return false;
+        }
+    }
+
+    ring.data[head & ring.mask] = value;
+    ring.head.store(head + 1, std::memory_order_seq_cst);
+
+    if (ring.waiting.exchange(false)) ends[1 - side].notify();
+    return true;
+}
+
+bool Channel::receive(int side, uint16_t& value) {
+    Ring& ring = rings[side];
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+
+    if (tail == ring.headCache) {
+        ring.headCache = ring.head.load(std::memory_order_acquire);
+        if (tail == ring.headCache) {
+            ring.waiting = true;
+            ring.headCache = ring.head.load(std::memory_order_seq_cst);
+            if (tail == ring.headCache) return false;
+        }
+    }
+
+    value = ring.data[tail & ring.mask];
+    ring.tail.store(tail + 1, std::memory_order_seq_cst);
+
+    if (ring.blocked.exchange(false)) ends[1 - side].notify();
+    return true;
+}
+
+size_t Channel::count(int side) {
+    Ring& ring = rings[side];
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+
+    ring.headCache = ring.head.load(std::memory_order_acquire);
+    if (ring.headCache == tail) {
+        // Say we are waiting, then look again in case it arrived in between
+        ring.waiting = true;
+        ring.headCache = ring.head.load(std::memory_order_seq_cst);
+    }
+    return ring.headCache - tail;
+}
+
+size_t Channel::space(int side) {
+    Ring& ring = rings[1 - side];
+    size_t head = ring.head.load(std::memory_order_relaxed);
+
+    ring.tailCache = ring.tail.load(std::memory_order_acquire);
+    if (head - ring.tailCache > ring.mask) {
+        ring.blocked = true;
+        ring.tailCache = ring.tail.load(std::memory_order_seq_cst);
+    }
+    return ring.data.size() - (head - ring.tailCache);
+}
+
+ChannelEnd::ChannelEnd(Channel& channel, int side):
+        IODevice(4, true), channel(channel) {
+    this->side = side;
+    lost = false;
+}
+
+void ChannelEnd::notify() {
+    ready();
+}
+
+void ChannelEnd::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    if (address == 0 && !channel.send(side, value)) {
+        lost = true;
+    }
+}
+
+uint16_t ChannelEnd::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    switch (address) {
+        case 0:
+            {
+                uint16_t value = 0;
+                channel.receive(side, value);
+                return value;
+            }
+
+        case 1:
+            {
+                uint16_t status = (channel.count(side) > 0 ? 1 : 0)
+                                | (channel.space(side) > 0 ? 2 : 0)
+                                | (lost ? 4 : 0);
+                lost = false;
+                return status;
+            }
+
+        case 2:
+            {
+                size_t n = channel.count(side);
+                return n > 0xffff ? 0xffff : n;
+            }
+
+        default:
+            {
+                size_t n = channel.space(side);
+                return n > 0xffff ? 0xffff : n;
+            }
+    }
+}
@@ -0,0 +1,152 @@
+#include "devices/Console.hpp"
+#include "IODevice.hpp"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include <unistd.h>
+
+// How long the writer waits for more output before writing out what it has
+const std::chrono::milliseconds FLUSH_DELAY(10);
+
+Console::Console(int fd, Mode mode): IODevice(4, true), buffer(CAPACITY) {
+    this->fd   = fd;
+    this->mode = mode;
+
+    head  = 0;
+    count = 0;
+
+    waitingForSpace = false;
+    flushRequested  = false;
+    done            = false;
+
+    writer = std::thread(&Console::writeLoop, this);
+}
+
+Console::~Console() {
+    {
+        std::lock_guard<std::mutex> lk(mt);
+        done = true;
+    }
+    dataCV.notify_all();
+    writer.join();
+}
+
+void Console::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    switch (address) {
+        case 0:
+            if (mode == CHARACTER) {
+                char c = value & 0xff;
+                put(&c, 1);
+            }
+            else {
+                char text[8];
+                int length = snprintf(text, sizeof(text), "%u\n", value);
+                put(text, length);
+            }
+            break;
+
+        case 1:
+            mode = value;
+            break;
+
+        case 3:
+            {
+                std::lock_guard<std::mutex> lk(mt);
+                flushRequested = true;
+            }
+            dataCV.notify_all();
+            break;
+    }
+}
+
+uint16_t Console::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    std::lock_guard<std::mutex> lk(mt);
+    switch (address) {
+        case 1:  return mode;
+        case 2:  return CAPACITY - count;
+        default: return 0;
+    }
+}
+
+void Console::put(const char* text, size_t length) {
+    std::unique_lock<std::mutex> lk(mt);
+
+    for (size_t i = 0; i < length; ++i) {
+        while (count == CAPACITY) {
+            // The program ignored SPACE, all we can do is wait
+            waitingForSpace = true;
+            dataCV.notify_all();
+            spaceCV.wait(lk);
+        }
+        buffer[(head + count) % CAPACITY] = text[i];
+        ++count;
+    }
+
+    if (count >= CAPACITY / 2) {
+        dataCV.notify_all();
+    }
+
+    if (count == CAPACITY) {
+        // The writer will interrupt once there is room again
+        waitingForSpace = true;
+        return;
+    }
+
+    lk.unlock();
+    ready();
+}
+
+void Console::writeLoop() {
+    std::string chunk;
+    chunk.reserve(CAPACITY);
+
+    std::unique_lock<std::mutex> lk(mt);
+    while (true) {
+        dataCV.wait(lk, [this]{ return done || count > 0; });
+        if (count == 0) break;
+
+        // Give the program a moment to put more in so we write in batches
+        dataCV.wait_for(lk, FLUSH_DELAY, [this]{
+            return done || flushRequested || waitingForSpace || count >= CAPACITY / 2;
+        });
+
+        chunk.clear();
+        for (size_t i = 0; i < count; ++i) {
+            chunk.push_back(buffer[(head + i) % CAPACITY]);
+        }
+        head  = (head + count) % CAPACITY;
+        count = 0;
+        flushRequested = false;
+
+        bool wasFull = waitingForSpace;
+        waitingForSpace = false;
+
+        lk.unlock();
+        spaceCV.notify_all();
+
+        size_t written = 0;
+        while (written < chunk.size()) {
+            ssize_t res = ::write(fd, chunk.data() + written, chunk.size() - written);
+            if (res < 0) break;
+            written += res;
+        }
+
+        if (wasFull) ready();
+        lk.lock();
+    }
+}
@@ -0,0 +1,83 @@
+#include "devices/DMA.hpp"
+#include "IODevice.hpp"
+#include "MemoryManager.hpp"
+
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+DMA::DMA(): IODevice(5, true, true) {
+    src    = 0;
+    dest   = 0;
+    length = 0;
+    mode   = COPY;
+    status = 0;
+}
+
+void DMA::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    switch (address) {
+        case 0: src    = value; break;
+        case 1: dest   = value; break;
+        case 2: length = value; break;
+        case 3: mode   = value; break;
+
+        case 4:
+            try {
+                transfer();
+                status = 0;
+            }
+            catch (std::out_of_range e) {
+                status = 1;
+            }
+            ready();
+            break;
+    }
+}
+
+uint16_t DMA::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    switch (address) {
+        case 0:  return src;
+        case 1:  return dest;
+        case 2:  return length;
+        case 3:  return mode;
+        default: return status;
+    }
+}
+
+void DMA::transfer() {
+    MemoryManager& mem = getMemory();
+
+    switch (mode) {
+        case COPY:
+            mem.moveRange(dest, src, length);
+            break;
+
+        case FILL:
+            mem.fillRange(dest, src, length);
+            break;
+
+        case DEVICE_TO_MEMORY:
+            for (size_t i = 0; i < length; ++i) {
+                mem[dest + i] = mem.read(src);
+            }
+            break;
+
+        case MEMORY_TO_DEVICE:
+            for (size_t i = 0; i < length; ++i) {
+                uint16_t value = mem.read(src + i);
+                mem[dest] = value;
+                mem.writeIfDevice(dest, value);
+            }
+            break;
+
+        default:
+            throw std::out_of_range("DMA::transfer");
+    }
+}
@@ -0,0 +1,253 @@
+#include "devices/Hypercall.hpp"
+#include "IODevice.hpp"
+#include "MemoryManager.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+const uint16_t STATUS_OK      = 0;
+const uint16_t STATUS_RANGE   = 1;
+const uint16_t STATUS_INVALID = 2;
+
+const size_t MAX_ARGS = 6;
+
+// Divides the number in place by a single word, returning the remainder
+static uint16_t divSmall(std::vector<uint16_t>& num, uint16_t divisor) {
+    uint32_t rem = 0;
+    for (size_t i = num.size(); i-- > 0;) {
+        uint32_t cur = (rem << 16) | num[i];
+        num[i] = cur / divisor;
+        rem    = cur % divisor;
+    }
+    return rem;
+}
+
+static bool isZero(const std::vector<uint16_t>& num) {
+    for (uint16_t w : num) {
+        if (w) return false;
+    }
+    return true;
+}
+
+Hypercall::Hypercall(): IODevice(2, true, true) {
+    args   = 0;
+    status = STATUS_OK;
+}
+
+void Hypercall::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    if (address == 0) {
+        args = value;
+        return;
+    }
+
+    try {
+        call(value);
+        status = STATUS_OK;
+    }
+    catch (std::out_of_range e) {
+        status = STATUS_RANGE;
+    }
+    catch (std::invalid_argument e) {
+        status = STATUS_INVALID;
+    }
+}
+
+uint16_t Hypercall::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    return address == 0 ? args : status;
+}
+
+void Hypercall::call(uint16_t function) {
+    MemoryManager& mem = getMemory();
+
+    // Every function has at most MAX_ARGS arguments, but the block might sit
+    // right at the end of memory so only read the ones we need
+    static const size_t argCount[] = {3, 3, 3, 2, 4, 5, 6};
+    if (function > FORMAT) {
+        throw std::invalid_argument("Hypercall::call");
+    }
+
+    uint16_t block[MAX_ARGS];
+    mem.getRange(args, block, argCount[function]);
+
+    switch (function) {
+        case MEMCPY:
+            mem.moveRange(block[0], block[1], block[2]);
+            break;
+
+        case MEMSET:
+            mem.fillRange(block[0], block[1], block[2]);
+            break;
+
+        case STRCMP:
+            {
+                size_t i = 0;
+                uint16_t x, y;
+                do {
+                    x = mem.read(block[0] + i);
+                    y = mem.read(block[1] + i);
+                    ++i;
+                }
+                while (x == y && x != 0);
+
+                uint16_t result = x == y ? 0 : (x > y ? 1 : 0xffff);
+                mem[args + 2] = result;
+            }
+            break;
+
+        case STRLEN:
+            {
+                size_t i = 0;
+                while (mem.read(block[0] + i) != 0) ++i;
+                mem[args + 1] = i;
+            }
+            break;
+
+        case MUL:
+            mul(block);
+            break;
+
+        case DIV:
+            div(block);
+            break;
+
+        case FORMAT:
+            format(block);
+            break;
+    }
+}
+
+void Hypercall::mul(uint16_t* block) {
+    MemoryManager& mem = getMemory();
+    size_t n = block[3];
+
+    a.resize(n);
+    b.resize(n);
+    out.assign(2 * n, 0);
+    mem.getRange(block[0], a.data(), n);
+    mem.getRange(block[1], b.data(), n);
+
+    // Schoolbook, a word at a time
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t carry = 0;
+        for (size_t j = 0; j < n; ++j) {
+            uint32_t cur = (uint32_t) a[i] * b[j] + out[i + j] + carry;
+            out[i + j] = cur;
+            carry = cur >> 16;
+        }
+        out[i + n] = carry;
+    }
+
+    mem.setRange(block[2], out.data(), 2 * n);
+}
+
+void Hypercall::div(uint16_t* block) {
+    MemoryManager& mem = getMemory();
+    size_t n = block[4];
+
+    a.resize(n);
+    b.resize(n);
+    mem.getRange(block[0], a.data(), n);
+    mem.getRange(block[1], b.data(), n);
+
+    if (isZero(b)) {
+        throw std::invalid_argument("Hypercall::div");
+    }
+
+    // Find how many words of the divisor are actually used
+    size_t used = n;
+    while (b[used - 1] == 0) --used;
+
+    if (used == 1) {
+        rem.assign(n, 0);
+        rem[0] = divSmall(a, b[0]);
+    }
+    else {
+        // Shift and subtract, a bit at a time
+        rem.assign(n, 0);
+        for (size_t bit = n * 16; bit-- > 0;) {
+            // rem = rem << 1 | next bit of a
+            uint16_t carry = (a[bit / 16] >> (bit % 16)) & 1;
+            for (size_t i = 0; i < n; ++i) {
+                uint16_t top = rem[i] >> 15;
+                rem[i] = (rem[i] << 1) | carry;
+                carry = top;
+            }
+            a[bit / 16] &= ~(1 << (bit % 16));
+
+            // A carry out means rem is already bigger than b
+            bool bigger = carry;
+            if (!bigger) {
+                bigger = true;
+                for (size_t i = n; i-- > 0;) {
+                    if (rem[i] != b[i]) {
+                        bigger = rem[i] > b[i];
+                        break;
+                    }
+                }
+            }
+
+            if (bigger) {
+                uint32_t borrow = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    uint32_t cur = (uint32_t) rem[i] - b[i] - borrow;
+                    rem[i] = cur;
+                    borrow = (cur >> 16) & 1;
+                }
+                a[bit / 16] |= 1 << (bit % 16);
+            }
+        }
+    }
+
+    mem.setRange(block[2], a.data(), n);
+    mem.setRange(block[3], rem.data(), n);
+}
+
+void Hypercall::format(uint16_t* block) {
+    MemoryManager& mem = getMemory();
+    size_t   n    = block[1];
+    uint16_t base = block[2];
+
+    if (base < 2 || base > 36 || n == 0) {
+        throw std::invalid_argument("Hypercall::format");
+    }
+
+    a.resize(n);
+    mem.getRange(block[0], a.data(), n);
+
+    // Two's complement, flip it round and remember the sign
+    bool negative = block[3] && (a[n - 1] & 0x8000);
+    if (negative) {
+        uint32_t carry = 1;
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t cur = (uint16_t) ~a[i] + carry;
+            a[i]  = cur;
+            carry = cur >> 16;
+        }
+    }
+
+    // Digits come out least significant first
+    out.clear();
+    do {
+        uint16_t digit = divSmall(a, base);
+        out.push_back(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    }
+    while (!isZero(a));
+
+    if (negative) out.push_back('-');
+    std::reverse(out.begin(), out.end());
+
+    size_t length = out.size();
+    out.push_back(0);
+    mem.setRange(block[4], out.data(), out.size());
+    mem[args + 5] = length;
+}
@@ -0,0 +1,121 @@
+#include "devices/Input.hpp"
+#include "IODevice.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+
+// How much we ask the host for at once
+const size_t CHUNK_SIZE = 0x4000;
+
+Input::Input(int fd): IODevice(3, true), buffer(CAPACITY) {
+    this->fd = fd;
+
+    head  = 0;
+    count = 0;
+    ended = false;
+    done  = false;
+
+    // The reader spends most of its time blocked in poll, this is how we get
+    // it out again when we are done
+    if (pipe(wakePipe) != 0) {
+        throw std::runtime_error("Input::Input: Could not create pipe");
+    }
+
+    reader = std::thread(&Input::readLoop, this);
+}
+
+Input::~Input() {
+    {
+        std::lock_guard<std::mutex> lk(mt);
+        done = true;
+    }
+    spaceCV.notify_all();
+    char c = 0;
+    ::write(wakePipe[1], &c, 1);
+
+    reader.join();
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+}
+
+uint16_t Input::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    std::lock_guard<std::mutex> lk(mt);
+    switch (address) {
+        case 0:
+            {
+                if (count == 0) return 0;
+
+                uint8_t ret = buffer[head];
+                head = (head + 1) % CAPACITY;
+                --count;
+                if (count == CAPACITY - CHUNK_SIZE) spaceCV.notify_all();
+                return ret;
+            }
+
+        case 1:
+            return (count > 0 ? 1 : 0) | (ended && count == 0 ? 2 : 0);
+
+        default:
+            return count > 0xffff ? 0xffff : count;
+    }
+}
+
+void Input::readLoop() {
+    std::vector<uint8_t> chunk(CHUNK_SIZE);
+
+    while (true) {
+        // Wait for room for a whole chunk, so we always ask for a lot
+        {
+            std::unique_lock<std::mutex> lk(mt);
+            spaceCV.wait(lk, [this]{ return done || count <= CAPACITY - CHUNK_SIZE; });
+            if (done) return;
+        }
+
+        pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = wakePipe[0];
+        fds[1].events = POLLIN;
+
+        if (poll(fds, 2, -1) < 0) continue;
+        if (fds[1].revents) return;
+
+        ssize_t res = ::read(fd, chunk.data(), CHUNK_SIZE);
+        if (res < 0 && errno == EINTR) continue;
+
+        bool wasEmpty;
+        {
+            std::lock_guard<std::mutex> lk(mt);
+            wasEmpty = count == 0;
+
+            if (res <= 0) {
+                ended = true;
+            }
+            else {
+                for (ssize_t i = 0; i < res; ++i) {
+                    buffer[(head + count) % CAPACITY] = chunk[i];
+                    ++count;
+                }
+            }
+        }
+
+        if (res <= 0) {
+            ready();
+            return;
+        }
+        if (wasEmpty) ready();
+    }
+}
@@ -0,0 +1,79 @@
+#include "devices/InterruptController.hpp"
+#include "IODevice.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+const size_t VECTOR   = 0;
+const size_t PRIORITY = VECTOR   + InterruptController::LINES;
+const size_t MASK     = PRIORITY + InterruptController::LINES;
+const size_t ACTIVE   = MASK + 1;
+
+InterruptController::InterruptController(): IODevice(ACTIVE + 1, true, true) {
+    for (int i = 0; i < LINES; ++i) {
+        vector[i]   = 0;
+        priority[i] = 0;
+    }
+    mask    = 0;
+    active  = 0;
+    pending = 0;
+}
+
+void InterruptController::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    if (address < PRIORITY) {
+        vector[address - VECTOR] = value;
+    }
+    else if (address < MASK) {
+        priority[address - PRIORITY] = value;
+    }
+    else if (address == MASK) {
+        mask = value;
+    }
+}
+
+uint16_t InterruptController::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    if (address < PRIORITY) return vector[address - VECTOR];
+    if (address < MASK)     return priority[address - PRIORITY];
+    if (address == MASK)    return mask;
+    return active;
+}
+
+void InterruptController::raise(int line) {
+    pending |= 1 << line;
+}
+
+int InterruptController::select(uint16_t flags) {
+    int best = -1;
+    for (int i = 0; i < LINES; ++i) {
+        if (!(pending & (1 << i)) || (mask & (1 << i))) continue;
+
+        // The program cleared fISF itself, so it has dealt with the line
+        if (!(flags & flagBit(i))) {
+            pending &= ~(1 << i);
+            continue;
+        }
+        if (best < 0 || priority[i] > priority[best]) best = i;
+    }
+    return best;
+}
+
+bool InterruptController::waiting(uint16_t flags) {
+    return select(flags) >= 0;
+}
+
+uint16_t InterruptController::take(int line) {
+    active   = line;
+    pending &= ~(1 << line);
+    return vector[line];
+}
+
+uint16_t InterruptController::flagBit(int line) {
+    // The software line sits just below the hardware lines in rFLAGS
+    return line < 8 ? 1 << (8 + line) : 1 << 7;
+}
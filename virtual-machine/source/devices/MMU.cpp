@@ -0,0 +1,86 @@
+#include "devices/MMU.hpp"
+#include "IODevice.hpp"
+#include "MemoryManager.hpp"
+
+#include <set>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+#include <sys/mman.h>
+
+MMU::MMU(size_t frames): IODevice(4, true, true) {
+    if (frames == 0 || frames > 0x10000) {
+        throw std::out_of_range("MMU::MMU");
+    }
+    this->frames = frames;
+
+    // Anonymous memory is zeroed and only backed once it is touched, so a big
+    // store costs nothing untill it is used
+    size_t bytes = sizeof(uint16_t) * MemoryManager::PAGE_WORDS * frames;
+    void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("MMU::MMU: Could not allocate store");
+    }
+    store = (uint16_t*) map;
+
+    page   = 0;
+    frame  = 0;
+    status = 0;
+}
+
+MMU::~MMU() {
+    for (uint16_t p : mapped) {
+        getMemory().unmapPage(p);
+    }
+    munmap(store, sizeof(uint16_t) * MemoryManager::PAGE_WORDS * frames);
+}
+
+void MMU::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    switch (address) {
+        case 0:
+            page = value;
+            break;
+
+        case 1:
+            frame = value;
+            break;
+
+        case 2:
+            try {
+                if (value == 0) {
+                    getMemory().unmapPage(page);
+                    mapped.erase(page);
+                }
+                else if (frame < frames) {
+                    getMemory().mapPage(page, store + frame * MemoryManager::PAGE_WORDS);
+                    mapped.insert(page);
+                }
+                else {
+                    throw std::out_of_range("MMU::write");
+                }
+                status = 0;
+            }
+            catch (std::out_of_range e) {
+                status = 1;
+            }
+            break;
+    }
+}
+
+uint16_t MMU::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    switch (address) {
+        case 0:  return page;
+        case 1:  return frame;
+        case 2:  return status;
+        default: return frames - 1;
+    }
+}
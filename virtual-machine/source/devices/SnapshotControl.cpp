@@ -0,0 +1,25 @@
+#include "devices/SnapshotControl.hpp"
+#include "IODevice.hpp"
+#include "Processor.hpp"
+#include "Snapshot.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+SnapshotControl::SnapshotControl(const char* filename, bool stopAfter):
+        IODevice(1, true, true), filename(filename) {
+    this->stopAfter = stopAfter;
+}
+
+void SnapshotControl::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    // This is a synchronous device, so we are in between instructions and
+    // the machine is in a consistent state
+    Snapshot::save(getProcessor(), filename.c_str());
+
+    if (stopAfter) {
+        getProcessor().stop();
+    }
+}
@@ -0,0 +1,79 @@
+#include "devices/Timer.hpp"
+#include "IODevice.hpp"
+#include "Processor.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+const uint16_t CONTROL_RUN      = 1 << 0;
+const uint16_t CONTROL_PERIODIC = 1 << 1;
+
+Timer::Timer(): IODevice(4, true, true) {
+    reload   = 0;
+    prescale = 0;
+    control  = 0;
+
+    running = false;
+    started = 0;
+}
+
+void Timer::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    switch (address) {
+        case 0:
+            reload = value;
+            break;
+
+        case 1:
+            prescale = value;
+            break;
+
+        case 2:
+            control = value;
+
+            cancel();
+            running = false;
+            if ((control & CONTROL_RUN) && period() > 0) {
+                running = true;
+                started = getProcessor().getClock();
+                schedule(period());
+            }
+            break;
+    }
+}
+
+uint16_t Timer::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+
+    switch (address) {
+        case 0:  return reload;
+        case 1:  return prescale;
+        case 2:  return control;
+        default:
+            {
+                if (!running) return 0;
+                uint64_t elapsed = getProcessor().getClock() - started;
+                return reload - elapsed / (prescale + 1);
+            }
+    }
+}
+
+void Timer::expire() {
+    if (control & CONTROL_PERIODIC) {
+        started += period();
+        schedule(started + period() - getProcessor().getClock());
+    }
+    else {
+        running = false;
+        control &= ~CONTROL_RUN;
+    }
+
+    ready();
+}
+
+uint64_t Timer::period() {
+    return (uint64_t) reload * (prescale + 1);
+}
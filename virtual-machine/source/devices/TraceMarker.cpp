@@ -0,0 +1,24 @@
+#include "devices/TraceMarker.hpp"
+#include "IODevice.hpp"
+#include "Trace.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+
+TraceMarker::TraceMarker(): IODevice(2, true) {
+    // Do nothing
+}
+
+void TraceMarker::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    if (!Trace::enabled) return;
+
+    if (address == BEGIN) {
+        Trace::begin("span", value);
+    }
+    else {
+        Trace::end("span", value);
+    }
+}
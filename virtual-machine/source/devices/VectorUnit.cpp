@@ -0,0 +1,187 @@
+#include "devices/VectorUnit.hpp"
+#include "IODevice.hpp"
+#include "MemoryManager.hpp"
+
+#include <vector>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const size_t OP      = 0;
+const size_t SRC_A   = 1;
+const size_t SRC_B   = 2;
+const size_t DEST    = 3;
+const size_t LENGTH  = 4;
+const size_t CONTROL = 5;
+const size_t RESULT  = 6;
+const size_t AUX     = 7;
+
+// Element wise operations. Each one does as much as it can 8 words at a time
+// and finishes off the rest one at a time.
+
+#ifdef __SSE2__
+#define ELEMENTWISE(name, vecOp, scalarOp)                                      \
+static void name(const uint16_t* a, const uint16_t* b, uint16_t* out, size_t n) { \
+    size_t i = 0;                                                               \
+    for (; i + 8 <= n; i += 8) {                                                \
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));                  \
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));                  \
+        _mm_storeu_si128((__m128i*) (out + i), vecOp(x, y));                    \
+    }                                                                           \
+    for (; i < n; ++i) {                                                        \
+        uint32_t x = a[i];                                                      \
+        uint32_t y = b[i];                                                      \
+        out[i] = scalarOp;                                                      \
+    }                                                                           \
+}
+#else
+#define ELEMENTWISE(name, vecOp, scalarOp)                                      \
+static void name(const uint16_t* a, const uint16_t* b, uint16_t* out, size_t n) { \
+    for (size_t i = 0; i < n; ++i) {                                            \
+        uint32_t x = a[i];                                                      \
+        uint32_t y = b[i];                                                      \
+        out[i] = scalarOp;                                                      \
+    }                                                                           \
+}
+#endif
+
+ELEMENTWISE(vecAdd,   _mm_add_epi16,    x + y)
+ELEMENTWISE(vecSub,   _mm_sub_epi16,    x - y)
+ELEMENTWISE(vecAdds,  _mm_adds_epu16,   x + y > 0xffff ? 0xffff : x + y)
+ELEMENTWISE(vecSubs,  _mm_subs_epu16,   x > y ? x - y : 0)
+ELEMENTWISE(vecMul,   _mm_mullo_epi16,  x * y)
+ELEMENTWISE(vecMulHi, _mm_mulhi_epu16,  (x * y) >> 16)
+ELEMENTWISE(vecAnd,   _mm_and_si128,    x & y)
+ELEMENTWISE(vecOr,    _mm_or_si128,     x | y)
+ELEMENTWISE(vecXor,   _mm_xor_si128,    x ^ y)
+
+static uint32_t vecSum(const uint16_t* a, size_t n) {
+    uint32_t sum = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    // Widen to 32 bits before adding so nothing is lost
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc  = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(x, zero));
+        acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(x, zero));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*) lanes, acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; ++i) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+static uint64_t vecDot(const uint16_t* a, const uint16_t* b, size_t n) {
+    uint64_t sum = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    // Put the low and high words of each product back together into 32 bit
+    // lanes, then widen those to 64 bits before adding, as two products are
+    // already enough to overflow 32
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc  = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i x  = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i y  = _mm_loadu_si128((const __m128i*) (b + i));
+        __m128i lo = _mm_mullo_epi16(x, y);
+        __m128i hi = _mm_mulhi_epu16(x, y);
+        __m128i p0 = _mm_unpacklo_epi16(lo, hi);
+        __m128i p1 = _mm_unpackhi_epi16(lo, hi);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p0, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p0, zero));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p1, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p1, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*) lanes, acc);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < n; ++i) {
+        sum += (uint32_t) a[i] * b[i];
+    }
+    return sum;
+}
+
+VectorUnit::VectorUnit(): IODevice(8, true, true) {
+    for (int i = 0; i < 8; ++i) regs[i] = 0;
+}
+
+void VectorUnit::write(size_t address, uint16_t value) {
+    // Bound check with super
+    IODevice::write(address, value);
+
+    if (address == CONTROL) {
+        try {
+            regs[CONTROL] = execute() ? 0 : 2;
+        }
+        catch (std::out_of_range e) {
+            regs[CONTROL] = 1;
+        }
+        ready();
+    }
+    else if (address != RESULT && address != AUX) {
+        regs[address] = value;
+    }
+}
+
+uint16_t VectorUnit::read(size_t address) {
+    // Bound check with super
+    IODevice::read(address);
+    return regs[address];
+}
+
+bool VectorUnit::execute() {
+    MemoryManager& mem = getMemory();
+    size_t n = regs[LENGTH];
+
+    // Memory pages need not be next to each other on the host, so work on
+    // copies. Copying is cheap next to doing the work in guest code.
+    a.resize(n);
+    mem.getRange(regs[SRC_A], a.data(), n);
+
+    if (regs[OP] == SUM) {
+        uint32_t sum = vecSum(a.data(), n);
+        regs[RESULT] = sum & 0xffff;
+        regs[AUX]    = sum >> 16;
+        return true;
+    }
+
+    b.resize(n);
+    mem.getRange(regs[SRC_B], b.data(), n);
+
+    if (regs[OP] == DOT) {
+        uint64_t sum = vecDot(a.data(), b.data(), n);
+        regs[RESULT] = sum & 0xffff;
+        regs[AUX]    = (sum >> 16) & 0xffff;
+        return sum <= UINT32_MAX;
+    }
+
+    out.resize(n);
+    switch (regs[OP]) {
+        case ADD:   vecAdd  (a.data(), b.data(), out.data(), n); break;
+        case SUB:   vecSub  (a.data(), b.data(), out.data(), n); break;
+        case ADDS:  vecAdds (a.data(), b.data(), out.data(), n); break;
+        case SUBS:  vecSubs (a.data(), b.data(), out.data(), n); break;
+        case MUL:   vecMul  (a.data(), b.data(), out.data(), n); break;
+        case MULHI: vecMulHi(a.data(), b.data(), out.data(), n); break;
+        case AND:   vecAnd  (a.data(), b.data(), out.data(), n); break;
+        case OR:    vecOr   (a.data(), b.data(), out.data(), n); break;
+        case XOR:   vecXor  (a.data(), b.data(), out.data(), n); break;
+        default:
+            throw std::out_of_range("VectorUnit::execute");
+    }
+
+    mem.setRange(regs[DEST], out.data(), n);
+    return true;
+}
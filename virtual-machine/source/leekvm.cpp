@@ -0,0 +1,230 @@
+#include "leekvm.h"
+#include "Processor.hpp"
+#include "MemoryManager.hpp"
+#include "RegisterManager.hpp"
+#include "IODevice.hpp"
+#include "CodeImage.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm> // copy
+#include <exception>
+
+#include <cstdlib>
+#include <cstdint>
+
+// A device that hands everything to the host's callbacks
+class CallbackDevice: public IODevice {
+    public:
+        CallbackDevice(uint16_t words, leek_read_fn readFn, leek_write_fn writeFn, void* user):
+                IODevice(words, true) {
+            this->readFn  = readFn;
+            this->writeFn = writeFn;
+            this->user    = user;
+        }
+
+        void write(size_t address, uint16_t value) {
+            // Bound check with super
+            IODevice::write(address, value);
+            if (writeFn) writeFn(user, address, value);
+        }
+
+        uint16_t read(size_t address) {
+            // Bound check with super
+            IODevice::read(address);
+            return readFn ? readFn(user, address) : 0;
+        }
+
+    private:
+        leek_read_fn  readFn;
+        leek_write_fn writeFn;
+        void* user;
+};
+
+struct leek_vm {
+    leek_vm(size_t words): memory(words), cpu(memory) {
+        cpu.setParkOnWait(true);
+
+        // Runs should be repeatable, so start from a clean machine. Memory
+        // already starts out zeroed.
+        for (size_t i = 0; i < 16; ++i) cpu.set(i, 0);
+    }
+
+    ~leek_vm() {
+        for (IODevice* dev : devices) {
+            cpu.removeDevice(*dev);
+            delete dev;
+        }
+    }
+
+    MemoryManager memory;
+    Processor cpu;
+    std::vector<IODevice*> devices;
+    std::string error;
+};
+
+struct leek_image {
+    std::shared_ptr<CodeImage> image;
+};
+
+// Exceptions can't go back through C, so remember what they said
+static int fail(leek_vm* vm, std::exception& e) {
+    vm->error = e.what();
+    return LEEK_ERROR;
+}
+
+// There is no machine to keep it in when creating one fails
+static thread_local std::string createError;
+
+int leek_version(void) {
+    return LEEK_API_VERSION;
+}
+
+leek_vm* leek_create(size_t words) {
+    try {
+        return new leek_vm(words);
+    }
+    catch (std::exception& e) {
+        createError = e.what();
+        return NULL;
+    }
+}
+
+void leek_destroy(leek_vm* vm) {
+    delete vm;
+}
+
+const char* leek_error(leek_vm* vm) {
+    if (!vm) return createError.c_str();
+    return vm->error.c_str();
+}
+
+int leek_load(leek_vm* vm, const uint16_t* image, size_t length) {
+    try {
+        vm->memory.setRange(1, const_cast<uint16_t*>(image), length);
+        vm->cpu.set(RegisterManager::FLAGS, 0);
+        vm->cpu.set(RegisterManager::STACK, length);
+        vm->cpu.set(RegisterManager::PC,    1);
+    }
+    catch (std::exception& e) {
+        return fail(vm, e);
+    }
+    return LEEK_OK;
+}
+
+leek_image* leek_image_create(const uint16_t* image, size_t length) {
+    try {
+        // Programs start at address 1, so the image does too
+        std::vector<uint16_t> words(length + 1, 0);
+        std::copy(image, image + length, words.begin() + 1);
+
+        leek_image* ret = new leek_image;
+        ret->image = std::make_shared<CodeImage>(words.data(), words.size());
+        return ret;
+    }
+    catch (std::exception& e) {
+        createError = e.what();
+        return NULL;
+    }
+}
+
+void leek_image_release(leek_image* image) {
+    delete image;
+}
+
+int leek_load_shared(leek_vm* vm, leek_image* image, int onStore) {
+    try {
+        vm->memory.mapCode(0, image->image, onStore != LEEK_SHARED_FAULT);
+        vm->cpu.set(RegisterManager::FLAGS, 0);
+        // Past the image, the rest of its last page is shared too
+        vm->cpu.set(RegisterManager::STACK,
+                image->image->pages() * MemoryManager::PAGE_WORDS - 1);
+        vm->cpu.set(RegisterManager::PC,    1);
+    }
+    catch (std::exception& e) {
+        return fail(vm, e);
+    }
+    return LEEK_OK;
+}
+
+int leek_map_device(leek_vm* vm, size_t position, uint16_t words, uint8_t line,
+        leek_read_fn read, leek_write_fn write, void* user) {
+    IODevice* dev = new CallbackDevice(words, read, write, user);
+    try {
+        vm->cpu.useDevice(*dev, position, line);
+    }
+    catch (std::exception& e) {
+        delete dev;
+        return fail(vm, e);
+    }
+    vm->devices.push_back(dev);
+    return LEEK_OK;
+}
+
+int leek_interrupt(leek_vm* vm, int line) {
+    try {
+        vm->cpu.interrupt(line);
+    }
+    catch (std::exception& e) {
+        return fail(vm, e);
+    }
+    return LEEK_OK;
+}
+
+int leek_run(leek_vm* vm, uint64_t budget, uint64_t* executed) {
+    uint64_t start = vm->cpu.getClock();
+    Processor::RunResult res = Processor::PREEMPTED;
+
+    try {
+        res = vm->cpu.runFor(budget);
+    }
+    catch (std::exception& e) {
+        return fail(vm, e);
+    }
+    if (executed) *executed = vm->cpu.getClock() - start;
+
+    switch (res) {
+        case Processor::HALTED:  return LEEK_HALTED;
+        case Processor::WAITING: return LEEK_WAITING;
+        default:                 return LEEK_BUDGET;
+    }
+}
+
+int leek_get_register(leek_vm* vm, int index, uint16_t* out) {
+    if (index < 0 || index >= 16) {
+        vm->error = "leek_get_register: No such register";
+        return LEEK_ERROR;
+    }
+    *out = vm->cpu.inspect(index);
+    return LEEK_OK;
+}
+
+int leek_set_register(leek_vm* vm, int index, uint16_t value) {
+    if (index < 0 || index >= 16) {
+        vm->error = "leek_set_register: No such register";
+        return LEEK_ERROR;
+    }
+    vm->cpu.set(index, value);
+    return LEEK_OK;
+}
+
+int leek_read_memory(leek_vm* vm, size_t address, uint16_t* out, size_t length) {
+    try {
+        vm->memory.getRange(address, out, length);
+    }
+    catch (std::exception& e) {
+        return fail(vm, e);
+    }
+    return LEEK_OK;
+}
+
+int leek_write_memory(leek_vm* vm, size_t address, const uint16_t* values, size_t length) {
+    try {
+        vm->memory.setRange(address, const_cast<uint16_t*>(values), length);
+    }
+    catch (std::exception& e) {
+        return fail(vm, e);
+    }
+    return LEEK_OK;
+}
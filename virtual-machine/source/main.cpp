@@ -1,12 +1,37 @@
 #include "Processor.hpp"
+#include "MemoryManager.hpp"
 #include "IODevice.hpp"
+#include "Checkpoint.hpp"
+#include "Snapshot.hpp"
+#include "Scheduler.hpp"
+#include "Stats.hpp"
+#include "Trace.hpp"
+#include "Heatmap.hpp"
+#include "InstructionTrace.hpp"
+#include "Engine.hpp"
+#include "Reference.hpp"
+#include "Lockstep.hpp"
 #include "devices/NumberDisplay.hpp"
+#include "devices/Console.hpp"
+#include "devices/Input.hpp"
+#include "devices/BlockDevice.hpp"
+#include "devices/MMU.hpp"
+#include "devices/DMA.hpp"
+#include "devices/VectorUnit.hpp"
+#include "devices/Timer.hpp"
+#include "devices/InterruptController.hpp"
+#include "devices/Hypercall.hpp"
+#include "devices/Atomic.hpp"
+#include "devices/SnapshotControl.hpp"
+#include "devices/TraceMarker.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <set>
+#include <vector>
+#include <thread>
 #include <tuple>
 #include <limits>
 #include <stdexcept>
@@ -15,32 +40,154 @@
 #include <cstring>
 #include <cassert>
 #include <cstdio>
+#include <csignal>
 
 #include <unistd.h>
 
 const std::streamsize maxStreamSize = std::numeric_limits<std::streamsize>::max();
 
+// Lines can be written core:line to send the interrupts to a core other than
+// the first
+void parseLine(const char* arg, size_t& core, uint8_t& line) {
+    const char* colon = strchr(arg, ':');
+    if (colon) {
+        core = strtoul(arg, NULL, 10);
+        line = atoi(colon + 1);
+    }
+    else {
+        core = 0;
+        line = atoi(arg);
+    }
+}
+
 int main(int argc, char** argv) {
-    std::set<std::tuple<IODevice*, size_t, uint8_t>> devices;
+    std::set<std::tuple<IODevice*, size_t, uint8_t, size_t>> devices;
+    InterruptController* controller = 0;
     bool standardDevices = false;
 
+    size_t coreCount = 1;
+    size_t workerCount = 0;
+
     bool interactive = false;
     bool hexMode     = false;
     char* filename = 0;
 
+    char* checkpointName = 0;
+    uint64_t checkpointInterval = 0;
+
+    char* bootName = 0;
+
+    char* statsName = 0;
+    char* traceName = 0;
+    char* itraceName = 0;
+
+    std::string heatmapPrefix;
+    uint64_t heatmapWindow = 0;
+
+    uint64_t lockstepInterval = 0;
+
     // Process args
     for (int i = 1; i < argc; ++i) {
         if (argv[i][0] == '-') {
             // Process flag
             switch (argv[i][1]) {
+                case 'b':
+                    // Boot from a snapshot
+                    bootName = argv[i+1];
+                    // Eat 1 word
+                    i += 1;
+                    break;
+
+                case 'c':
+                    // Checkpoint to file every so many instructions
+                    checkpointName = argv[i+1];
+                    checkpointInterval = strtoull(argv[i+2], NULL, 10);
+                    if (checkpointInterval == 0) {
+                        std::cerr << "Checkpoint interval must be positive" << std::endl;
+                        return 1;
+                    }
+                    // Eat 2 words
+                    i += 2;
+                    break;
+
                 case 'd':
                     // Add a device
-                    if (!strcmp(argv[i+1], "numdisp")) {
-                        IODevice* dev = new NumberDisplay();
+                    {
+                        IODevice* dev = 0;
+                        if (!strcmp(argv[i+1], "numdisp")) {
+                            dev = new NumberDisplay();
+                        }
+                        else if (!strcmp(argv[i+1], "console")) {
+                            dev = new Console();
+                        }
+                        else if (!strcmp(argv[i+1], "input")) {
+                            dev = new Input();
+                        }
+                        else if (!strcmp(argv[i+1], "mmu")) {
+                            dev = new MMU();
+                        }
+                        else if (!strcmp(argv[i+1], "dma")) {
+                            dev = new DMA();
+                        }
+                        else if (!strcmp(argv[i+1], "vector")) {
+                            dev = new VectorUnit();
+                        }
+                        else if (!strcmp(argv[i+1], "timer")) {
+                            dev = new Timer();
+                        }
+                        else if (!strcmp(argv[i+1], "hypercall")) {
+                            dev = new Hypercall();
+                        }
+                        else if (!strcmp(argv[i+1], "atomic")) {
+                            dev = new Atomic();
+                        }
+                        else if (!strcmp(argv[i+1], "marker")) {
+                            dev = new TraceMarker();
+                        }
+                        else if (!strcmp(argv[i+1], "intc")) {
+                            controller = new InterruptController();
+                            dev = controller;
+                        }
+                        else {
+                            std::cerr << "Unknown device: " << argv[i+1] << std::endl;
+                            return 1;
+                        }
                         size_t    pos = strtoul(argv[i+2], NULL, 16);
-                        uint8_t  line = atoi(argv[i+3]);
+                        size_t   core;
+                        uint8_t  line;
+                        parseLine(argv[i+3], core, line);
 
-                        devices.insert(std::make_tuple(dev, pos, line));
+                        devices.insert(std::make_tuple(dev, pos, line, core));
+                    }
+                    // Eat 3 words
+                    i += 3;
+                    break;
+
+                case 'D':
+                    // Check every instruction against the reference model
+                    lockstepInterval = strtoull(argv[i+1], NULL, 10);
+                    if (lockstepInterval == 0) {
+                        std::cerr << "Lockstep interval must be positive" << std::endl;
+                        return 1;
+                    }
+                    // Eat 1 word
+                    i += 1;
+                    break;
+
+                case 'f':
+                    // Add a disk backed by a file
+                    try {
+                        IODevice* dev = new BlockDevice(argv[i+1]);
+                        size_t    pos = strtoul(argv[i+2], NULL, 16);
+                        size_t   core;
+                        uint8_t  line;
+                        parseLine(argv[i+3], core, line);
+
+                        devices.insert(std::make_tuple(dev, pos, line, core));
+                    }
+                    catch (std::exception& e) {
+                        std::cerr << e.what() << std::endl;
+                        return 1;
                     }
                     // Eat 3 words
                     i += 3;
@@ -62,11 +209,79 @@ int main(int argc, char** argv) {
                     interactive = true;
                     break;
 
+                case 'M':
+                    // Count accesses to each word of memory
+                    heatmapPrefix = argv[i+1];
+                    heatmapWindow = strtoull(argv[i+2], NULL, 10);
+                    if (heatmapWindow == 0) {
+                        std::cerr << "Heatmap window must be positive" << std::endl;
+                        return 1;
+                    }
+                    // Eat 2 words
+                    i += 2;
+                    break;
+
+                case 'm':
+                    // Count what the machine does and write it to a file
+                    statsName = argv[i+1];
+                    // Eat 1 word
+                    i += 1;
+                    break;
+
                 case 's':
                     // Standard devices
                     standardDevices = true;
                     break;
 
+                case 'n':
+                    // Number of cores
+                    coreCount = strtoul(argv[i+1], NULL, 10);
+                    if (coreCount == 0) {
+                        std::cerr << "Need at least one core" << std::endl;
+                        return 1;
+                    }
+                    // Eat 1 word
+                    i += 1;
+                    break;
+
+                case 'S':
+                    // Save a snapshot and stop when the program asks for it
+                    {
+                        IODevice* dev = new SnapshotControl(argv[i+1], true);
+                        size_t    pos = strtoul(argv[i+2], NULL, 16);
+                        uint8_t  line = 0;
+
+                        devices.insert(std::make_tuple(dev, pos, line, 0));
+                    }
+                    // Eat 2 words
+                    i += 2;
+                    break;
+
+                case 't':
+                    // Record a timeline of events
+                    traceName = argv[i+1];
+                    // Eat 1 word
+                    i += 1;
+                    break;
+
+                case 'T':
+                    // Record every instruction
+                    itraceName = argv[i+1];
+                    // Eat 1 word
+                    i += 1;
+                    break;
+
+                case 'w':
+                    // Share the cores between fewer host threads
+                    workerCount = strtoul(argv[i+1], NULL, 10);
+                    if (workerCount == 0) {
+                        std::cerr << "Need at least one worker" << std::endl;
+                        return 1;
+                    }
+                    // Eat 1 word
+                    i += 1;
+                    break;
+
                 case 'x':
                     // Sets the input mode
                     hexMode = true;
@@ -90,35 +305,127 @@ int main(int argc, char** argv) {
 
     if (standardDevices) {
         {
-            // Number Display
-            IODevice* dev = new NumberDisplay();
+            // Console, this starts out printing numbers like numdisp did
+            IODevice* dev = new Console();
             size_t    pos = 0xc100;
             uint8_t  line = 0;
 
-            devices.insert(std::make_tuple(dev, pos, line));
+            devices.insert(std::make_tuple(dev, pos, line, 0));
         }
     }
 
-    if (!filename) {
+    if (!filename && !bootName) {
         // If we don't provide data, then the only thing that makes sense is to
         // run in interactive mode.
         interactive = true;
     }
 
-    Processor cpu(0x10000); // 64k of memory
+    // Checkpoints, snapshots and instruction traces only hold one set of
+    // registers, and there is only one prompt
+    if (coreCount > 1 && (interactive || checkpointName || bootName || itraceName)) {
+        std::cerr << "More than one core needs a program, and can't be used "
+                  << "with -b, -c, -i or -T" << std::endl;
+        return 1;
+    }
+
+    // The reference model has no devices, and only follows one core from a
+    // program we load ourselves
+    if (lockstepInterval && (!filename || !devices.empty() || coreCount > 1
+                || interactive || checkpointName || bootName || itraceName)) {
+        std::cerr << "Lockstep needs a program, and can't be used with devices "
+                  << "or with -b, -c, -i, -n or -T" << std::endl;
+        return 1;
+    }
+
+    if (statsName) {
+        Stats::enabled = true;
+        Stats::dumpOnSignal(SIGUSR1, statsName);
+    }
+
+    if (traceName) {
+        Trace::enabled = true;
+    }
+
+    MemoryManager memory(0x10000); // 64k of memory
+
+    std::vector<Processor*> cores;
+    for (size_t i = 0; i < coreCount; ++i) {
+        cores.push_back(new Processor(memory));
+    }
+    Processor& cpu = *cores[0];
+
+    Heatmap* heatmap = 0;
+    if (heatmapWindow) {
+        heatmap = new Heatmap(0x10000, heatmapWindow);
+        for (Processor* core : cores) {
+            core->useHeatmap(*heatmap);
+        }
+    }
 
     for (auto t : devices) {
-        cpu.useDevice(*std::get<0>(t), std::get<1>(t), std::get<2>(t));
+        size_t core = std::get<3>(t);
+        if (core >= coreCount) {
+            std::cerr << "No such core: " << core << std::endl;
+            return 1;
+        }
+        cores[core]->useDevice(*std::get<0>(t), std::get<1>(t), std::get<2>(t));
+
+        if (std::get<0>(t) == controller) {
+            cores[core]->useInterruptController(*controller);
+        }
+    }
+
+    InstructionTrace* itrace = 0;
+    if (itraceName) {
+        try {
+            itrace = new InstructionTrace(itraceName);
+        }
+        catch (std::runtime_error e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        cpu.useInstructionTrace(*itrace);
+    }
+
+    // If we have been checkpointing to this file before, carry on from where
+    // we left off rather than starting the program again
+    Checkpoint* checkpoint = 0;
+    bool resumed = false;
+    if (checkpointName) {
+        try {
+            checkpoint = new Checkpoint(checkpointName);
+            resumed = checkpoint->restore(cpu);
+        }
+        catch (std::runtime_error e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        cpu.useCheckpoint(*checkpoint, checkpointInterval);
+    }
+
+    // A snapshot already has a program in it, so we don't load one
+    bool booted = false;
+    if (bootName && !resumed) {
+        try {
+            Snapshot::boot(cpu, bootName);
+        }
+        catch (std::runtime_error e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        booted = true;
     }
 
     // Initialise the state of the processor
 
-    cpu.set(RegisterManager::FLAGS, 0);
-    cpu.set(RegisterManager::STACK, 0);
-    cpu.set(RegisterManager::PC,    1);
+    if (!resumed && !booted) {
+        cpu.set(RegisterManager::FLAGS, 0);
+        cpu.set(RegisterManager::STACK, 0);
+        cpu.set(RegisterManager::PC,    1);
+    }
 
     // Push any data in the file to memory
-    if (filename) {
+    if (filename && !resumed && !booted) {
         std::ifstream in(filename);
 
         while (in.peek() != std::ifstream::traits_type::eof()) {
@@ -145,7 +452,31 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (interactive) {
+    if (lockstepInterval) {
+        // Both engines start from the program we just loaded
+        Reference reference;
+        ProcessorEngine processor;
+        Engine* engines[2] = {&reference, &processor};
+        for (Engine* e : engines) {
+            for (uint32_t i = 0; i < 0x10000; ++i) {
+                e->write(i, memory.read(i));
+            }
+            for (size_t i = 0; i < 16; ++i) {
+                e->set(i, cpu.inspect(i));
+            }
+        }
+
+        Lockstep lock(reference, processor, lockstepInterval);
+        if (lock.run() == Lockstep::DIVERGED) {
+            std::cout << "Diverged from the reference at instruction "
+                      << lock.divergedAt() << std::endl;
+            Verifier::print(std::cout, lock.divergence());
+            return 1;
+        }
+        std::cout << "Agreed with the reference for " << lock.ticks()
+                  << " instructions" << std::endl;
+    }
+    else if (interactive) {
         bool done = false;
         while (!done) {
 
@@ -208,14 +539,74 @@ int main(int argc, char** argv) {
             }
         }
     }
-    else {
+    else if (coreCount == 1) {
         // Just run untill we halt.
         cpu.run();
     }
+    else {
+        // Every core starts where the first one would, with its number in r1
+        // so it can find its own work (and its own stack)
+        for (size_t i = 0; i < coreCount; ++i) {
+            for (size_t j = 0; j < 16; ++j) {
+                cores[i]->set(j, cpu.inspect(j));
+            }
+            cores[i]->set(1, i);
+        }
+
+        // Run them all untill they have all halted
+        if (workerCount) {
+            Scheduler scheduler(workerCount);
+            for (Processor* core : cores) {
+                scheduler.add(*core);
+            }
+            scheduler.wait();
+        }
+        else {
+            std::vector<std::thread> threads;
+            for (Processor* core : cores) {
+                threads.push_back(std::thread(&Processor::run, core));
+            }
+            for (std::thread& t : threads) {
+                t.join();
+            }
+        }
+    }
+
+    if (statsName) {
+        std::ofstream out(statsName);
+        Stats::dump(out);
+    }
+
+    if (traceName) {
+        std::ofstream out(traceName);
+        Trace::write(out);
+    }
+
+    if (heatmap) {
+        std::ofstream fetch((heatmapPrefix + "-fetch.pgm").c_str(), std::ios::binary);
+        heatmap->writeFetchImage(fetch);
+        std::ofstream data((heatmapPrefix + "-data.pgm").c_str(), std::ios::binary);
+        heatmap->writeDataImage(data);
+        std::ofstream words((heatmapPrefix + "-words.csv").c_str());
+        heatmap->writeWords(words);
+        std::ofstream pages((heatmapPrefix + "-pages.csv").c_str());
+        heatmap->writePages(pages);
+        std::ofstream ws((heatmapPrefix + "-ws.csv").c_str());
+        heatmap->writeWorkingSet(ws);
+
+        delete heatmap;
+    }
 
     for (auto t : devices) {
         delete std::get<0>(t);
     }
 
+    delete checkpoint;
+    delete itrace;
+
+    for (Processor* core : cores) {
+        delete core;
+    }
+
     return 0;
 }
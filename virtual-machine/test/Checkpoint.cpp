@@ -0,0 +1,178 @@
+#include "Checkpoint.hpp"
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+#include <unistd.h>
+
+using namespace std;
+
+void loadFib(Processor& cpu) {
+    cpu.set(RegisterManager::FLAGS, 0);
+    cpu.set(RegisterManager::STACK, 0);
+    cpu.set(RegisterManager::PC,    1);
+
+    cpu.push(0x0101); // 1: MOV 0 1
+    cpu.push(0x0102); // 2: MOV 0 2
+    cpu.push(0x5012); // 3: ADDi 0 1 2
+    cpu.push(0x3121); // 4: ADD 1 2 1
+    cpu.push(0x3122); // 5: ADD 1 2 2
+    cpu.push(0x051e); // 6: PUSH 1
+    cpu.push(0x204f); // 7: REL- $4 rPC    # line 4
+}
+
+int main(int argc, char** argv) {
+    const char* filename = "checkpoint-test.ckpt";
+    remove(filename);
+
+    {
+        // Checkpoint part way through a program, then pick it up in a fresh
+        // processor and make sure both end up in the same place
+        cout << "Testing save and restore... \t" << flush;
+
+        Processor orig(0x10000);
+        loadFib(orig);
+
+        Checkpoint cp(filename);
+        for (int i = 0; i < 20; ++i) orig.tick();
+        cp.save(orig);
+        for (int i = 0; i < 20; ++i) orig.tick();
+        cp.save(orig);
+
+        Processor copy(0x10000);
+        Checkpoint cpRead(filename);
+        bool restored = cpRead.restore(copy);
+
+        bool pass = restored;
+        for (size_t i = 0; i < 16 && pass; ++i) {
+            pass = orig.inspect(i) == copy.inspect(i);
+        }
+
+        for (int i = 0; i < 20; ++i) {
+            orig.tick();
+            copy.tick();
+        }
+        for (size_t i = 0; i < 16 && pass; ++i) {
+            pass = orig.inspect(i) == copy.inspect(i);
+        }
+
+        // Pop the stack to compare what was written to memory
+        for (int i = 0; i < 10 && pass; ++i) {
+            orig.exec(0x06e1); // POP 1
+            copy.exec(0x06e1); // POP 1
+            pass = orig.inspect(1) == copy.inspect(1);
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Chop the end off the last record, we should get the one before it
+        cout << "Testing torn records... \t" << flush;
+
+        Processor orig(0x10000);
+        loadFib(orig);
+
+        remove(filename);
+        Checkpoint cp(filename);
+        for (int i = 0; i < 20; ++i) orig.tick();
+        cp.save(orig);
+        uint16_t expectedPC = orig.inspect(RegisterManager::PC);
+
+        for (int i = 0; i < 20; ++i) orig.tick();
+        cp.save(orig);
+
+        FILE* f = fopen(filename, "rb");
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fclose(f);
+        truncate(filename, size - 3);
+
+        Processor copy(0x10000);
+        Checkpoint cpRead(filename);
+        bool restored = cpRead.restore(copy);
+
+        if (restored && copy.inspect(RegisterManager::PC) == expectedPC) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Files that aren't ours, or are for another memory size, are left
+        // exactly as they were
+        cout << "Testing foreign files... \t" << flush;
+
+        remove(filename);
+        FILE* f = fopen(filename, "wb");
+        fputs("0101 0102 5012 3121 3122 051e 204f\n", f);
+        fclose(f);
+
+        bool pass = false;
+        {
+            Processor cpu(0x10000);
+            Checkpoint cp(filename);
+            try {
+                cp.restore(cpu);
+            }
+            catch (std::runtime_error& e) {
+                pass = true;
+            }
+        }
+
+        f = fopen(filename, "rb");
+        fseek(f, 0, SEEK_END);
+        pass = pass && ftell(f) == 35;
+        fclose(f);
+
+        remove(filename);
+        {
+            Processor small(0x1000);
+            loadFib(small);
+            Checkpoint cp(filename);
+            cp.save(small);
+        }
+        f = fopen(filename, "rb");
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fclose(f);
+
+        bool threw = false;
+        {
+            Processor cpu(0x10000);
+            Checkpoint cp(filename);
+            try {
+                cp.restore(cpu);
+            }
+            catch (std::runtime_error& e) {
+                threw = true;
+            }
+        }
+        f = fopen(filename, "rb");
+        fseek(f, 0, SEEK_END);
+        pass = pass && threw && ftell(f) == size;
+        fclose(f);
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    remove(filename);
+    return 0;
+}
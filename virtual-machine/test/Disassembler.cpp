@@ -0,0 +1,126 @@
+#include "Disassembler.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+void load(vector<uint16_t>& memory, const vector<uint16_t>& program) {
+    for (size_t i = 0; i < program.size(); ++i) memory[i + 1] = program[i];
+}
+
+int main(int argc, char** argv) {
+    {
+        cout << "Testing text... \t" << flush;
+
+        bool pass = Disassembler::text(0x3121) == "ADD     r1      r2      r1"
+                 && Disassembler::text(0x81c0) == "SUBi    r1      12      r0"
+                 && Disassembler::text(0x113a) == "REL+    19      r10"
+                 && Disassembler::text(0x208f) == "JMP-    8"
+                 && Disassembler::text(0x201f) == "HALT"
+                 && Disassembler::text(0x070f) == "FPRED   fZERO"
+                 && Disassembler::text(0x051e) == "PUSH    r1"
+                 && Disassembler::text(0x06ef) == "POP     rPC"
+                 && Disassembler::text(0x0c0f) == "WFI"
+                 && Disassembler::text(0x0d12) == "LIT     0x0d12";
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // A loop ending in FPRED, with some data after the HALT
+        cout << "Testing blocks... \t" << flush;
+
+        vector<uint16_t> memory(0x10000, 0);
+        load(memory, {
+            0x0101, // 1: MOV   r0 r1
+            0x50c3, // 2: ADDi  r0 12 r3
+            0x5111, // 3: ADDi  r1 1 r1
+            0x8313, // 4: SUBi  r3 1 r3
+            0x070f, // 5: FPRED fZERO
+            0x101f, // 6: JMP+  1           # line 8
+            0x205f, // 7: JMP-  5           # line 3
+            0x201f, // 8: HALT
+            0xc100, // 9: LIT
+        });
+
+        Disassembler dis(memory);
+        dis.addEntry(1);
+        dis.analyse();
+
+        const auto& blocks = dis.blocks();
+        const auto& loops  = dis.loops();
+
+        bool pass = blocks.size() == 5
+                 && blocks.count(1) && blocks.at(1).end == 2 && blocks.at(1).entry
+                 && blocks.count(3) && blocks.at(3).end == 5
+                 && blocks.at(3).successors == vector<uint16_t>({6, 7})
+                 && blocks.at(6).successors == vector<uint16_t>({8})
+                 && blocks.at(7).successors == vector<uint16_t>({3})
+                 && blocks.at(8).halts
+                 && blocks.at(3).predecessors.size() == 2
+                 && dis.isCode(8) && !dis.isCode(9)
+                 && loops.size() == 1 && loops[0].header == 3
+                 && loops[0].blocks == vector<uint16_t>({3, 7})
+                 && loops[0].latches == vector<uint16_t>({7})
+                 && blocks.at(7).loop == 0 && blocks.at(6).loop == Disassembler::NO_LOOP;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // One loop inside another, and a return we can't follow
+        cout << "Testing nested loops... \t" << flush;
+
+        vector<uint16_t> memory(0x10000, 0);
+        load(memory, {
+            0x5032, // 1: ADDi  r0 3 r2
+            0x5043, // 2: ADDi  r0 4 r3     # outer
+            0x8313, // 3: SUBi  r3 1 r3     # inner
+            0x070f, // 4: FPRED fZERO
+            0x101f, // 5: JMP+  1           # line 7
+            0x204f, // 6: JMP-  4           # line 3
+            0x8212, // 7: SUBi  r2 1 r2
+            0x070f, // 8: FPRED fZERO
+            0x06ef, // 9: POP   rPC
+            0x209f, // 10: JMP- 9           # line 2
+        });
+
+        Disassembler dis(memory);
+        dis.addEntry(1);
+        dis.analyse();
+
+        const auto& blocks = dis.blocks();
+        const auto& loops  = dis.loops();
+
+        bool pass = loops.size() == 2
+                 && loops[0].header == 2 && loops[0].depth == 1
+                 && loops[0].parent == Disassembler::NO_LOOP
+                 && loops[1].header == 3 && loops[1].depth == 2 && loops[1].parent == 0
+                 && blocks.at(3).loop == 1 && blocks.at(7).loop == 0
+                 && blocks.at(9).indirect && blocks.at(9).successors.empty()
+                 && blocks.at(10).loop == 0;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "Heatmap.hpp"
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    Processor cpu(0x10000);
+    Heatmap map(0x10000, 4);
+    cpu.useHeatmap(map);
+
+    // Copy 0x1000 to 0x2000 three times, then halt
+    cpu.set(RegisterManager::FLAGS, 0);
+    cpu.set(RegisterManager::STACK, 0);
+    cpu.set(RegisterManager::PC,    1);
+    cpu.set(2, 0x1000);
+    cpu.set(3, 0x2000);
+    cpu.set(5, 3);
+
+    cpu.push(0x0424); // 1: LOAD  r2    r4
+    cpu.push(0x0343); // 2: STORE r4    r3
+    cpu.push(0x8515); // 3: SUBi  r5 $1 r5
+    cpu.push(0x070f); // 4: FPRED fZERO
+    cpu.push(0x101f); // 5: REL+  $1    rPC   # line 7
+    cpu.push(0x206f); // 6: REL-  $6    rPC   # line 1
+    cpu.push(0x201f); // 7: REL-  $1    rPC
+    cpu.run();
+
+    {
+        cout << "Testing counts... \t" << flush;
+
+        bool pass = map.get(Heatmap::FETCH, 1) == 3
+                 && map.get(Heatmap::FETCH, 6) == 2
+                 && map.get(Heatmap::FETCH, 7) == 1
+                 && map.get(Heatmap::LOAD,  0x1000) == 3
+                 && map.get(Heatmap::STORE, 0x2000) == 3
+                 && map.get(Heatmap::LOAD,  0x2000) == 0
+                 && map.get(Heatmap::FETCH, 0x1000) == 0;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // 16 ticks in windows of 4. The code page is always touched, the
+        // data pages only by the ticks that run lines 1 and 2.
+        cout << "Testing working set... \t" << flush;
+
+        stringstream ss;
+        map.writeWorkingSet(ss);
+        string csv = ss.str();
+
+        bool pass = csv == "start,pages\n0,3\n4,3\n8,2\n12,2\n16,1\n";
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+            cout << csv;
+        }
+    }
+
+    {
+        cout << "Testing image... \t" << flush;
+
+        stringstream ss;
+        map.writeDataImage(ss);
+        string pgm = ss.str();
+
+        string header = "P5\n256 256\n255\n";
+        bool pass = pgm.size() == header.size() + 0x10000
+                 && pgm.compare(0, header.size(), header) == 0
+                 && (uint8_t) pgm[header.size() + 0x1000] == 255
+                 && (uint8_t) pgm[header.size() + 0x1001] == 0;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    return 0;
+}
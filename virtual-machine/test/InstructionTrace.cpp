@@ -0,0 +1,130 @@
+#include "InstructionTrace.hpp"
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    const char* filename = "instruction-trace-test.lkt";
+
+    {
+        // Small blocks so there are lots of them, and the writer has to
+        // keep up with a ring of only two
+        cout << "Testing round trip... \t" << flush;
+
+        vector<InstructionTrace::Record> expected;
+        {
+            InstructionTrace trace(filename, 64, 2);
+            srand(1);
+            uint16_t pc = 0;
+            for (uint64_t i = 0; i < 100000; ++i) {
+                InstructionTrace::Record rec;
+                rec.index = i;
+
+                // Mostly straight line code in a small loop, with the odd
+                // jump anywhere
+                pc = rand() % 10 ? pc + 1 : rand();
+                if (pc > 0x40 && rand() % 2) pc = 0x10;
+
+                rec.pc          = pc;
+                rec.instruction = pc * 7 + (rand() % 50 == 0);
+                rec.value       = rand() % 3 ? i : rand();
+                rec.flags       = rand() % 20 ? 0x10 : rand();
+                rec.interrupted = rand() % 100 == 0;
+
+                trace.record(rec.pc, rec.instruction, rec.value, rec.flags,
+                        rec.interrupted);
+                expected.push_back(rec);
+            }
+        }
+
+        InstructionTrace::Reader reader(filename);
+        InstructionTrace::Record rec;
+        size_t count = 0;
+        bool pass = true;
+        while (pass && reader.next(rec)) {
+            const InstructionTrace::Record& e = expected[count];
+            pass = rec.index == count && rec.pc == e.pc
+                && rec.instruction == e.instruction && rec.value == e.value
+                && rec.flags == e.flags && rec.interrupted == e.interrupted;
+            ++count;
+        }
+        pass = pass && count == expected.size();
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        cout << "Testing processor... \t" << flush;
+
+        {
+            Processor cpu(0x10000);
+            InstructionTrace trace(filename);
+            cpu.useInstructionTrace(trace);
+
+            cpu.set(RegisterManager::FLAGS, 0);
+            cpu.set(RegisterManager::STACK, 0);
+            cpu.set(RegisterManager::PC,    1);
+            cpu.set(1, 0x0040);
+
+            cpu.push(0x5121); // 1: ADDi r1 $2 r1
+            cpu.push(0x201f); // 2: REL- $1    rPC
+            cpu.run();
+        }
+
+        InstructionTrace::Reader reader(filename);
+        InstructionTrace::Record a, b, c;
+        bool pass = reader.next(a) && reader.next(b) && !reader.next(c)
+                 && a.pc == 1 && a.instruction == 0x5121 && a.value == 0x0042
+                 && b.pc == 2 && b.instruction == 0x201f && b.value == 2;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // A disk that is always full. Recording has to stop rather than
+        // wait for the writer, and flush says what went wrong.
+        cout << "Testing write errors... \t" << flush;
+
+        bool pass = false;
+        {
+            InstructionTrace trace("/dev/full", 64, 2);
+            for (int i = 0; i < 10000; ++i) {
+                trace.record(i, 0x5121, i * 7, 0, false);
+            }
+            try {
+                trace.flush();
+            }
+            catch (std::runtime_error& e) {
+                pass = true;
+            }
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    remove(filename);
+    return 0;
+}
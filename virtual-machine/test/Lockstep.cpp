@@ -0,0 +1,148 @@
+#include "Lockstep.hpp"
+#include "Engine.hpp"
+#include "Reference.hpp"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+// Gets ADD wrong once the result goes over 1000
+class BrokenEngine: public ProcessorEngine {
+    public:
+        void tick() {
+            uint16_t instruction = read(inspect(15));
+            ProcessorEngine::tick();
+
+            uint8_t dest = instruction & 0xf;
+            if (instruction >> 12 == 0x3 && inspect(dest) > 1000) {
+                set(dest, inspect(dest) + 1);
+            }
+        }
+};
+
+void loadFib(Engine& e) {
+    vector<uint16_t> program = {
+        0x0101, // 1: MOV   0 1
+        0x0102, // 2: MOV   0 2
+        0x5012, // 3: ADDi  0 1 2
+        0x3121, // 4: ADD   1 2 1
+        0x3122, // 5: ADD   1 2 2
+        0x051e, // 6: PUSH  1
+        0x0b00, // 7: INTER
+        0x8313, // 8: SUBi  3 $1 3
+        0x070f, // 9: FPRED fZERO
+        0x101f, // 10: REL+ $1 rPC       # line 12
+        0x208f, // 11: REL- $8 rPC       # line 4
+        0x201f, // 12: REL- $1 rPC
+    };
+    for (uint32_t i = 0; i < 0x10000; ++i) e.write(i, 0);
+    for (size_t i = 0; i < program.size(); ++i) e.write(i + 1, program[i]);
+
+    for (size_t i = 0; i < 16; ++i) e.set(i, 0);
+    e.set(3, 12);
+    e.set(12, 8);                        // the handler is the next line
+    e.set(13, 1 << 4);                   // fICF
+    e.set(14, 0x1000);
+    e.set(15, 1);
+}
+
+int main(int argc, char** argv) {
+    {
+        cout << "Testing agreement... \t" << flush;
+
+        Reference ref;
+        ProcessorEngine cpu;
+        loadFib(ref);
+        loadFib(cpu);
+
+        Lockstep lock(ref, cpu, 10);
+        Lockstep::Result res = lock.run(10000);
+
+        if (res == Lockstep::HALTED && cpu.inspect(1) == 46368) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+            Verifier::print(cout, lock.divergence());
+        }
+    }
+
+    {
+        // Find the first bad ADD in the middle of a long interval
+        cout << "Testing bisection... \t" << flush;
+
+        Reference ref;
+        BrokenEngine broken;
+        loadFib(ref);
+        loadFib(broken);
+
+        Lockstep lock(ref, broken, 1000);
+        Lockstep::Result res = lock.run();
+
+        // Find the same tick by hand
+        ProcessorEngine cpu;
+        loadFib(cpu);
+        uint64_t tick = 0;
+        while (true) {
+            uint16_t instruction = cpu.read(cpu.inspect(15));
+            cpu.tick();
+            if (instruction >> 12 == 0x3 && cpu.inspect(instruction & 0xf) > 1000) break;
+            ++tick;
+        }
+
+        const Verifier::Divergence& d = lock.divergence();
+        bool pass = res == Lockstep::DIVERGED && lock.divergedAt() == tick
+                 && d.instruction >> 12 == 0x3
+                 && d.expected[d.instruction & 0xf] + 1 == d.actual[d.instruction & 0xf];
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+            Verifier::print(cout, d);
+        }
+    }
+
+    {
+        // INTER leaves an interrupt pending for the next tick, so some of
+        // these checkpoints land with one pending and a bisect has to put
+        // it back to land on the same tick
+        cout << "Testing pending interrupts... \t" << flush;
+
+        ProcessorEngine cpu;
+        loadFib(cpu);
+        uint64_t tick = 0;
+        while (true) {
+            uint16_t instruction = cpu.read(cpu.inspect(15));
+            cpu.tick();
+            if (instruction >> 12 == 0x3 && cpu.inspect(instruction & 0xf) > 1000) break;
+            ++tick;
+        }
+
+        bool pass = true;
+        for (uint64_t interval = 1; interval <= 64; ++interval) {
+            Reference ref;
+            BrokenEngine broken;
+            loadFib(ref);
+            loadFib(broken);
+
+            Lockstep lock(ref, broken, interval);
+            if (lock.run() != Lockstep::DIVERGED || lock.divergedAt() != tick) {
+                pass = false;
+            }
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    return 0;
+}
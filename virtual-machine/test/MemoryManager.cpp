@@ -1,6 +1,10 @@
 #include "MemoryManager.hpp"
+#include "CodeImage.hpp"
 
 #include <iostream>
+#include <vector>
+#include <memory>
+#include <thread>
 #include <stdexcept>
 #include <cstdint>
 
@@ -57,6 +61,165 @@ int main(int argc, char** argv) {
         }
     }
 
+    {
+        // Test the bulk operations, including moves that overlap and cross
+        // page boundaries in both directions
+        cout << "Testing bulk operations... \t\t" << flush;
+        for (size_t i = 0; i < 0x1000; ++i) {
+            testMem[i] = i;
+        }
+
+        bool pass = true;
+
+        testMem.moveRange(0x0180, 0x0100, 0x200);
+        for (size_t i = 0; i < 0x200 && pass; ++i) {
+            pass = testMem[0x0180 + i] == 0x0100 + i;
+        }
+
+        testMem.moveRange(0x0800, 0x0880, 0x200);
+        for (size_t i = 0; i < 0x200 && pass; ++i) {
+            pass = testMem[0x0800 + i] == 0x0880 + i;
+        }
+
+        testMem.fillRange(0x20f0, 7, 0x20);
+        uint16_t values[0x30];
+        testMem.getRange(0x20e8, values, 0x30);
+        for (size_t i = 0; i < 0x30 && pass; ++i) {
+            bool filled = i >= 8 && i < 0x28;
+            pass = filled == (values[i] == 7);
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Nothing has memory of its own until it is written to
+        cout << "Testing lazy pages... \t\t\t" << flush;
+
+        MemoryManager fresh(0x10000);
+        bool pass = fresh.pagesInUse() == 0;
+        for (size_t i = 0; i < 0x10000 && pass; ++i) {
+            pass = fresh.read(i) == 0;
+        }
+        pass = pass && fresh.pagesInUse() == 0;
+
+        fresh[0x1234] = 5;
+        fresh.fillRange(0x40ff, 1, 2);
+        pass = pass && fresh.pagesInUse() == 3
+                    && fresh.read(0x1234) == 5 && fresh.read(0x1235) == 0
+                    && fresh.read(0x40ff) == 1 && fresh.read(0x4100) == 1;
+
+        // Other memories still see zeros
+        MemoryManager other(0x10000);
+        pass = pass && other.read(0x1234) == 0 && other.pagesInUse() == 0;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Cores storing to the same fresh pages at once, each to its own
+        // word, all land in the one copy of each page
+        cout << "Testing stores from many cores... \t" << flush;
+        const size_t CORES = 4;
+
+        MemoryManager fresh(0x10000);
+        vector<uint8_t> ok(CORES, 1);
+        vector<thread> threads;
+        for (size_t t = 0; t < CORES; ++t) {
+            threads.push_back(thread([&fresh, &ok, t]() {
+                for (size_t page = 0; page < 0x100; ++page) {
+                    size_t index = page * MemoryManager::PAGE_WORDS + t;
+                    uint16_t value = page + t + 1;
+                    if (t % 2) {
+                        fresh.setRange(index, &value, 1);
+                    }
+                    else {
+                        fresh[index] = value;
+                    }
+                    if (fresh.read(index) != value) ok[t] = 0;
+                }
+            }));
+        }
+        for (thread& th : threads) th.join();
+
+        bool pass = fresh.pagesInUse() == 0x100;
+        for (size_t t = 0; t < CORES; ++t) {
+            pass = pass && ok[t];
+            for (size_t page = 0; page < 0x100; ++page) {
+                size_t index = page * MemoryManager::PAGE_WORDS + t;
+                pass = pass && fresh.read(index) == page + t + 1;
+            }
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Two memories on one image, one copying on write and one not
+        cout << "Testing shared code... \t\t\t" << flush;
+
+        vector<uint16_t> program(MemoryManager::PAGE_WORDS + 10);
+        for (size_t i = 0; i < program.size(); ++i) program[i] = 0x1000 + i;
+        shared_ptr<CodeImage> image = make_shared<CodeImage>(program.data(), program.size());
+
+        MemoryManager copying(0x1000);
+        MemoryManager faulting(0x1000);
+        copying.mapCode(1, image, true);
+        faulting.mapCode(1, image, false);
+        image.reset();
+
+        size_t base = MemoryManager::PAGE_WORDS;
+        bool pass = copying.read(base + 5) == 0x1005 && faulting.read(base + 5) == 0x1005
+                 && copying.read(base + program.size()) == 0;
+
+        // Only the page written to is copied
+        copying[base + 5] = 7;
+        uint16_t word = 9;
+        copying.setRange(base + MemoryManager::PAGE_WORDS + 1, &word, 1);
+        pass = pass && copying.read(base + 5) == 7 && copying.read(base + 6) == 0x1006
+                    && copying.read(base + MemoryManager::PAGE_WORDS + 1) == 9
+                    && faulting.read(base + 5) == 0x1005
+                    && faulting.read(base + MemoryManager::PAGE_WORDS + 1) == 0x1101;
+
+        bool threw = false;
+        try {
+            faulting.fillRange(base + 3, 0, 2);
+        }
+        catch (runtime_error& e) {
+            threw = true;
+        }
+        pass = pass && threw && faulting.read(base + 3) == 0x1003;
+
+        // Pages pointed elsewhere go back to the shared code
+        uint16_t frame[MemoryManager::PAGE_WORDS] = {0};
+        faulting.mapPage(1, frame);
+        faulting[base] = 4;
+        faulting.unmapPage(1);
+        pass = pass && frame[0] == 4 && faulting.read(base) == 0x1000;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
     {
         // Test out of range indexing
         cout << "Testing out of range indexes... \t" << flush;
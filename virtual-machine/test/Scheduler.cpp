@@ -0,0 +1,116 @@
+#include "Scheduler.hpp"
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+void loadCounter(Processor& cpu) {
+    cpu.set(RegisterManager::FLAGS, 0);
+    cpu.set(RegisterManager::STACK, 0);
+    cpu.set(RegisterManager::PC,    1);
+    cpu.set(7, 20000);
+
+    cpu.push(0x8717); // 1: SUBi  r7 $1 r7
+    cpu.push(0x070f); // 2: FPRED fZERO
+    cpu.push(0x101f); // 3: REL+  $1    rPC   # line 5
+    cpu.push(0x204f); // 4: REL-  $4    rPC   # line 1
+    cpu.push(0x201f); // 5: REL-  $1    rPC
+}
+
+void loadSleeper(Processor& cpu) {
+    cpu.set(RegisterManager::FLAGS, 0);
+    cpu.set(RegisterManager::STACK, 0);
+    cpu.set(RegisterManager::PC,    1);
+
+    cpu.push(0x0c0f); // 1: WFI
+    cpu.push(0x201f); // 2: REL-  $1    rPC
+}
+
+int main(int argc, char** argv) {
+    {
+        // Far more sleepers than workers. If waiting held on to a worker
+        // the counters would never get to run.
+        cout << "Testing parking... \t" << flush;
+        const int COUNT = 200;
+
+        vector<Processor*> sleepers;
+        vector<Processor*> counters;
+        for (int i = 0; i < COUNT; ++i) {
+            sleepers.push_back(new Processor(0x100));
+            counters.push_back(new Processor(0x100));
+            loadSleeper(*sleepers.back());
+            loadCounter(*counters.back());
+        }
+
+        Scheduler sched(2, 1000);
+        for (int i = 0; i < COUNT; ++i) {
+            sched.add(*sleepers[i]);
+            sched.add(*counters[i]);
+        }
+
+        // All the counters should finish while the sleepers sleep
+        bool pass = false;
+        for (int i = 0; i < 1000 && !pass; ++i) {
+            pass = sched.count() == COUNT;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        for (int i = 0; i < COUNT && pass; ++i) {
+            pass = counters[i]->inspect(7) == 0;
+            pass = pass && sleepers[i]->inspect(RegisterManager::PC) == 2;
+        }
+
+        // Then wake them all up
+        for (Processor* cpu : sleepers) {
+            cpu->interrupt(0);
+        }
+        sched.wait();
+        pass = pass && sched.count() == 0;
+
+        for (int i = 0; i < COUNT; ++i) {
+            delete sleepers[i];
+            delete counters[i];
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Interrupts that arrive while the program is running (or before it
+        // gets to its WFI) must not be lost
+        cout << "Testing wake races... \t" << flush;
+        const int COUNT = 100;
+
+        vector<Processor*> sleepers;
+        for (int i = 0; i < COUNT; ++i) {
+            sleepers.push_back(new Processor(0x100));
+            loadSleeper(*sleepers.back());
+        }
+
+        Scheduler sched(2, 1);
+        for (int i = 0; i < COUNT; ++i) {
+            sched.add(*sleepers[i]);
+            sleepers[i]->interrupt(0);
+        }
+        sched.wait();
+
+        for (Processor* cpu : sleepers) {
+            delete cpu;
+        }
+
+        cout << "OK!" << endl;
+    }
+
+    return 0;
+}
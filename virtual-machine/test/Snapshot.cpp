@@ -0,0 +1,126 @@
+#include "Snapshot.hpp"
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+#include "devices/SnapshotControl.hpp"
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <csignal>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    const char* filename = "snapshot-test.snap";
+    remove(filename);
+
+    {
+        // The program asks for a snapshot half way through. Booting it should
+        // carry on from the instruction after the request.
+        cout << "Testing save and boot... \t" << flush;
+
+        Processor orig(0x10000);
+        SnapshotControl control(filename, true);
+        orig.useDevice(control, 0xc100, 0);
+
+        orig.set(RegisterManager::FLAGS, 0);
+        orig.set(RegisterManager::STACK, 0);
+        orig.set(RegisterManager::PC,    1);
+
+        orig.push(0x106a); // 1: REL+  $6    r10
+        orig.push(0x04aa); // 2: LOAD  r10   r10
+        orig.push(0x5051); // 3: ADDi  r0 $5 r1
+        orig.push(0x031a); // 4: STORE r1    r10   # snapshot
+        orig.push(0x5171); // 5: ADDi  r1 $7 r1
+        orig.push(0x201f); // 6: REL-  $1    rPC   # halt
+        orig.push(0x0000); // 7: NOP
+        orig.push(0xc100); // 8: Address of the snapshot control
+
+        orig.run();
+        bool stopped = orig.inspect(1) == 5 && orig.inspect(RegisterManager::PC) == 5;
+
+        Processor copy(0x10000);
+        Snapshot::boot(copy, filename);
+        copy.run();
+
+        if (stopped && copy.inspect(1) == 12) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Booting something that isn't a snapshot should throw
+        cout << "Testing bad snapshots... \t" << flush;
+
+        FILE* f = fopen(filename, "wb");
+        fputs("Not a snapshot", f);
+        fclose(f);
+
+        bool pass = false;
+        Processor copy(0x10000);
+        try {
+            Snapshot::boot(copy, filename);
+        }
+        catch (std::runtime_error e) {
+            pass = true;
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // A save that can't be written leaves the old file and no temporary
+        // one behind
+        cout << "Testing failed saves... \t" << flush;
+
+        FILE* f = fopen(filename, "wb");
+        fputs("Old", f);
+        fclose(f);
+
+        // Files can't grow past 4 KB, writes past that fail
+        struct rlimit old, small;
+        getrlimit(RLIMIT_FSIZE, &old);
+        small = old;
+        small.rlim_cur = 0x1000;
+        signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &small);
+
+        bool pass = false;
+        Processor cpu(0x10000);
+        try {
+            Snapshot::save(cpu, filename);
+        }
+        catch (std::runtime_error& e) {
+            pass = true;
+        }
+        setrlimit(RLIMIT_FSIZE, &old);
+
+        struct stat st;
+        pass = pass && stat(filename, &st) == 0 && st.st_size == 3
+                    && access((string(filename) + ".tmp").c_str(), F_OK) != 0;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    remove(filename);
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "Stats.hpp"
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+#include "devices/Atomic.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+void loadProgram(Processor& cpu) {
+    cpu.set(RegisterManager::FLAGS, 0);
+    cpu.set(RegisterManager::STACK, 0);
+    cpu.set(RegisterManager::PC,    1);
+    cpu.set(2, 0x8000);
+    cpu.set(3, 5);
+
+    cpu.push(0x0424); // 1: LOAD  r2    r4
+    cpu.push(0x0332); // 2: STORE r3    r2
+    cpu.push(0x0b00); // 3: INTER
+    cpu.push(0x201f); // 4: REL-  $1    rPC
+}
+
+void runProgram() {
+    Processor cpu(0x10000);
+    Atomic atomic;
+    cpu.useDevice(atomic, 0x8000, 0);
+    loadProgram(cpu);
+    cpu.run();
+    cpu.removeDevice(atomic);
+}
+
+bool contains(const string& haystack, const string& needle) {
+    return haystack.find(needle) != string::npos;
+}
+
+int main(int argc, char** argv) {
+    Stats::enabled = true;
+
+    {
+        cout << "Testing counts... \t" << flush;
+
+        runProgram();
+
+        stringstream ss;
+        Stats::dump(ss);
+        string json = ss.str();
+
+        // push doesn't go through exec, so loading the program isn't counted
+        bool pass = contains(json, "\"instructions\": 4,")
+                 && contains(json, "\"LOAD\": 1")
+                 && contains(json, "\"STORE\": 1")
+                 && contains(json, "\"INTER\": 1")
+                 && contains(json, "\"REL-\": 1")
+                 && contains(json, "\"8000\": {\"reads\": 1, \"writes\": 1}")
+                 && contains(json, "\"loads\": [0, 0, 0, 0, 0, 0, 0, 0, 1,")
+                 && contains(json, "\"stores\": [0, 0, 0, 0, 0, 0, 0, 0, 1,")
+                 && contains(json, "\"interrupts\": [0, 0, 0, 0, 0, 0, 0, 0, 1]");
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Another thread counts into its own block, it should all add up
+        cout << "Testing threads... \t" << flush;
+
+        thread t(runProgram);
+        t.join();
+
+        stringstream ss;
+        Stats::dump(ss);
+        string json = ss.str();
+
+        bool pass = contains(json, "\"instructions\": 8,")
+                 && contains(json, "\"8000\": {\"reads\": 2, \"writes\": 2}")
+                 && contains(json, "\"interrupts\": [0, 0, 0, 0, 0, 0, 0, 0, 2]");
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Threads that come and go pass their blocks on, nothing they
+        // counted should go missing
+        cout << "Testing thread reuse... \t" << flush;
+
+        for (int i = 0; i < 50; ++i) {
+            thread t([]() { Stats::deviceWrite(0x9000); });
+            t.join();
+        }
+
+        stringstream ss;
+        Stats::dump(ss);
+        string json = ss.str();
+
+        bool pass = contains(json, "\"9000\": {\"reads\": 0, \"writes\": 50}")
+                 && contains(json, "\"instructions\": 8,");
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "Trace.hpp"
+#include "Processor.hpp"
+#include "RegisterManager.hpp"
+#include "devices/TraceMarker.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+size_t count(const string& haystack, const string& needle) {
+    size_t n = 0;
+    for (size_t pos = haystack.find(needle); pos != string::npos;
+            pos = haystack.find(needle, pos + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+int main(int argc, char** argv) {
+    Trace::enabled = true;
+
+    {
+        // Mark a span, then take a software interrupt inside it
+        cout << "Testing events... \t" << flush;
+
+        Processor cpu(0x10000);
+        TraceMarker marker;
+        cpu.useDevice(marker, 0x8000, 0);
+
+        cpu.set(RegisterManager::FLAGS, 0);
+        cpu.set(RegisterManager::STACK, 0);
+        cpu.set(RegisterManager::PC,    1);
+        cpu.set(RegisterManager::IHP,   5);
+        cpu.set(2, 0x8000);
+        cpu.set(3, 0x8001);
+        cpu.set(4, 7);
+
+        cpu.push(0x0342); // 1: STORE r4    r2     # begin span 7
+        cpu.push(0x084d); // 2: FSET  fICF
+        cpu.push(0x0b00); // 3: INTER
+        cpu.push(0x201f); // 4: REL-  $1    rPC
+        cpu.push(0x0343); // 5: STORE r4    r3     # end span 7
+        cpu.push(0x201f); // 6: REL-  $1    rPC
+        cpu.run();
+
+        stringstream ss;
+        Trace::write(ss);
+        string json = ss.str();
+
+        bool pass = count(json, "\"name\": \"span\"") == 2
+                 && count(json, "\"ph\": \"b\"") == 1
+                 && count(json, "\"ph\": \"e\"") == 1
+                 && count(json, "\"id\": 7") == 2
+                 && count(json, "\"name\": \"interrupt\"") == 1
+                 && count(json, "\"name\": \"device write\"") == 2;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Enough events to need a few chunks, from two threads at once
+        cout << "Testing buffers... \t" << flush;
+
+        const size_t N = Trace::CHUNK_EVENTS * 3 + 1;
+        auto spam = [N]() {
+            for (size_t i = 0; i < N; ++i) Trace::instant("spam", i);
+        };
+        thread a(spam);
+        thread b(spam);
+        a.join();
+        b.join();
+
+        stringstream ss;
+        Trace::write(ss);
+        string json = ss.str();
+
+        bool pass = count(json, "\"name\": \"spam\"") == 2 * N
+                 && count(json, "\"args\": {\"value\": " + to_string(N - 1) + "}") == 2;
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Threads that come and go, like the ones async devices write from,
+        // take over the buffers of threads that are done
+        cout << "Testing thread reuse... \t" << flush;
+
+        stringstream before;
+        Trace::write(before);
+
+        for (int i = 0; i < 50; ++i) {
+            thread t([]() { Trace::instant("short", 0); });
+            t.join();
+        }
+
+        stringstream after;
+        Trace::write(after);
+
+        bool pass = count(after.str(), "\"name\": \"short\"") == 50
+                 && count(after.str(), "thread_name") == count(before.str(), "thread_name");
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "Verifier.hpp"
+#include "Engine.hpp"
+#include "Reference.hpp"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+// Gets the high word of MUL wrong, like Processor once did
+class BrokenEngine: public ProcessorEngine {
+    public:
+        void exec(uint16_t instruction) {
+            ProcessorEngine::exec(instruction);
+            if (instruction >> 12 == 0x9) set(11, inspect(11) ^ 1);
+        }
+};
+
+Engine* makeProcessor() {
+    return new ProcessorEngine();
+}
+
+Engine* makeBroken() {
+    return new BrokenEngine();
+}
+
+int main(int argc, char** argv) {
+    {
+        // Every encoding from a few states each
+        cout << "Testing all encodings... \t" << flush;
+
+        Verifier verifier(makeProcessor);
+        uint64_t cases = verifier.run();
+
+        bool pass = cases == 0x10000 * 16 && verifier.divergences().empty();
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+            for (auto& d : verifier.divergences()) Verifier::print(cout, d);
+        }
+    }
+
+    {
+        // Should be caught straight away, with nothing in the state that
+        // doesn't need to be there
+        cout << "Testing divergences... \t\t" << flush;
+
+        Verifier verifier(makeBroken);
+        verifier.setMaxDivergences(4);
+        verifier.run(0x9000, 0x1000);
+
+        bool pass = verifier.divergences().size() == 4;
+        for (auto& d : verifier.divergences()) {
+            pass = pass && d.instruction >> 12 == 0x9
+                && d.expected[11] != d.actual[11];
+            for (size_t i = 0; i < 16; ++i) {
+                pass = pass && d.before[i] == 0;
+            }
+        }
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+            for (auto& d : verifier.divergences()) Verifier::print(cout, d);
+        }
+    }
+
+    {
+        // Two Processors should agree with each other too
+        cout << "Testing engine pairs... \t" << flush;
+
+        Verifier verifier(makeProcessor, makeProcessor);
+        verifier.setSamples(2);
+        verifier.run();
+
+        if (verifier.divergences().empty()) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "leekvm.h"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+
+using namespace std;
+
+uint16_t readCount(void* user, uint16_t address) {
+    return ((vector<uint16_t>*) user)->size();
+}
+
+void writeValue(void* user, uint16_t address, uint16_t value) {
+    ((vector<uint16_t>*) user)->push_back(value);
+}
+
+int main(int argc, char** argv) {
+    {
+        // Fibonacci numbers go out through a device, then it halts
+        cout << "Testing load and run... \t" << flush;
+
+        const uint16_t image[] = {
+            0x1099, //  1: REL+  $9    r9
+            0x0499, //  2: LOAD  r9    r9    # device
+            0x5011, //  3: ADDi  r0 $1 r1
+            0x5012, //  4: ADDi  r0 $1 r2
+            0x0319, //  5: STORE r1    r9
+            0x3121, //  6: ADD   r1 r2 r1
+            0x3122, //  7: ADD   r1 r2 r2
+            0x0329, //  8: STORE r2    r9
+            0x0493, //  9: LOAD  r9    r3    # how many so far
+            0x201f, // 10: REL-  $1    rPC
+            0xc100, // 11: Address of the device
+        };
+        vector<uint16_t> out;
+
+        leek_vm* vm = leek_create(0x10000);
+        bool pass = vm != NULL;
+        pass = pass && leek_load(vm, image, sizeof(image) / 2) == LEEK_OK;
+        pass = pass && leek_map_device(vm, 0xc100, 1, 0, readCount, writeValue, &out) == LEEK_OK;
+
+        uint64_t ran = 0;
+        pass = pass && leek_run(vm, 1000, &ran) == LEEK_HALTED;
+        pass = pass && out.size() == 2 && out[0] == 1 && out[1] == 3;
+        uint16_t value = 0;
+        pass = pass && leek_get_register(vm, 3, &value) == LEEK_OK && value == 2;
+        pass = pass && leek_get_register(vm, 16, &value) == LEEK_ERROR;
+
+        uint16_t word = 0;
+        pass = pass && leek_read_memory(vm, 11, &word, 1) == LEEK_OK && word == 0xc100;
+        pass = pass && leek_read_memory(vm, 0xffff, &word, 2) == LEEK_ERROR;
+
+        leek_destroy(vm);
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Budgets, waiting for interrupts and bad arguments
+        cout << "Testing budget and waiting... \t" << flush;
+
+        const uint16_t image[] = {
+            0x5111, // 1: ADDi  r1 $1 r1
+            0x8111, // 2: SUBi  r1 $1 r1
+            0x5111, // 3: ADDi  r1 $1 r1
+            0x0c0f, // 4: WFI
+            0x5111, // 5: ADDi  r1 $1 r1
+            0x201f, // 6: REL-  $1    rPC
+        };
+
+        leek_vm* vm = leek_create(0x100);
+        leek_load(vm, image, sizeof(image) / 2);
+
+        uint64_t ran = 0;
+        bool pass = leek_run(vm, 2, &ran) == LEEK_BUDGET && ran == 2;
+        pass = pass && leek_run(vm, 100, &ran) == LEEK_WAITING;
+        pass = pass && leek_run(vm, 100, &ran) == LEEK_WAITING && ran == 0;
+        pass = pass && leek_interrupt(vm, 3) == LEEK_OK;
+        pass = pass && leek_run(vm, 100, &ran) == LEEK_HALTED;
+        uint16_t value = 0;
+        pass = pass && leek_get_register(vm, 1, &value) == LEEK_OK && value == 2;
+
+        pass = pass && leek_interrupt(vm, 9) == LEEK_ERROR;
+        pass = pass && leek_set_register(vm, 16, 0) == LEEK_ERROR;
+        pass = pass && leek_map_device(vm, 0xff, 2, 0, NULL, NULL, NULL) == LEEK_ERROR;
+        pass = pass && leek_create(0) == NULL && leek_error(NULL)[0] != 0;
+
+        leek_destroy(vm);
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    {
+        // Machines sharing one image, with a store into it
+        cout << "Testing shared images... \t" << flush;
+
+        const uint16_t image[] = {
+            0x1039, // 1: REL+  $3    r9
+            0x5071, // 2: ADDi  r0 $7 r1
+            0x0319, // 3: STORE r1    r9
+            0x201f, // 4: REL-  $1    rPC
+            0x0000, // 5: Written to
+        };
+
+        leek_image* shared = leek_image_create(image, sizeof(image) / 2);
+        leek_vm* copying  = leek_create(0x1000);
+        leek_vm* faulting = leek_create(0x1000);
+        bool pass = shared != NULL
+                 && leek_load_shared(copying, shared, LEEK_SHARED_COPY) == LEEK_OK
+                 && leek_load_shared(faulting, shared, LEEK_SHARED_FAULT) == LEEK_OK;
+        leek_image_release(shared);
+
+        uint16_t word = 0;
+        pass = pass && leek_run(copying, 100, NULL) == LEEK_HALTED;
+        pass = pass && leek_read_memory(copying, 5, &word, 1) == LEEK_OK && word == 7;
+        pass = pass && leek_run(faulting, 100, NULL) == LEEK_ERROR;
+        pass = pass && leek_read_memory(faulting, 5, &word, 1) == LEEK_OK && word == 0;
+
+        leek_destroy(copying);
+        leek_destroy(faulting);
+
+        // The stack is past the shared page, so pushing is fine even when
+        // stores to the image fault
+        const uint16_t pushes[] = {
+            0x5071, // 1: ADDi  r0 $7 r1
+            0x051e, // 2: PUSH  r1
+            0x201f, // 3: HALT
+        };
+
+        shared   = leek_image_create(pushes, sizeof(pushes) / 2);
+        faulting = leek_create(0x1000);
+        pass = pass && shared != NULL
+                    && leek_load_shared(faulting, shared, LEEK_SHARED_FAULT) == LEEK_OK;
+        leek_image_release(shared);
+
+        pass = pass && leek_run(faulting, 100, NULL) == LEEK_HALTED;
+        uint16_t stack = 0;
+        pass = pass && leek_get_register(faulting, 14, &stack) == LEEK_OK && stack == 0x100
+                    && leek_read_memory(faulting, stack, &word, 1) == LEEK_OK && word == 7;
+
+        leek_destroy(faulting);
+
+        if (pass) {
+            cout << "OK!" << endl;
+        }
+        else {
+            cout << "Fail" << endl;
+        }
+    }
+
+    return 0;
+}
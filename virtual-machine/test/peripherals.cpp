@@ -1,8 +1,27 @@
 #include "Processor.hpp"
+#include "MemoryManager.hpp"
 #include "devices/Incrementer.hpp"
 #include "devices/Multiplier.hpp"
+#include "devices/MMU.hpp"
+#include "devices/DMA.hpp"
+#include "devices/VectorUnit.hpp"
+#include "devices/Console.hpp"
+#include "devices/Input.hpp"
+#include "devices/BlockDevice.hpp"
+#include "devices/Timer.hpp"
+#include "devices/InterruptController.hpp"
+#include "devices/Hypercall.hpp"
+#include "devices/Channel.hpp"
+#include "devices/Atomic.hpp"
 
 #include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+#include <cstdio>
+
+#include <unistd.h>
 
 int main(int argc, char** argv) {
     {
@@ -14,21 +33,20 @@ int main(int argc, char** argv) {
         test.useDevice(inc, 0xc100, 0);
 
         test.exec(0x010e); // MOV  r0  rSTACK
-        test.exec(0x010f); // MOV  r0  rPC
-        test.exec(0x201f); // LSET rPC 1
-
-        test.exec(0x0101); // MOV  r0 r1
-        test.exec(0x2641); // LSET r1 100
+        test.exec(0x501f); // ADDi r0 $1 rPC
+        test.set(1, 100);
 
         // Push the program
-        test.push(0x084d); // FSET  fICF
-        test.push(0x4f4c); // ADDi  rPC 4 rIHP
-        test.push(0x1c12); // HSET  r2 0xc1
-        test.push(0x2002); // LSET  r2 0x00
-        test.push(0x0312); // STORE r1 r2
-        test.push(0x0C0F); // WFI
-        test.push(0x0421); // LOAD  r2 r1
-        test.push(0xe01f); // JMP-  1
+        test.push(0x084d); //  1: FSET  fICF
+        test.push(0x5f5c); //  2: ADDi  rPC $5 rIHP  # line 8
+        test.push(0x1062); //  3: REL+  $6     r2    # line 10
+        test.push(0x0422); //  4: LOAD  r2     r2
+        test.push(0x0312); //  5: STORE r1     r2
+        test.push(0x0c0f); //  6: WFI
+        test.push(0x201f); //  7: REL-  $1     rPC
+        test.push(0x0421); //  8: LOAD  r2     r1
+        test.push(0x201f); //  9: REL-  $1     rPC
+        test.push(0xc100); // 10: Address of the incrementer
 
         test.run();
 
@@ -50,19 +68,20 @@ int main(int argc, char** argv) {
 
         test.exec(0x010d); // MOV   r0    rFLAGS
         test.exec(0x010e); // MOV   r0    rSTACK
-        test.exec(0x401f); // ADDi  r0 $1 rPC
-
-        test.push(0x1c19); // HSET  0xc1  r9
-        test.push(0x2009); // LSET  0x00  r9
-        test.push(0x491a); // ADDi  r9 $1 r10
-        test.push(0x4051); // ADDi  r0 $5 r1
-        test.push(0x4072); // ADDi  r0 $7 r2
-        test.push(0x0319); // STORE r1    r9
-        test.push(0x032a); // STORE r2    r10
-        test.push(0x0c0f); // WFI
-        test.push(0x0491); // LOAD  r9    r1
-        test.push(0x04a2); // LOAD  r10   r2
-        test.push(0xe01f); // JMP-  $1
+        test.exec(0x501f); // ADDi  r0 $1 rPC
+
+        test.push(0x10a9); //  1: REL+  $10   r9     # line 12
+        test.push(0x0499); //  2: LOAD  r9    r9
+        test.push(0x591a); //  3: ADDi  r9 $1 r10
+        test.push(0x5051); //  4: ADDi  r0 $5 r1
+        test.push(0x5072); //  5: ADDi  r0 $7 r2
+        test.push(0x0319); //  6: STORE r1    r9
+        test.push(0x032a); //  7: STORE r2    r10
+        test.push(0x0c0f); //  8: WFI
+        test.push(0x0491); //  9: LOAD  r9    r1
+        test.push(0x04a2); // 10: LOAD  r10   r2
+        test.push(0x201f); // 11: REL-  $1    rPC
+        test.push(0xc100); // 12: Address of the multiplier
 
         test.run();
 
@@ -74,5 +93,857 @@ int main(int argc, char** argv) {
         }
     }
 
+    {
+        // Map a page onto a frame, write through it, then look at the same
+        // frame through a different page
+        std::cout << "Testing MMU... \t\t" << std::flush;
+        Processor test(0x10000);
+        MMU mmu;
+
+        test.useDevice(mmu, 0xc100, 0);
+        test.set(9, 0xc100);  // PAGE
+        test.set(10, 0xc101); // FRAME
+        test.set(11, 0xc102); // CONTROL
+
+        test.set(2, 0x8010);
+        test.exec(0x0302);    // STORE r0 r2
+
+        test.set(1, 0x80);
+        test.exec(0x0319);    // STORE r1 r9
+        test.set(1, 5);
+        test.exec(0x031a);    // STORE r1 r10
+        test.set(1, 1);
+        test.exec(0x031b);    // STORE r1 r11
+
+        test.set(3, 1234);
+        test.exec(0x0332);    // STORE r3 r2
+
+        test.exec(0x030b);    // STORE r0 r11
+        test.exec(0x0424);    // LOAD  r2 r4
+        bool unmapped = test.inspect(4) == 0;
+
+        test.set(1, 0x90);
+        test.exec(0x0319);    // STORE r1 r9
+        test.set(1, 1);
+        test.exec(0x031b);    // STORE r1 r11
+        test.set(2, 0x9010);
+        test.exec(0x0424);    // LOAD  r2 r4
+        bool remapped = test.inspect(4) == 1234;
+
+        // Asking for a frame past the end of the store should fail
+        MMU small(16);
+        test.removeDevice(mmu);
+        test.useDevice(small, 0xc100, 0);
+        test.set(1, 0x20);
+        test.exec(0x031a);    // STORE r1 r10
+        test.set(1, 1);
+        test.exec(0x031b);    // STORE r1 r11
+        test.exec(0x04b4);    // LOAD  r11 r4
+        bool failed = test.inspect(4) == 1;
+
+        // Nor can the page the MMU itself is on
+        test.set(1, 0xc1);
+        test.exec(0x0319);    // STORE r1 r9
+        test.set(1, 0);
+        test.exec(0x031a);    // STORE r1 r10
+        test.set(1, 1);
+        test.exec(0x031b);    // STORE r1 r11
+        test.exec(0x04b4);    // LOAD  r11 r4
+        failed = failed && test.inspect(4) == 1;
+
+        // Once an MMU is gone its pages are back to normal memory
+        {
+            MMU gone(16);
+            test.useDevice(gone, 0xc200, 0);
+            test.set(1, 0x40);
+            test.set(3, 0xc200);
+            test.exec(0x0313);    // STORE r1 r3
+            test.set(1, 1);
+            test.set(3, 0xc202);
+            test.exec(0x0313);    // STORE r1 r3
+            test.set(1, 99);
+            test.set(2, 0x4000);
+            test.exec(0x0312);    // STORE r1 r2
+            test.removeDevice(gone);
+        }
+        test.exec(0x0424);    // LOAD  r2 r4
+        bool restored = test.inspect(4) == 0;
+
+        if (unmapped && remapped && failed && restored) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        // Fill a block, copy it somewhere else with one transfer and wait for
+        // the interrupt
+        std::cout << "Testing DMA... \t\t" << std::flush;
+        Processor test(0x10000);
+        DMA dma;
+
+        test.useDevice(dma, 0xc100, 0);
+        test.exec(0x010d); // MOV   r0    rFLAGS
+        test.exec(0x010e); // MOV   r0    rSTACK
+        test.exec(0x501f); // ADDi  r0 $1 rPC
+
+        test.set(5, 0x3000); // Fill this
+        test.set(6, 0x4000); // then copy it to here
+        test.set(7, 0x1000); // this many words
+
+        test.push(0x10e9); //  1: REL+  $14   r9    # line 16
+        test.push(0x0499); //  2: LOAD  r9    r9
+        test.push(0x5051); //  3: ADDi  r0 $5 r1
+        test.push(0x0319); //  4: STORE r1    r9    # SRC = 5
+        test.push(0x5919); //  5: ADDi  r9 $1 r9
+        test.push(0x0359); //  6: STORE r5    r9    # DEST
+        test.push(0x5919); //  7: ADDi  r9 $1 r9
+        test.push(0x0379); //  8: STORE r7    r9    # LENGTH
+        test.push(0x5919); //  9: ADDi  r9 $1 r9
+        test.push(0x5011); // 10: ADDi  r0 $1 r1
+        test.push(0x0319); // 11: STORE r1    r9    # MODE = fill
+        test.push(0x5919); // 12: ADDi  r9 $1 r9
+        test.push(0x0319); // 13: STORE r1    r9    # go
+        test.push(0x0c0f); // 14: WFI
+        test.push(0x201f); // 15: REL-  $1    rPC
+        test.push(0xc100); // 16: Address of the DMA
+
+        test.run();
+
+        // Second transfer straight from the host side, a copy
+        test.set(9, 0xc100);
+        test.exec(0x0359); // STORE r5 r9  # SRC
+        test.set(9, 0xc101);
+        test.exec(0x0369); // STORE r6 r9  # DEST
+        test.set(9, 0xc103);
+        test.exec(0x0309); // STORE r0 r9  # MODE = copy
+        test.set(9, 0xc104);
+        test.exec(0x0309); // STORE r0 r9  # go
+
+        bool pass = true;
+        for (uint16_t i = 0; i < 0x1000 && pass; ++i) {
+            test.set(1, 0x4000 + i);
+            test.exec(0x0412); // LOAD r1 r2
+            pass = test.inspect(2) == 5;
+        }
+        test.set(1, 0x5000);
+        test.exec(0x0412);     // LOAD r1 r2
+        pass = pass && test.inspect(2) != 5;
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        // Run a few of the vector operations over arrays that aren't a
+        // multiple of the vector width and check them against plain loops
+        std::cout << "Testing VectorUnit... \t" << std::flush;
+        Processor test(0x10000);
+        VectorUnit vec;
+
+        test.useDevice(vec, 0xc100, 0);
+
+        const size_t n = 37;
+        uint16_t a[n], b[n];
+        test.set(RegisterManager::STACK, 0x1000 - 1);
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = i * 2011 + 0x8000;
+            test.push(a[i]);
+        }
+        test.set(RegisterManager::STACK, 0x2000 - 1);
+        for (size_t i = 0; i < n; ++i) {
+            b[i] = i * 1777 + 3;
+            test.push(b[i]);
+        }
+
+        // Set register 'index' of the device to 'value'
+        auto setReg = [&](uint16_t index, uint16_t value) {
+            test.set(1, value);
+            test.set(2, 0xc100 + index);
+            test.exec(0x0312); // STORE r1 r2
+        };
+        auto load = [&](uint16_t address) {
+            test.set(2, address);
+            test.exec(0x0421); // LOAD r2 r1
+            return test.inspect(1);
+        };
+
+        setReg(1, 0x1000);
+        setReg(2, 0x2000);
+        setReg(3, 0x3000);
+        setReg(4, n);
+
+        bool pass = true;
+
+        setReg(0, VectorUnit::ADDS);
+        setReg(5, 1);
+        for (size_t i = 0; i < n && pass; ++i) {
+            uint32_t sum = a[i] + b[i];
+            pass = load(0x3000 + i) == (sum > 0xffff ? 0xffff : sum);
+        }
+
+        setReg(0, VectorUnit::MULHI);
+        setReg(5, 1);
+        for (size_t i = 0; i < n && pass; ++i) {
+            pass = load(0x3000 + i) == ((uint32_t) a[i] * b[i]) >> 16;
+        }
+
+        setReg(0, VectorUnit::DOT);
+        setReg(5, 1);
+        uint64_t dot = 0;
+        for (size_t i = 0; i < n; ++i) dot += (uint32_t) a[i] * b[i];
+        pass = pass && load(0xc106) == (dot & 0xffff) && load(0xc107) == ((dot >> 16) & 0xffff);
+        pass = pass && load(0xc105) == (dot > UINT32_MAX ? 2 : 0);
+
+        // Two products of 0xffff are already too big for 32 bits
+        test.set(RegisterManager::STACK, 0x1000 - 1);
+        test.push(0xffff);
+        test.push(0xffff);
+        setReg(2, 0x1000);
+        setReg(4, 2);
+        setReg(5, 1);
+        pass = pass && load(0xc106) == 0x0002 && load(0xc107) == 0xfffc && load(0xc105) == 2;
+
+        setReg(4, 1);
+        setReg(5, 1);
+        pass = pass && load(0xc106) == 0x0001 && load(0xc107) == 0xfffe && load(0xc105) == 0;
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        // Print a mix of characters and numbers into a pipe, everything
+        // should come out in order once the console is gone
+        std::cout << "Testing Console... \t" << std::flush;
+        int fds[2];
+        pipe(fds);
+
+        bool spaceOK;
+        {
+            Processor test(0x10000);
+            Console con(fds[1], Console::CHARACTER);
+
+            test.useDevice(con, 0xc100, 0);
+            test.set(9, 0xc100);
+            test.set(10, 0xc101);
+
+            const char* text = "Hello ";
+            for (const char* c = text; *c; ++c) {
+                test.set(1, *c);
+                test.exec(0x0319); // STORE r1 r9
+            }
+
+            test.set(1, Console::NUMBER);
+            test.exec(0x031a);     // STORE r1 r10
+            for (uint16_t i = 0; i < 1000; ++i) {
+                test.set(1, i);
+                test.exec(0x0319); // STORE r1 r9
+            }
+
+            test.set(10, 0xc102);
+            test.exec(0x04a1);     // LOAD r10 r1
+            spaceOK = test.inspect(1) <= Console::CAPACITY;
+        }
+        close(fds[1]);
+
+        std::string expected = "Hello ";
+        for (int i = 0; i < 1000; ++i) {
+            expected += std::to_string(i) + "\n";
+        }
+
+        std::string got;
+        char buff[256];
+        ssize_t n;
+        while ((n = read(fds[0], buff, sizeof(buff))) > 0) {
+            got.append(buff, n);
+        }
+        close(fds[0]);
+
+        if (spaceOK && got == expected) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        // Feed some text through a pipe, wait for it to arrive, then read it
+        // all back out through DATA untill the input ends
+        std::cout << "Testing Input... \t" << std::flush;
+        int fds[2];
+        pipe(fds);
+
+        std::string text;
+        for (int i = 0; i < 5000; ++i) {
+            text += 'a' + i % 26;
+        }
+
+        Processor test(0x10000);
+        Input in(fds[0]);
+        test.useDevice(in, 0xc100, 0);
+        test.set(RegisterManager::FLAGS, 0);
+        test.set(9, 0xc100);
+        test.set(10, 0xc101);
+
+        std::thread feeder([&]() {
+            write(fds[1], text.data(), text.size());
+            close(fds[1]);
+        });
+
+        std::string got;
+        bool pass = true;
+        while (pass) {
+            test.exec(0x04a1);     // LOAD r10 r1
+            uint16_t status = test.inspect(1);
+            if (status & 2) break;
+            if (status & 1) {
+                test.exec(0x0491); // LOAD r9 r1
+                got += (char) test.inspect(1);
+            }
+            else {
+                test.exec(0x0c0f); // WFI
+            }
+            pass = got.size() <= text.size();
+        }
+        feeder.join();
+        close(fds[0]);
+
+        if (pass && got == text) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        // Write a sector out synchronously, then read it back into somewhere
+        // else in the background while the processor waits for it
+        std::cout << "Testing BlockDevice... \t" << std::flush;
+        const char* filename = "peripherals-test.disk";
+        remove(filename);
+
+        bool pass = true;
+        for (int async = 0; async < 2; ++async) {
+            Processor test(0x10000);
+            BlockDevice disk(filename, 8, async);
+            test.useDevice(disk, 0xc100, 0);
+            test.set(RegisterManager::FLAGS, 0);
+
+            auto setReg = [&](uint16_t index, uint16_t value) {
+                test.set(1, value);
+                test.set(2, 0xc100 + index);
+                test.exec(0x0312); // STORE r1 r2
+            };
+            auto load = [&](uint16_t address) {
+                test.set(2, address);
+                test.exec(0x0421); // LOAD r2 r1
+                return test.inspect(1);
+            };
+
+            if (!async) {
+                test.set(RegisterManager::STACK, 0x2000 - 1);
+                for (int i = 0; i < 256; ++i) {
+                    test.push(i * 3 + 1);
+                }
+                setReg(0, 5);
+                setReg(2, 0x2000);
+                setReg(3, BlockDevice::WRITE);
+                pass = pass && load(0xc104) == 0;
+            }
+
+            setReg(0, 5);
+            setReg(2, 0x3000);
+            setReg(3, BlockDevice::READ);
+            while (load(0xc104) == 1) {
+                test.exec(0x0c0f); // WFI
+            }
+            pass = pass && load(0xc104) == 0 && load(0xc105) == 8;
+
+            for (int i = 0; i < 256 && pass; ++i) {
+                pass = load(0x3000 + i) == i * 3 + 1;
+            }
+
+            // Sectors past the end are an error, which is kept through a
+            // command that works until STATUS is read
+            setReg(0, 8);
+            setReg(3, BlockDevice::READ);
+            setReg(0, 5);
+            setReg(3, BlockDevice::READ);
+            uint16_t status;
+            while ((status = load(0xc104)) == 1) {
+                test.exec(0x0c0f); // WFI
+            }
+            pass = pass && status == 2 && load(0xc104) == 0;
+        }
+        remove(filename);
+
+        // Without a size the file has to be there already, and isn't made
+        try {
+            BlockDevice missing(filename, 0, false);
+            pass = false;
+        }
+        catch (std::runtime_error& e) {
+            pass = pass && access(filename, F_OK) != 0;
+        }
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        std::cout << "Testing Timer... \t" << std::flush;
+        Processor test(0x10000);
+        Timer timer;
+
+        test.useDevice(timer, 0xc100, 0);
+        test.exec(0x010d); // MOV   r0    rFLAGS
+        test.exec(0x010e); // MOV   r0    rSTACK
+        test.exec(0x501f); // ADDi  r0 $1 rPC
+
+        // Go off every 100 * 10 ticks
+        test.set(1, 100);
+        test.set(9, 0xc100);
+        test.exec(0x0319); // STORE r1 r9  # RELOAD
+        test.set(1, 9);
+        test.set(9, 0xc101);
+        test.exec(0x0319); // STORE r1 r9  # PRESCALE
+        test.set(1, 3);
+        test.set(9, 0xc102);
+        test.exec(0x0319); // STORE r1 r9  # CONTROL = periodic, go
+
+        test.push(0x0c0f); // 1: WFI
+        test.push(0x0c0f); // 2: WFI
+        test.push(0x0c0f); // 3: WFI
+        test.push(0x201f); // 4: REL- $1 rPC
+
+        // Nothing else is happening, so the waits should skip the clock
+        // straight ahead rather than sleeping
+        test.run();
+        bool pass = test.getClock() >= 3000 && test.getClock() < 3010;
+
+        // One shot, then count down part of the way by hand
+        test.set(1, 1);
+        test.exec(0x0319); // STORE r1 r9  # CONTROL = go
+        for (int i = 0; i < 55; ++i) test.tick();
+        test.set(9, 0xc103);
+        test.exec(0x0492); // LOAD r9 r2   # COUNT
+        pass = pass && test.inspect(2) == 95;
+
+        // Other cores on the same memory can't use it, it works on its own
+        // processor's clock
+        {
+            MemoryManager shared(0x10000);
+            Processor owner(shared);
+            Processor other(shared);
+            Timer local;
+            owner.useDevice(local, 0xc100, 0);
+
+            other.set(RegisterManager::FLAGS, 0);
+            other.set(RegisterManager::STACK, 0);
+            other.set(RegisterManager::PC,    1);
+            other.set(1, 7);
+            other.set(9, 0xc100);
+            other.push(0x0319); // 1: STORE r1 r9  # RELOAD
+            other.push(0x0492); // 2: LOAD  r9 r2
+            other.push(0x201f); // 3: REL-  $1 rPC
+            other.run();
+            pass = pass && other.inspect(2) == 0;
+
+            owner.set(1, 5);
+            owner.set(9, 0xc100);
+            owner.exec(0x0492); // LOAD  r9 r2
+            pass = pass && owner.inspect(2) == 0;
+            owner.exec(0x0319); // STORE r1 r9
+            owner.exec(0x0492); // LOAD  r9 r2
+            pass = pass && owner.inspect(2) == 5;
+
+            owner.removeDevice(local);
+        }
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        std::cout << "Testing InterruptController... \t" << std::flush;
+        Processor test(0x10000);
+        InterruptController intc;
+
+        test.useDevice(intc, 0xc100, 0);
+        test.useInterruptController(intc);
+
+        auto setReg = [&](uint16_t index, uint16_t value) {
+            test.set(1, value);
+            test.set(2, 0xc100 + index);
+            test.exec(0x0312); // STORE r1 r2
+        };
+
+        setReg(0, 0x1000);  // Line 0 goes to 0x1000
+        setReg(1, 0x2000);  // Line 1 goes to 0x2000, line 2 uses rIHP
+        setReg(10, 1);      // Line 1 has a higher priority than line 0
+        setReg(18, 1 << 3); // Mask line 3
+
+        test.set(RegisterManager::IHP,   0x3000);
+        test.set(RegisterManager::STACK, 0x8000);
+        test.set(RegisterManager::PC,    0x0100);
+
+        const uint16_t ICF  = 1 << 4;
+        const uint16_t ISF0 = 1 << 8;
+
+        // Both at once, line 1 should go first and line 0 once fICF is set
+        test.set(RegisterManager::FLAGS, ICF);
+        test.interrupt(0);
+        test.interrupt(1);
+        test.tick();
+        bool pass = test.inspect(RegisterManager::PC) == 0x2000;
+        pass = pass && test.inspect(RegisterManager::FLAGS) == ISF0;
+
+        test.set(1, 0xc113);
+        test.exec(0x0412); // LOAD r1 r2   # ACTIVE
+        pass = pass && test.inspect(2) == 1;
+
+        test.set(RegisterManager::FLAGS, test.inspect(RegisterManager::FLAGS) | ICF);
+        test.tick();
+        pass = pass && test.inspect(RegisterManager::PC) == 0x1000;
+        pass = pass && test.inspect(RegisterManager::FLAGS) == 0;
+
+        // Masked lines wait
+        test.set(RegisterManager::FLAGS, ICF);
+        test.interrupt(3);
+        test.tick();
+        pass = pass && test.inspect(RegisterManager::PC) == 0x1001;
+
+        // Line 2 has no vector, so it behaves as if there were no controller
+        test.interrupt(2);
+        test.tick();
+        pass = pass && test.inspect(RegisterManager::PC) == 0x3000;
+        pass = pass && (test.inspect(RegisterManager::FLAGS) & (ISF0 << 2));
+
+        // The handler left fISF set, that alone isn't a new interrupt
+        test.set(RegisterManager::FLAGS, test.inspect(RegisterManager::FLAGS) | ICF);
+        test.tick();
+        pass = pass && test.inspect(RegisterManager::PC) == 0x3001;
+
+        // Line 3 has been waiting all along
+        setReg(18, 0);
+        test.tick();
+        pass = pass && test.inspect(RegisterManager::PC) == 0x3000;
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        std::cout << "Testing Hypercall... \t" << std::flush;
+        Processor test(0x10000);
+        Hypercall hyper;
+
+        test.useDevice(hyper, 0xc100, 0);
+
+        auto store = [&](uint16_t address, uint16_t value) {
+            test.set(1, value);
+            test.set(2, address);
+            test.exec(0x0312); // STORE r1 r2
+        };
+        auto load = [&](uint16_t address) {
+            test.set(1, address);
+            test.exec(0x0412); // LOAD r1 r2
+            return test.inspect(2);
+        };
+        auto call = [&](uint16_t function, std::vector<uint16_t> block) {
+            for (size_t i = 0; i < block.size(); ++i) store(0x100 + i, block[i]);
+            store(0xc100, 0x100);
+            store(0xc101, function);
+            return load(0xc101);
+        };
+        auto storeString = [&](uint16_t address, std::string str) {
+            for (size_t i = 0; i <= str.size(); ++i) store(address + i, str.c_str()[i]);
+        };
+
+        bool pass = true;
+
+        // Strings
+        storeString(0x1000, "hello");
+        storeString(0x2000, "help");
+        pass = pass && call(Hypercall::STRCMP, {0x1000, 0x2000, 0}) == 0;
+        pass = pass && load(0x102) == 0xffff;
+        pass = pass && call(Hypercall::MEMCPY, {0x2000, 0x1000, 6}) == 0;
+        pass = pass && call(Hypercall::STRCMP, {0x1000, 0x2000, 1}) == 0;
+        pass = pass && load(0x102) == 0;
+        pass = pass && call(Hypercall::STRLEN, {0x2000, 0}) == 0;
+        pass = pass && load(0x101) == 5;
+
+        // 0x0001ffff * 0x00010003 = 0x000200004fffd, the long way round
+        store(0x3000, 0xffff); store(0x3001, 0x0001);
+        store(0x3002, 0x0003); store(0x3003, 0x0001);
+        pass = pass && call(Hypercall::MUL, {0x3000, 0x3002, 0x3004, 2}) == 0;
+        pass = pass && load(0x3004) == 0xfffd && load(0x3005) == 0x0004;
+        pass = pass && load(0x3006) == 0x0002 && load(0x3007) == 0x0000;
+
+        // And back again, plus a bit left over
+        store(0x3004, 0xfffe);
+        store(0x3030, 0x0003); store(0x3031, 0x0001);
+        store(0x3032, 0x0000); store(0x3033, 0x0000);
+        pass = pass && call(Hypercall::DIV, {0x3004, 0x3030, 0x3010, 0x3020, 4}) == 0;
+        pass = pass && load(0x3010) == 0xffff && load(0x3011) == 0x0001;
+        pass = pass && load(0x3012) == 0x0000 && load(0x3020) == 0x0001;
+        pass = pass && load(0x3021) == 0x0000;
+
+        store(0x3008, 0);
+        store(0x3009, 0);
+        pass = pass && call(Hypercall::DIV, {0x3004, 0x3008, 0x3010, 0x3020, 2}) == 2;
+
+        // -1234567 in base 10
+        store(0x4000, 0x2979);
+        store(0x4001, 0xffed);
+        pass = pass && call(Hypercall::FORMAT, {0x4000, 2, 10, 1, 0x4100, 0}) == 0;
+        storeString(0x2000, "-1234567");
+        pass = pass && load(0x105) == 8;
+        pass = pass && call(Hypercall::STRCMP, {0x4100, 0x2000, 1}) == 0;
+        pass = pass && load(0x102) == 0;
+
+        pass = pass && call(Hypercall::MEMSET, {0xff00, 7, 0x200}) == 1;
+        pass = pass && call(99, {}) == 2;
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        std::cout << "Testing Channel... \t" << std::flush;
+        Processor sender(0x10000);
+        Processor receiver(0x10000);
+        Channel channel(16);
+
+        sender.useDevice(channel.end(0), 0xc100, 0);
+        receiver.useDevice(channel.end(1), 0xc100, 1);
+
+        // Nothing there yet, so the first word through should interrupt
+        receiver.set(RegisterManager::FLAGS, 1 << 4);
+        receiver.set(RegisterManager::IHP,   0x3000);
+        receiver.set(RegisterManager::STACK, 0x8000);
+        receiver.set(RegisterManager::PC,    0x0100);
+
+        sender.set(1, 0);
+        sender.set(2, 0xc100);
+        sender.exec(0x0312); // STORE r1 r2
+        receiver.tick();
+        bool pass = receiver.inspect(RegisterManager::PC) == 0x3000;
+
+        receiver.set(1, 0xc100);
+        receiver.exec(0x0412); // LOAD r1 r2
+        pass = pass && receiver.inspect(2) == 0;
+
+        // Now lots of words through a small ring, on two threads
+        const uint16_t WORDS = 50000;
+        std::thread other([&]() {
+            sender.set(2, 0xc103);
+            for (uint16_t i = 1; i <= WORDS; ++i) {
+                sender.exec(0x0423);    // LOAD r2 r3   # SPACE
+                while (sender.inspect(3) == 0) {
+                    std::this_thread::yield();
+                    sender.exec(0x0423);
+                }
+
+                sender.set(1, i);
+                sender.set(2, 0xc100);
+                sender.exec(0x0312);    // STORE r1 r2  # DATA
+                sender.set(2, 0xc103);
+            }
+        });
+
+        for (uint16_t i = 1; i <= WORDS && pass; ++i) {
+            receiver.set(1, 0xc102);
+            receiver.exec(0x0412);      // LOAD r1 r2   # COUNT
+            while (receiver.inspect(2) == 0) {
+                std::this_thread::yield();
+                receiver.exec(0x0412);
+            }
+
+            receiver.set(1, 0xc100);
+            receiver.exec(0x0412);      // LOAD r1 r2   # DATA
+            pass = receiver.inspect(2) == i;
+        }
+        other.join();
+
+        // Fill it up and one more gets lost
+        for (int i = 0; i < 17; ++i) {
+            sender.set(2, 0xc100);
+            sender.exec(0x0312);        // STORE r1 r2
+        }
+        sender.set(2, 0xc101);
+        sender.exec(0x0423);            // LOAD r2 r3   # STATUS
+        pass = pass && sender.inspect(3) == 4;
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        std::cout << "Testing Atomic... \t" << std::flush;
+        const int CORES = 4;
+
+        MemoryManager shared(0x10000);
+        std::vector<Processor*> cores;
+        for (int i = 0; i < CORES; ++i) cores.push_back(new Processor(shared));
+
+        Atomic atomic;
+        cores[0]->useDevice(atomic, 0xc200, 0);
+
+        // Every core adds 1 to the word at 0x4000 a thousand times, holding
+        // lock 0 while it does
+        cores[0]->set(RegisterManager::STACK, 0);
+        cores[0]->push(0x0452); //  1: LOAD  r5    r2    # take the lock
+        cores[0]->push(0x5202); //  2: ADDi  r2 $0 r2
+        cores[0]->push(0x070f); //  3: FPRED fZERO
+        cores[0]->push(0x101f); //  4: REL+  $1    rPC   # got it
+        cores[0]->push(0x205f); //  5: REL-  $5    rPC   # line 1
+        cores[0]->push(0x0463); //  6: LOAD  r6    r3
+        cores[0]->push(0x5313); //  7: ADDi  r3 $1 r3
+        cores[0]->push(0x0336); //  8: STORE r3    r6
+        cores[0]->push(0x0305); //  9: STORE r0    r5    # let it go
+        cores[0]->push(0x8717); // 10: SUBi  r7 $1 r7
+        cores[0]->push(0x070f); // 11: FPRED fZERO
+        cores[0]->push(0x101f); // 12: REL+  $1    rPC   # line 14
+        cores[0]->push(0x20df); // 13: REL-  $13   rPC   # line 1
+        cores[0]->push(0x201f); // 14: REL-  $1    rPC
+
+        for (Processor* core : cores) {
+            core->set(RegisterManager::FLAGS, 0);
+            core->set(RegisterManager::PC,    1);
+            core->set(0, 0);
+            core->set(5, 0xc200);
+            core->set(6, 0x4000);
+            core->set(7, 1000);
+        }
+        shared[0x4000] = 0;
+
+        std::vector<std::thread> threads;
+        for (Processor* core : cores) {
+            threads.push_back(std::thread(&Processor::run, core));
+        }
+        for (std::thread& t : threads) t.join();
+
+        bool pass = shared.read(0x4000) == CORES * 1000;
+
+        // Counters hand out numbers in order
+        pass = pass && shared.read(0xc210) == 0 && shared.read(0xc210) == 1;
+
+        cores[0]->removeDevice(atomic);
+        for (Processor* core : cores) delete core;
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
+
+    {
+        std::cout << "Testing owned devices... \t" << std::flush;
+
+        // These run on the host as soon as they are written to, so two
+        // cores running at once can only share them if one is refused
+        MemoryManager shared(0x10000);
+        Processor owner(shared);
+        Processor other(shared);
+
+        DMA dma;
+        VectorUnit vec;
+        Hypercall hyper;
+        MMU mmu;
+        owner.useDevice(dma,   0xc100, 0);
+        owner.useDevice(vec,   0xc108, 0);
+        owner.useDevice(hyper, 0xc110, 0);
+        owner.useDevice(mmu,   0xc118, 0);
+
+        // Both store r1 to the first register of each device and read them
+        // back, a thousand times
+        owner.set(RegisterManager::STACK, 0);
+        owner.push(0x0317); //  1: STORE r1  r7
+        owner.push(0x0318); //  2: STORE r1  r8
+        owner.push(0x0319); //  3: STORE r1  r9
+        owner.push(0x031a); //  4: STORE r1  r10
+        owner.push(0x0472); //  5: LOAD  r7  r2
+        owner.push(0x0483); //  6: LOAD  r8  r3
+        owner.push(0x0494); //  7: LOAD  r9  r4
+        owner.push(0x04a5); //  8: LOAD  r10 r5
+        owner.push(0x8616); //  9: SUBi  r6 $1 r6
+        owner.push(0x070f); // 10: FPRED fZERO
+        owner.push(0x101f); // 11: REL+  $1  rPC   # line 13
+        owner.push(0x20cf); // 12: REL-  $12 rPC   # line 1
+        owner.push(0x201f); // 13: REL-  $1  rPC
+
+        Processor* cores[2] = {&owner, &other};
+        for (Processor* core : cores) {
+            core->set(RegisterManager::FLAGS, 0);
+            core->set(RegisterManager::PC,    1);
+            core->set(0, 0);
+            core->set(6,  1000);
+            core->set(7,  0xc100);
+            core->set(8,  0xc108);
+            core->set(9,  0xc110);
+            core->set(10, 0xc118);
+        }
+        owner.set(1, 5);
+        other.set(1, 9);
+
+        std::thread t(&Processor::run, &other);
+        owner.run();
+        t.join();
+
+        bool pass = true;
+        for (size_t i = 2; i <= 5; ++i) {
+            pass = pass && owner.inspect(i) == 5 && other.inspect(i) == 0;
+        }
+        pass = pass && shared.read(0xc100) == 5 && shared.read(0xc108) == 5
+                    && shared.read(0xc110) == 5 && shared.read(0xc118) == 5;
+
+        owner.removeDevice(mmu);
+        owner.removeDevice(hyper);
+        owner.removeDevice(vec);
+        owner.removeDevice(dma);
+
+        if (pass) {
+            std::cout << "OK!" << std::endl;
+        }
+        else {
+            std::cout << "Fail" << std::endl;
+        }
+    }
     return 0;
 }
@@ -0,0 +1,308 @@
+/*
+ * objdump.cpp
+ *
+ * Disassembles a program image, split into basic blocks with the loops they
+ * are in. See Disassembler.hpp for how code is told apart from data.
+ *
+ *     leek-objdump {image} [-x] [-e address]... [-p profile] [-t trace] [-n top]
+ *
+ * The image is read the way leek-vm reads it, -x for hexadecimal, and is
+ * loaded from address 1. Code is found from address 1 and from each -e
+ * address, written in hexadecimal, so add the interrupt handler with -e if
+ * only the program sets up rIHP.
+ *
+ * Give a profile to see where the time goes. -p takes the words csv from
+ * leek-vm -M and -t an instruction trace from leek-vm -T. Every block is
+ * then shown with how often it ran and its share of all instructions, and
+ * the 'top' hottest blocks (10 by default) are listed at the end.
+ *
+ * -- Callum Nicholson
+ */
+#include "Disassembler.hpp"
+#include "InstructionTrace.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+typedef Disassembler::Block Block;
+typedef Disassembler::Loop  Loop;
+
+void usage() {
+    std::cerr << "Usage: leek-objdump {image} [-x] [-e address]... [-p profile] "
+              << "[-t trace] [-n top]" << std::endl;
+}
+
+// The same as leek-vm, so the addresses line up
+bool load(const char* filename, bool hexMode, std::vector<uint16_t>& memory,
+        uint32_t& end) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+
+    end = 1;
+    while (in.peek() != std::ifstream::traits_type::eof() && end < 0x10000) {
+        uint16_t instruction;
+        if (hexMode) {
+            in >> std::ws;
+            if (in.peek() == std::ifstream::traits_type::eof()) break;
+            if (in.peek() == '#') {
+                in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                continue;
+            }
+            char buff[5];
+            in.read(buff, 4);
+            buff[4] = 0;
+            instruction = strtoul(buff, NULL, 16);
+        }
+        else {
+            instruction = in.get() << 8;
+            instruction |= in.get() & 0xff;
+        }
+        memory[end++] = instruction;
+    }
+    return true;
+}
+
+// The words csv from leek-vm -M, address,page,fetches,loads,stores
+bool loadProfile(const char* filename, std::vector<uint64_t>& fetches) {
+    std::ifstream in(filename);
+    if (!in) return false;
+
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        char* pos;
+        unsigned long address = strtoul(line.c_str(), &pos, 10);
+        if (*pos != ',' || address >= fetches.size()) continue;
+        pos = strchr(pos + 1, ',');
+        if (!pos) continue;
+        fetches[address] += strtoull(pos + 1, NULL, 10);
+    }
+    return true;
+}
+
+void loadTrace(const char* filename, std::vector<uint64_t>& fetches) {
+    InstructionTrace::Reader reader(filename);
+    InstructionTrace::Record rec;
+    while (reader.next(rec)) {
+        ++fetches[rec.pc];
+    }
+}
+
+void hex(std::ostream& out, uint16_t value) {
+    out << std::hex << std::setfill('0') << std::setw(4) << value
+        << std::dec << std::setfill(' ');
+}
+
+// "runs 12  fetches 60 (4.1%)" for a range of words
+void printCounts(std::ostream& out, const std::vector<uint64_t>& fetches,
+        uint64_t total, uint16_t first, uint64_t sum) {
+    out << "  runs " << fetches[first] << "  fetches " << sum << " ("
+        << std::fixed << std::setprecision(1)
+        << (total ? 100.0 * sum / total : 0.0) << "%)";
+}
+
+uint64_t sumBlock(const std::vector<uint64_t>& fetches, const Block& b) {
+    uint64_t sum = 0;
+    for (uint32_t a = b.start; a <= b.end; ++a) sum += fetches[a];
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    const char* filename    = NULL;
+    const char* profileName = NULL;
+    const char* traceName   = NULL;
+    bool hexMode = false;
+    size_t top = 10;
+    std::vector<uint16_t> entries;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-x")) {
+            hexMode = true;
+        }
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+            entries.push_back(strtoul(argv[++i], NULL, 16));
+        }
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            profileName = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            traceName = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            top = strtoul(argv[++i], NULL, 10);
+        }
+        else if (argv[i][0] != '-' && !filename) {
+            filename = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (!filename) {
+        usage();
+        return 1;
+    }
+
+    std::vector<uint16_t> memory(0x10000, 0);
+    uint32_t end;
+    if (!load(filename, hexMode, memory, end)) {
+        std::cerr << "Could not open " << filename << std::endl;
+        return 1;
+    }
+
+    std::vector<uint64_t> fetches(0x10000, 0);
+    bool profiled = profileName || traceName;
+    if (profileName && !loadProfile(profileName, fetches)) {
+        std::cerr << "Could not open " << profileName << std::endl;
+        return 1;
+    }
+    if (traceName) {
+        try {
+            loadTrace(traceName, fetches);
+        }
+        catch (std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    uint64_t total = 0;
+    for (uint64_t f : fetches) total += f;
+
+    Disassembler dis(memory);
+    dis.addEntry(1);
+    for (uint16_t e : entries) dis.addEntry(e);
+    dis.analyse();
+
+    const std::map<uint16_t, Block>& blocks = dis.blocks();
+    const std::vector<Loop>& loops = dis.loops();
+
+    // The listing, code as blocks and anything else in the image as data
+    std::vector<uint16_t> next;
+    bool inData = false;
+    for (uint32_t address = 1; address < 0x10000; ++address) {
+        bool isCode = dis.isCode(address);
+        if (!isCode && address >= end) continue;
+
+        if (isCode && blocks.count(address)) {
+            const Block& b = blocks.at(address);
+            std::cout << std::endl << "block ";
+            hex(std::cout, b.start);
+            if (b.entry) std::cout << "  entry";
+            if (b.loop != Disassembler::NO_LOOP) {
+                std::cout << "  loop ";
+                hex(std::cout, loops[b.loop].header);
+                std::cout << " depth " << loops[b.loop].depth;
+            }
+            if (profiled) printCounts(std::cout, fetches, total, b.start, sumBlock(fetches, b));
+            std::cout << std::endl;
+            inData = false;
+        }
+        else if (!isCode && !inData) {
+            std::cout << std::endl << "data" << std::endl;
+            inData = true;
+        }
+
+        std::cout << "    ";
+        hex(std::cout, address);
+        std::cout << "  ";
+        hex(std::cout, memory[address]);
+        std::cout << "    ";
+
+        if (!isCode) {
+            std::cout << "LIT     0x";
+            hex(std::cout, memory[address]);
+            std::cout << std::endl;
+            continue;
+        }
+
+        std::string text = Disassembler::text(memory[address]);
+        std::cout << text;
+
+        // Say where jumps go, and where each block can go next
+        next.clear();
+        bool known = Disassembler::successors(address, memory[address], next);
+        if (known && next.size() == 1 && next[0] != (uint16_t) (address + 1)) {
+            std::cout << std::string(text.size() < 32 ? 32 - text.size() : 1, ' ') << "; ";
+            hex(std::cout, next[0]);
+        }
+        std::cout << std::endl;
+
+        auto it = blocks.upper_bound(address);
+        if (it == blocks.begin()) continue;
+        const Block& b = (--it)->second;
+        if (b.end != address) continue;
+        std::cout << "    ->";
+        for (uint16_t s : b.successors) {
+            std::cout << " ";
+            hex(std::cout, s);
+        }
+        if (b.indirect) std::cout << " ?";
+        if (b.halts)    std::cout << " (halt)";
+        std::cout << std::endl;
+    }
+
+    if (!loops.empty()) {
+        std::cout << std::endl << "loops" << std::endl
+                  << "    header  depth  parent  blocks  words  latches" << std::endl;
+        for (const Loop& l : loops) {
+            uint64_t words = 0, sum = 0;
+            for (uint16_t start : l.blocks) {
+                const Block& b = blocks.at(start);
+                words += b.end - b.start + 1;
+                sum   += sumBlock(fetches, b);
+            }
+
+            std::cout << "    ";
+            hex(std::cout, l.header);
+            std::cout << "    " << std::setw(5) << std::left << l.depth << "  ";
+            if (l.parent == Disassembler::NO_LOOP) {
+                std::cout << "-     ";
+            }
+            else {
+                hex(std::cout, loops[l.parent].header);
+                std::cout << "  ";
+            }
+            std::cout << "  " << std::setw(6) << l.blocks.size()
+                      << "  " << std::setw(5) << words << std::right << " ";
+            for (uint16_t latch : l.latches) {
+                std::cout << " ";
+                hex(std::cout, latch);
+            }
+            if (profiled) printCounts(std::cout, fetches, total, l.header, sum);
+            std::cout << std::endl;
+        }
+    }
+
+    if (profiled) {
+        std::vector<std::pair<uint64_t, uint16_t>> hottest;
+        for (auto& kv : blocks) {
+            uint64_t sum = sumBlock(fetches, kv.second);
+            if (sum) hottest.push_back(std::make_pair(sum, kv.first));
+        }
+        std::sort(hottest.rbegin(), hottest.rend());
+        if (hottest.size() > top) hottest.resize(top);
+
+        std::cout << std::endl << "hottest blocks, of " << total
+                  << " instructions" << std::endl;
+        for (auto& h : hottest) {
+            std::cout << "    ";
+            hex(std::cout, h.second);
+            printCounts(std::cout, fetches, total, h.second, h.first);
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
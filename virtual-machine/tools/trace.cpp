@@ -0,0 +1,228 @@
+/*
+ * trace.cpp
+ *
+ * Looks through instruction traces recorded with leek-vm -T. The trace is
+ * read a block at a time, so it can be far bigger than memory.
+ *
+ *     leek-trace stats  {trace} [-n top]
+ *     leek-trace find   {trace} {field}={value} [-n max]
+ *     leek-trace window {trace} {index | field=value} [-r radius]
+ *
+ * stats counts instructions, interrupts and instructions by opcode, and lists
+ * the 'top' busiest addresses (10 by default). find prints every record where
+ * 'field' (pc, instr, value or flags) has 'value', written in hexadecimal, up
+ * to 'max' of them. window prints 'radius' records either side (8 by
+ * default) of the record at 'index', or of the first record that matches.
+ *
+ * -- Callum Nicholson
+ */
+#include "InstructionTrace.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+
+typedef InstructionTrace::Record Record;
+
+void usage() {
+    std::cerr << "Usage: leek-trace stats  {trace} [-n top]" << std::endl
+              << "       leek-trace find   {trace} {field}={value} [-n max]" << std::endl
+              << "       leek-trace window {trace} {index | field=value} [-r radius]" << std::endl;
+}
+
+void print(const Record& rec) {
+    std::cout << std::dec << std::setw(12) << std::setfill(' ') << rec.index
+              << std::hex << std::setfill('0')
+              << "  pc " << std::setw(4) << rec.pc
+              << "  instr " << std::setw(4) << rec.instruction
+              << "  value " << std::setw(4) << rec.value
+              << "  flags " << std::setw(4) << rec.flags
+              << (rec.interrupted ? "  interrupted" : "")
+              << std::dec << std::setfill(' ') << std::endl;
+}
+
+// Picks out one of the fields by name, as used by find and window
+struct Match {
+    int field;
+    uint16_t value;
+
+    bool parse(const char* arg) {
+        static const char* FIELDS[] = {"pc", "instr", "value", "flags"};
+
+        const char* eq = strchr(arg, '=');
+        if (!eq) return false;
+        std::string name(arg, eq - arg);
+        for (field = 0; field < 4; ++field) {
+            if (name == FIELDS[field]) break;
+        }
+        if (field == 4) return false;
+
+        value = strtoul(eq + 1, NULL, 16);
+        return true;
+    }
+
+    bool operator()(const Record& rec) const {
+        switch (field) {
+            case 0:  return rec.pc == value;
+            case 1:  return rec.instruction == value;
+            case 2:  return rec.value == value;
+            default: return rec.flags == value;
+        }
+    }
+};
+
+int stats(InstructionTrace::Reader& reader, size_t top) {
+    uint64_t count = 0;
+    uint64_t interrupts = 0;
+
+    // Long operations by their top 4 bits, the rest by the next 4
+    uint64_t ops[32] = {0};
+    std::vector<uint64_t> pcs(0x10000, 0);
+
+    Record rec;
+    while (reader.next(rec)) {
+        ++count;
+        if (rec.interrupted) ++interrupts;
+
+        uint8_t opHi = rec.instruction >> 12;
+        uint8_t opLo = (rec.instruction >> 8) & 0xf;
+        ++ops[opHi ? 16 + opHi : opLo];
+        ++pcs[rec.pc];
+    }
+
+    std::cout << "instructions  " << count << std::endl;
+    std::cout << "interrupts    " << interrupts << std::endl;
+
+    std::cout << std::endl << "opcode        count" << std::endl;
+    for (int i = 0; i < 32; ++i) {
+        if (!ops[i]) continue;
+        std::cout << std::hex << std::setfill('0')
+                  << (i < 16 ? "0" : "") << std::setw(1) << (i < 16 ? i : i - 16)
+                  << (i < 16 ? "xx" : "xxx") << std::dec << std::setfill(' ')
+                  << "          " << ops[i] << std::endl;
+    }
+
+    std::vector<std::pair<uint64_t, uint16_t>> busiest;
+    for (size_t pc = 0; pc < pcs.size(); ++pc) {
+        if (pcs[pc]) busiest.push_back(std::make_pair(pcs[pc], pc));
+    }
+    std::sort(busiest.rbegin(), busiest.rend());
+    if (busiest.size() > top) busiest.resize(top);
+
+    std::cout << std::endl << "pc            count" << std::endl;
+    for (auto& b : busiest) {
+        std::cout << std::hex << std::setfill('0') << std::setw(4) << b.second
+                  << std::dec << std::setfill(' ') << "          " << b.first
+                  << std::endl;
+    }
+    return 0;
+}
+
+int find(InstructionTrace::Reader& reader, const Match& match, uint64_t max) {
+    uint64_t found = 0;
+    Record rec;
+    while (found < max && reader.next(rec)) {
+        if (match(rec)) {
+            print(rec);
+            ++found;
+        }
+    }
+    return found ? 0 : 1;
+}
+
+int window(InstructionTrace::Reader& reader, const Match* match, uint64_t index,
+        size_t radius) {
+    // Only the records before the event are kept, the ones after are
+    // printed as they come
+    std::deque<Record> before;
+    Record rec;
+    bool found = false;
+    while (reader.next(rec)) {
+        if (match ? (*match)(rec) : rec.index == index) {
+            found = true;
+            break;
+        }
+        before.push_back(rec);
+        if (before.size() > radius) before.pop_front();
+    }
+    if (!found) {
+        std::cerr << "No such record" << std::endl;
+        return 1;
+    }
+
+    for (const Record& r : before) print(r);
+    std::cout << ">>" << std::endl;
+    print(rec);
+    std::cout << "<<" << std::endl;
+    for (size_t i = 0; i < radius && reader.next(rec); ++i) print(rec);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    std::string command = argv[1];
+    const char* filename = argv[2];
+
+    // What is left is the event for find and window, then the options
+    const char* event = NULL;
+    uint64_t limit = 0;
+    int i = 3;
+    if (command != "stats") {
+        if (argc < 4) {
+            usage();
+            return 1;
+        }
+        event = argv[3];
+        i = 4;
+    }
+    for (; i < argc; ++i) {
+        if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "-r")) && i + 1 < argc) {
+            limit = strtoull(argv[++i], NULL, 10);
+        }
+        else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        InstructionTrace::Reader reader(filename);
+
+        if (command == "stats") {
+            return stats(reader, limit ? limit : 10);
+        }
+
+        Match match;
+        bool isMatch = match.parse(event);
+        if (command == "find") {
+            if (!isMatch) {
+                usage();
+                return 1;
+            }
+            return find(reader, match, limit ? limit : UINT64_MAX);
+        }
+        if (command == "window") {
+            uint64_t index = isMatch ? 0 : strtoull(event, NULL, 10);
+            return window(reader, isMatch ? &match : NULL, index, limit ? limit : 8);
+        }
+    }
+    catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    usage();
+    return 1;
+}